@@ -5,6 +5,9 @@
 #define ANSI_COLOR_MAGENTA "\x1b[35m"
 #define ANSI_COLOR_CYAN    "\x1b[36m"
 #define ANSI_COLOR_RESET   "\x1b[0m"""
+//most specialized copies of functions made for constant function pointer arguments
+#define MAX_CLONES 16
+#define MAX_ARRAY_DIMS 8
 #define MIN3(a, b, c) ((a) < (b) ? ((a) < (c) ? (a) : (c)) : ((b) < (c) ? (b) : (c)))
 
 #include <stdio.h>
@@ -13,6 +16,13 @@
 #include <string.h>
 #include <ctype.h>
 #include <inttypes.h>
+#include <time.h>
+#include <stdarg.h>
+#include <elf.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <dlfcn.h>
 
 enum token_type {
     IF_KWD,
@@ -75,12 +85,17 @@ enum token_type {
     FOR,
     PLUS_PLUS,
     MINUS_MINUS,
-    CONTINUE
+    CONTINUE,
+    ARENA_KWD,
+    SOA_KWD,
+    PACKED_KWD,
+    CONST_KWD,
+    STRING
 };
 
-static int numTokenTypes = 61;
+static int numTokenTypes = 66;
 
-char* tokenStrings[61]= {"IF", "ELSE", "WHILE", "FUN", "RETURN", "PRINT", "FUSION/STRUCT", "TYPE", "BELL", "DELAY", "-", "/", "%", "REFERENCE", "DEREFERENCE", "WINDOW_START", "WINDOW_END", "PLAY", "KBDOWNLOGIC", "KBDOWNEND", "KBUPLOGIC", "KBUPEND", "EQ", "DEFINE", "==", "<", ">", "<>", "AND", "OR", "XOR", "SEMI", "[", "]", ",", ".", "(", ")", "{", "}", "+", "*", "ID", "INTEGER", "USER_OP", "END", "SWITCH", "CASE", "BREAK", "DEFAULT", "LONG", "BOOLEAN", "CHAR", "TRUE", "FALSE", ":", "?", "FOR", "++", "--","CONTINUE"};
+char* tokenStrings[66]= {"IF", "ELSE", "WHILE", "FUN", "RETURN", "PRINT", "FUSION/STRUCT", "TYPE", "BELL", "DELAY", "-", "/", "%", "REFERENCE", "DEREFERENCE", "WINDOW_START", "WINDOW_END", "PLAY", "KBDOWNLOGIC", "KBDOWNEND", "KBUPLOGIC", "KBUPEND", "EQ", "DEFINE", "==", "<", ">", "<>", "AND", "OR", "XOR", "SEMI", "[", "]", ",", ".", "(", ")", "{", "}", "+", "*", "ID", "INTEGER", "USER_OP", "END", "SWITCH", "CASE", "BREAK", "DEFAULT", "LONG", "BOOLEAN", "CHAR", "TRUE", "FALSE", ":", "?", "FOR", "++", "--","CONTINUE", "ARENA", "SOA", "PACKED", "CONST", "STRING"};
 
 union token_value {
     char *id;
@@ -97,24 +112,35 @@ struct swit_entry{
     uint64_t value;
     int casecount;
     int switchnum;
-    struct swit_entry *next;
+    int profile_key;
 };
 
 struct struct_var {
     char* name;
     int type;
+    //byte offset in the struct, and whether a struct type is stored inline rather than as a
+    //pointer to a struct of its own, which it is for pointer fields
+    int offset;
+    int is_inline;
+    //nonzero for a char or boolean, which takes a single byte
+    int is_byte;
 };
 
 struct struct_data {
     int id;
     struct struct_var* data;
     int type_count;
+    //the size in words, with inline structs counted in full
+    int words;
+    //nonzero if every word is a scalar, none a pointer to another struct
+    int flat;
 };
 
 struct token {
     enum token_type type;
     union token_value value;
     int line_num;
+    int index; //position in the token list, identifies profile counters across compilations
     struct token *next;
     struct token *prev;
 };
@@ -130,6 +156,44 @@ struct trie_node {
     char ch;
     //which type the variable is
     int var_type;
+    //for a global initialized with a literal, its value and whether nothing ever writes it
+    uint64_t init_value;
+    int is_constant;
+    //for a struct global laid out in .data, its struct type, 0 otherwise
+    int init_struct;
+    //for an array declared with literal sizes, the size of each dimension; 0 dimensions if they
+    //are not known here, as for a parameter
+    int dims[MAX_ARRAY_DIMS];
+    int dim_count;
+    //for an array of structs, their type, and whether each field is kept in a column of its own
+    int element_struct;
+    int soa;
+    //the bits each element of an array of scalars takes: 64 for a word, 8 for a char or boolean
+    //and 1 for a packed boolean
+    int element_bits;
+    //for a struct replaced by its fields, the offset of the first one from %rbp, 0 otherwise
+    int fields_at;
+    //for a pointer, the bytes between the elements it steps over, 0 otherwise
+    int pointer_stride;
+    //for an array initialized with a list of literals, the table holding them, 0 otherwise
+    struct table_data *table;
+};
+
+//the elements of an array initialized with a list of literals, assembled into .rodata, or into
+//.data for a global the program writes to
+struct table_data {
+    //the name of the array and the index of its token, which make up the label
+    char *id;
+    int index;
+    int dims[MAX_ARRAY_DIMS];
+    int dim_count;
+    //8 for words, 1 for chars and booleans
+    int bytes;
+    uint64_t *values;
+    int count;
+    int total;
+    int writable;
+    struct table_data *next;
 };
 
 struct var_namespace {
@@ -141,9 +205,22 @@ struct var_namespace {
 struct fun_signature {
     char *funId;
     char **variableType;    
+    char **paramId;
+    int param_count;
+    //bit n is set if parameter n is a funp that is never assigned, so a constant can replace it
+    unsigned int funp_mask;
+    struct token *start;
     struct fun_signature *next;
 };
 
+//a copy of a function compiled with some funp parameters bound to known functions
+struct fun_clone {
+    char *name;
+    struct fun_signature *signature;
+    char **bound;
+    struct fun_clone *next;
+};
+
 //used to store user operators, their symbols, and the expressions they represent
 struct user_operator {
     struct user_operator *next;
@@ -156,6 +233,7 @@ struct user_operator {
 };
 
 int getVarType(char*);
+struct trie_node *findVar(char *id);
 
 static jmp_buf escape;
 
@@ -168,7 +246,12 @@ static struct token *current_token;
 
 static struct var_namespace *namespace_head;
 
-//static struct fun_signature *signature_head;
+static struct fun_signature *signature_head;
+static struct fun_clone *clone_head;
+static struct fun_clone *clone_tail;
+static int clone_count = 0;
+//the clone being compiled, 0 while compiling the functions as written
+static struct fun_clone *current_clone;
 
 static unsigned int if_count = 0;
 static unsigned int while_count = 0;
@@ -179,13 +262,83 @@ static unsigned int switch_count = 0;
 static unsigned int case_count = 0;
 static struct swit_token * swithead = NULL;
 static struct swit_token * switinsert = NULL;
-static struct swit_entry * switenhead = NULL;
+//cases of the switch being compiled, sorted by value before the dispatch code is generated
+static struct swit_entry * switch_cases = NULL;
+static int switch_case_count = 0;
+static int switch_case_size = 0;
+static int *switch_clusters = NULL;
+static unsigned int switch_node_count = 0;
 static unsigned int defaultflag = 0;
 static unsigned int caseflag = 0;
 static unsigned int runswiflag = 0;
-static unsigned int globalbreakcount = 0;
 
-static int num_global_vars = 0;
+//labels of the innermost loop: break jumps to <loop_kind>_end_<loop_num>, continue to <loop_kind>_next_<loop_num>
+static char *loop_kind = "while";
+static unsigned int loop_num = 0;
+
+//marks of open arena blocks that a jump out of them has to leave: the outermost one in the function
+//for return, the outermost one inside the innermost loop for break and continue; 0 if there is none.
+//The assembly keeps a mark in a frame slot and names it by offset, the C backend numbers them.
+static int arena_function_mark = 0;
+static int arena_loop_mark = 0;
+static int print_arena_stats = 0;
+
+//condition code of a comparison whose result is still in the flags, 0 if the result is in a register
+static char *pending_cc = 0;
+
+//what the operand just parsed looks like, used to pick between branchy and branch-free code
+static int operand_is_bool = 0;
+static int operand_calls = 0;
+static int operand_loads = 0;
+static unsigned int logic_count = 0;
+
+//where the value of the operand just parsed lives: a register, an immediate or a memory operand
+static char value_loc[64] = "%rax";
+
+//accumulators used by e2 through e6, as bits for live_regs and touched_regs
+enum accumulator {
+    REG_R13 = 1,
+    REG_R14 = 2,
+    REG_R15 = 4,
+    REG_RBX = 8,
+    REG_R8 = 16,
+    REG_R9 = 32
+};
+static char *registerNames[6] = {"%r13", "%r14", "%r15", "%rbx", "%r8", "%r9"};
+//accumulators holding a value an enclosing level still needs, and accumulators written so far
+static int live_regs = 0;
+static int touched_regs = 0;
+
+//frame layout of the function being compiled, fixed once its body has been generated
+static int frame_slots = 0;
+static int frame_pushes = 0;
+static int makes_calls = 0;
+//-O level; -O2 also vectorizes loops
+static int opt_level = 0;
+
+//--profile-generate: file the instrumented program writes its counters to, and the key of each counter
+static char *profile_file = 0;
+static int *profile_keys = 0;
+static int profile_size = 0;
+//--profile-use: counts read back, indexed by key, and the largest of them
+static char *profile_use = 0;
+static uint64_t *profile_data = 0;
+static uint64_t profile_max = 0;
+static int token_count = 0;
+//hash of the types and spellings of all tokens, written into a profile so it only fits the same source
+static uint64_t token_hash = 0;
+//the fun token of the function being compiled
+static struct token *function_token = 0;
+
+//initializers of globals that need code to run, collected into globals_init
+static FILE *global_init = 0;
+static char *global_init_code = 0;
+static size_t global_init_size = 0;
+//every table of the program, in program order
+static struct table_data *table_head = 0;
+//the string literals of the program, each once, numbered from 0 for their labels
+static char **string_literals = 0;
+static int string_literal_count = 0;
 static char *function_name;
 
 static int struct_count = 0;
@@ -198,6 +351,10 @@ static int standardTypeCount = 0;
 static int variableType = 2;
 static int struct_decode_type = 0;
 static int struct_decode_type_np = 0;
+//the size in words of an inline struct that a field assignment copies into, 0 for a single word
+static int struct_decode_words = 0;
+//nonzero if the field an assignment stores to is a char or boolean, which takes a byte
+static int struct_decode_byte = 0;
 /*static int perform = 1;*/
 
 static struct user_operator* user_ops; //stores linked list of user operators
@@ -296,12 +453,15 @@ void convertToUpperCase(char *sPtr)
 }
 
 void detectMispelledKeyword(char* id){
-    convertToUpperCase(id);
+    //the id still names the token, so a copy is uppercased
+    char *upper = strdup(id);
+    convertToUpperCase(upper);
     for(int i = 0; i < numTokenTypes; i++){
-	if(levenshtein(tokenStrings[i], id) < 2){
-	    fprintf(stderr, "Maybe instead of %s you meant %s\n", id, tokenStrings[i]);
+	if(levenshtein(tokenStrings[i], upper) < 2){
+	    fprintf(stderr, "Maybe instead of %s you meant %s\n", upper, tokenStrings[i]);
 	}
     }
+    free(upper);
 }
 
 void error_missingVariable(char* id){
@@ -334,6 +494,7 @@ void addStandardTypes() {
     addType("char");
     addType("long");
     addType("funp");
+    addType("string");
     standardTypeCount = definedTypeCount;
 }
 
@@ -357,20 +518,52 @@ int isVarStruct(char* name){
     return getVarType(name) >= standardTypeCount;
 }
 
-//figures out what index a certain variable is in a struct
-int getVarIndexInStruct(char* varName, int structType){
-    for(int i = 0; i < struct_count; i++){
-        if(struct_info[i].id == structType){
-            for(int j = 0; j < struct_info[i].type_count; j++){
-                char* struct_var = struct_info[i].data[j].name;
-                if(strcmp(struct_var, varName) == 0){
-                    return j;
-                }
+/* returns the fields of a struct type, 0 if it is not defined (yet) */
+struct struct_data *findStructLayout(int structType) {
+    for (int i = 0; i < struct_count; i++) {
+        if (struct_info[i].id == structType) {
+            return &struct_info[i];
+        }
+    }
+    return 0;
+}
+
+/* nonzero if the struct type is defined and can be laid out without any other allocation */
+int isFlatStruct(int structType) {
+    struct struct_data *layout = findStructLayout(structType);
+    return layout != 0 && layout->flat && layout->words > 0;
+}
+
+/* the value a word of a flat struct starts out with: 333 in a word field, 0 in the bytes of char
+   and boolean fields */
+uint64_t structFillWord(struct struct_data *layout, int word) {
+    for (int i = 0; i < layout->type_count; i++) {
+        struct struct_var *field = &layout->data[i];
+        if (field->is_inline) {
+            struct struct_data *inner = findStructLayout(field->type);
+            if (word >= field->offset / 8 && word < field->offset / 8 + inner->words) {
+                return structFillWord(inner, word - field->offset / 8);
             }
-            error(GENERAL, "structure var name after dot was not recognize for specified structure\n");
+        } else if (!field->is_byte && field->offset / 8 == word) {
+            return 333;
+        }
+    }
+    return 0;
+}
+
+/* returns the field of a struct type with the given name, 0 if there is none */
+struct struct_var *findField(char *varName, int structType) {
+    struct struct_data *layout = findStructLayout(structType);
+    if (layout == 0) {
+        return 0; //We don't have a struct data structure at the moment
+    }
+    for (int i = 0; i < layout->type_count; i++) {
+        if (strcmp(layout->data[i].name, varName) == 0) {
+            return &layout->data[i];
         }
     }
-    return 0; //We don't have a struct data structure at the moment
+    error(GENERAL, "structure var name after dot was not recognize for specified structure\n");
+    return 0;
 }
 
 int getVarTypeInStruct(char* varName, int structType){
@@ -603,6 +796,25 @@ struct token *getToken(void) {
             error(GENERAL, "invalid character\n");
         }
         next_char = getchar();
+    } else if (next_char == '"') {
+        //a string literal, with \n, \t, \\ and \" for the bytes that cannot be written in it
+        next_token->type = STRING;
+        id_length = 0;
+        next_char = getchar();
+        while (next_char != '"') {
+            if (next_char == -1 || next_char == '\n') {
+                error(GENERAL, "unterminated string literal\n");
+            }
+            if (next_char == '\\') {
+                next_char = getchar();
+                next_char = next_char == 'n' ? '\n' : next_char == 't' ? '\t' : next_char;
+            }
+            appendChar(next_char);
+            next_char = getchar();
+        }
+        appendChar('\0');
+        next_token->value.id = strdup(id_buffer);
+        next_char = getchar();
     } else if (isdigit(next_char)) {
         next_token->type = INTEGER;
         next_token->value.integer = 0;
@@ -643,6 +855,14 @@ struct token *getToken(void) {
             next_token->type = DEFAULT;
         } else if (strcmp(id_buffer, "break") == 0) {
             next_token->type = BREAK;
+        } else if (strcmp(id_buffer, "arena") == 0) {
+            next_token->type = ARENA_KWD;
+        } else if (strcmp(id_buffer, "soa") == 0) {
+            next_token->type = SOA_KWD;
+        } else if (strcmp(id_buffer, "packed") == 0) {
+            next_token->type = PACKED_KWD;
+        } else if (strcmp(id_buffer, "const") == 0) {
+            next_token->type = CONST_KWD;
         } else if (strcmp(id_buffer, "continue") == 0) {
             next_token->type = CONTINUE;  
         } else if (strcmp(id_buffer, "startwindow") == 0) {
@@ -739,6 +959,21 @@ int isBreak(){
 int isContinue(){
     return current_token->type == CONTINUE;
 }
+int isArena() {
+    return current_token->type == ARENA_KWD;
+}
+int isSoa() {
+    return current_token->type == SOA_KWD;
+}
+int isPacked() {
+    return current_token->type == PACKED_KWD;
+}
+int isConst() {
+    return current_token->type == CONST_KWD;
+}
+int isString() {
+    return current_token->type == STRING;
+}
 int isPrint() {
     return current_token->type == PRINT_KWD;
 }
@@ -964,12 +1199,14 @@ int getVarTypePos(char *id) {
     return node_ptr->var_type;
 }
 
+/* returns the type of the innermost variable with the given name, globals included, -1 if there is none */
 int getVarType(char *id) {
-    return getVarTypePos(id);
-   // return standardTypeCount;
+    struct trie_node *node_ptr = findVar(id);
+    return node_ptr == 0 ? -1 : node_ptr->var_type;
 }
 
-int getVarNum(char *id) {
+/* returns the trie node of the innermost variable with the given name, or 0 */
+struct trie_node *findVar(char *id) {
     struct var_namespace *current_namespace = namespace_head;
     while (current_namespace != 0) {
         struct trie_node *node_ptr = current_namespace->root_ptr;
@@ -982,19 +1219,24 @@ int getVarNum(char *id) {
             }
             node_ptr = node_ptr->children[child_num];
             if (node_ptr == 0) {
-                current_namespace = current_namespace->next;
-                node_ptr = 0;
                 break;
             }
         }
         if (node_ptr != 0 && node_ptr->var_num != 0) {
-            return node_ptr->var_num;
+            return node_ptr;
         }
+        //not here, or only the prefix of a longer name
+        current_namespace = current_namespace->next;
     }
     return 0;
 }
 
-void setVarNum(char *id, int var_num, int varType) {
+int getVarNum(char *id) {
+    struct trie_node *node_ptr = findVar(id);
+    return node_ptr != 0 ? node_ptr->var_num : 0;
+}
+
+struct trie_node *setVarNum(char *id, int var_num, int varType) {
     struct trie_node *node_ptr = namespace_head->root_ptr;
     for (char* ch_ptr = id; *ch_ptr != 0; ch_ptr++) {
         int child_num;
@@ -1013,6 +1255,38 @@ void setVarNum(char *id, int var_num, int varType) {
     }
     node_ptr->var_type = varType;
     node_ptr->var_num = var_num;
+    //a string is indexed like an array of chars whose size is not known here
+    node_ptr->dims[0] = 0;
+    node_ptr->dim_count = varType == 4;
+    node_ptr->element_struct = 0;
+    node_ptr->soa = 0;
+    node_ptr->element_bits = varType == 4 ? 8 : 64;
+    node_ptr->fields_at = 0;
+    node_ptr->pointer_stride = 0;
+    node_ptr->table = 0;
+    if (-var_num > frame_slots) {
+        frame_slots = -var_num;
+    }
+    return node_ptr;
+}
+
+/* returns the trie node of a global variable */
+struct trie_node *findGlobal(char *id) {
+    struct var_namespace *global_namespace = namespace_head;
+    while (global_namespace->next != 0) {
+        global_namespace = global_namespace->next;
+    }
+    struct trie_node *node_ptr = global_namespace->root_ptr;
+    for (char* ch_ptr = id; *ch_ptr != 0 && node_ptr != 0; ch_ptr++) {
+        int child_num;
+        if (isdigit(*ch_ptr)) {
+            child_num = *ch_ptr - '0';
+        } else {
+            child_num = *ch_ptr - 'a' + 10;
+        }
+        node_ptr = node_ptr->children[child_num];
+    }
+    return node_ptr;
 }
 
 void beginVarScope(void) {
@@ -1024,21 +1298,22 @@ void beginVarScope(void) {
 }
 
 void endVarScope(void) {
+    //the slots stay reserved in the frame, the next sibling scope reuses them
     namespace_head = namespace_head->next;
-    if (namespace_head->next_var_num % 2 == 0) {
-        if (!isWindow) {
-            printf("    lea %d(%%rbp),%%rsp\n", 8 * (namespace_head->next_var_num));
-        }
-    } else {
-        if (!isWindow) {
-            printf("    lea %d(%%rbp),%%rsp\n", 8 * (namespace_head->next_var_num + 1));
-        }
-    }
 }
 
 /* prints instructions to set the value of %rax to the value of the variable */
 void get(char *id, char *instruction) {
     int var_num = getVarNum(id);
+    struct trie_node *node_ptr = findVar(id);
+    if (node_ptr != 0 && node_ptr->is_constant && strcmp(instruction, "mov") == 0) {
+        printf("    mov $%" PRIu64 ",%%rax\n", node_ptr->init_value);
+        return;
+    }
+    if (node_ptr != 0 && node_ptr->table != 0) {
+        printf("    %s $%s_table_%d,%%rax\n", instruction, node_ptr->table->id, node_ptr->table->index);
+        return;
+    }
     switch (var_num) {
         case 0:
             error_missingVariable(id); 
@@ -1052,11 +1327,80 @@ void get(char *id, char *instruction) {
     }
 }
 
-void getArr(char *id, int arrIndex) {
-    //?is this section sufficiently different from get to justify reimplementing it instead of making a call to get?
-    //?get was changed, so you may want to consider modifying this code
-    get(id, "mov");
-    printf("    lea %d(%%rax), %%rax\n", 8 * arrIndex);
+/* records the sizes of an array variable, so that its indexes combine with the strides of them,
+   and the struct type of its elements, 0 for scalars of element_bits each */
+void setArrayDims(char *id, int *dims, int dim_count, int element_struct, int soa, int element_bits) {
+    struct trie_node *node_ptr = findVar(id);
+    memcpy(node_ptr->dims, dims, dim_count * sizeof(int));
+    node_ptr->dim_count = dim_count;
+    node_ptr->element_struct = element_struct;
+    node_ptr->soa = soa;
+    node_ptr->element_bits = element_bits;
+}
+
+/* the words between consecutive indexes of the given dimension */
+uint64_t arrayStride(int *dims, int dim_count, int level) {
+    uint64_t stride = 1;
+    for (int i = level + 1; i < dim_count; i++) {
+        stride *= dims[i];
+    }
+    return stride;
+}
+
+/* parses the * after a type name that declares a pointer, and returns the bytes between the
+   elements the pointer steps over: a byte for a char or boolean, a word, or the words of a struct.
+   Returns 0 if there is no * */
+int pointerDeclaration(int type) {
+    if (!isMul()) {
+        return 0;
+    }
+    consume();
+    if (type == 0 || type == 1) {
+        return 1;
+    }
+    struct struct_data *layout = type >= standardTypeCount ? findStructLayout(type) : 0;
+    return layout != 0 && layout->words > 0 ? 8 * layout->words : 8;
+}
+
+/* the pointer_stride of the variable a token names, 0 if it is not a pointer */
+int pointerStride(struct token *tkn) {
+    struct trie_node *node_ptr = tkn->type == ID ? findVar(tkn->value.id) : 0;
+    return node_ptr != 0 ? node_ptr->pointer_stride : 0;
+}
+
+/* the bytes a $ reads or writes at the address that starts at tkn: a byte through a char or
+   boolean pointer, on its own or stepped with +, else a word */
+int pointeeBytes(struct token *tkn) {
+    if (tkn->type == LEFT && tkn->next->type == ID
+            && (tkn->next->next->type == PLUS || tkn->next->next->type == RIGHT)) {
+        tkn = tkn->next;
+    }
+    return pointerStride(tkn) == 1 ? 1 : 8;
+}
+
+/* nonzero if the parentheses of a $ that start at tkn hold a pointer plus an index and nothing that
+   binds looser than +, so that the index can go into the addressing mode */
+int isScaledAddress(struct token *tkn) {
+    if (tkn->type != LEFT || tkn->next->type != ID || tkn->next->next->type != PLUS) {
+        return 0;
+    }
+    int stride = pointerStride(tkn->next);
+    if (stride != 1 && stride != 2 && stride != 4 && stride != 8) {
+        return 0;
+    }
+    int depth = 0;
+    for (tkn = tkn->next; tkn->type != END; tkn = tkn->next) {
+        depth += (tkn->type == LEFT) - (tkn->type == RIGHT);
+        if (depth < 0) {
+            return 1;
+        }
+        enum token_type type = tkn->type;
+        if (depth == 0 && (type == EQ_EQ || type == LT || type == GT || type == LT_GT || type == AND
+                || type == OR || type == XOR || type == QUESTION_MARK || type == COLON)) {
+            return 0;
+        }
+    }
+    return 0;
 }
 
 /* prints instructions to set the value of the variable to the value of %rax */
@@ -1091,10 +1435,6 @@ void set(char *id) {
     }
 }
 
-void setAddress(){
-    printf("    movq %%rax, (%%r8)\n");
-}
-
 /* prints the name of the variable that the given node represents */
 void printId(struct trie_node *node_ptr) {
     if (node_ptr->ch == '\0') {
@@ -1104,21 +1444,135 @@ void printId(struct trie_node *node_ptr) {
     printf("%c", node_ptr->ch);
 }
 
+
 /* generates labels for global variables and initializes their values to 0 */
 void initVars(struct trie_node *node_ptr) {
     if (node_ptr == 0) {
         return;
     }
-    if (node_ptr->var_num) {
+    if (node_ptr->var_num && node_ptr->init_struct) {
+        //the struct follows its pointer, its fields holding what <type>_struct fills in
+        printId(node_ptr);
+        printf("_var:\n");
+        printf("    .quad ");
+        printId(node_ptr);
+        printf("_var_0\n");
+        printId(node_ptr);
+        printf("_var_0:\n");
+        struct struct_data *layout = findStructLayout(node_ptr->init_struct);
+        for (int i = 0; i < layout->words; i++) {
+            printf("    .quad %" PRIu64 "\n", structFillWord(layout, i));
+        }
+    } else if (node_ptr->var_num && node_ptr->table == 0) {
+        if (node_ptr->is_constant) {
+            printf("    .section .rodata\n");
+        }
         printId(node_ptr);
         printf("_var:\n");
-        printf("    .quad 0\n");
+        printf("    .quad %" PRIu64 "\n", node_ptr->init_value);
+        if (node_ptr->is_constant) {
+            printf("    .data\n");
+        }
     }
     for (int child_num = 0; child_num < 36; child_num++) {
         initVars(node_ptr->children[child_num]);
     }
 }
 
+//registers holding the first six arguments of a call, as in the SysV ABI
+static char *argRegisters[6] = {"%rdi", "%rsi", "%rdx", "%rcx", "%r8", "%r9"};
+
+//graphics and string builtins take their arguments in the same registers, so calls go straight to
+//graphicfuncs.c and strings.c; the string ones return a value
+#define BUILTIN_COUNT 14
+#define FIRST_STRING_BUILTIN 6
+static char *builtinFunctions[BUILTIN_COUNT][2] = {
+    {"drawrect", "bg_drawrect"},
+    {"setcolor", "bg_setcolor"},
+    {"startpolygon", "bg_startpolygon"},
+    {"addpoint", "bg_addpoint"},
+    {"endpolygon", "bg_endpolygon"},
+    {"drawngon", "bg_drawngon"},
+    {"strnew", "str_new"},
+    {"strlen", "str_length"},
+    {"strfind", "str_find"},
+    {"strcmp", "str_compare"},
+    {"strcopy", "str_copy"},
+    {"strread", "str_read"},
+    {"strwrite", "str_write"},
+    {"strprint", "str_print"}
+};
+
+/* returns the C function implementing a builtin, or 0 if the id is not one */
+char *builtinSymbol(char *id) {
+    for (int i = 0; i < BUILTIN_COUNT; i++) {
+        if (strcmp(id, builtinFunctions[i][0]) == 0) {
+            return builtinFunctions[i][1];
+        }
+    }
+    return 0;
+}
+
+/* nonzero if the builtin id returns a value */
+int builtinReturns(char *id) {
+    for (int i = FIRST_STRING_BUILTIN; i < BUILTIN_COUNT; i++) {
+        if (strcmp(id, builtinFunctions[i][0]) == 0) {
+            return strcmp(builtinFunctions[i][1], "str_print") != 0;
+        }
+    }
+    return 0;
+}
+
+/* the number of a string literal, added the first time it is used */
+int stringLiteral(char *text) {
+    for (int i = 0; i < string_literal_count; i++) {
+        if (strcmp(string_literals[i], text) == 0) {
+            return i;
+        }
+    }
+    string_literals = realloc(string_literals, (string_literal_count + 1) * sizeof(char *));
+    string_literals[string_literal_count] = text;
+    return string_literal_count++;
+}
+
+/* nonzero if the current token is a string literal or a string variable that makes up a whole
+   operand of print, which then writes the string */
+int isStringOperand(void) {
+    if (!isString() && !(isId() && findVar(getId()) != 0 && findVar(getId())->var_type == 4)) {
+        return 0;
+    }
+    enum token_type next = current_token->next->type;
+    return next != LEFT_BRACKET && next != LEFT && next != DOT && next != PLUS && next != MINUS && next != MUL
+        && next != DIV && next != MODULUS && next != EQ_EQ && next != LT && next != GT && next != LT_GT
+        && next != AND && next != OR && next != XOR && next != QUESTION_MARK && next != USER_OP
+        && next != PLUS_PLUS && next != MINUS_MINUS;
+}
+
+/* assembles the string literals in .rodata: the length in a word, then the bytes and a 0 */
+void printStringLiterals(void) {
+    if (string_literal_count == 0) {
+        return;
+    }
+    printf("    .section .rodata\n");
+    for (int i = 0; i < string_literal_count; i++) {
+        printf("    .align 8\n");
+        printf("    .quad %zu\n", strlen(string_literals[i]));
+        printf("string_%d:\n", i);
+        printf("    .string \"");
+        for (unsigned char *ch = (unsigned char *) string_literals[i]; *ch != 0; ch++) {
+            if (*ch == '"' || *ch == '\\') {
+                printf("\\%c", *ch);
+            } else if (*ch < ' ' || *ch > '~') {
+                printf("\\%03o", *ch);
+            } else {
+                printf("%c", *ch);
+            }
+        }
+        printf("\"\n");
+    }
+    printf("    .data\n");
+}
+
 int isFunctionName(char* id){
     for(int i = 0; i < numFunctions; i++){
         if(strcmp(id,functionNames[i]) == 0 ){
@@ -1128,1579 +1582,7819 @@ int isFunctionName(char* id){
     return 0;
 }
 
-void expression(int perform);
-void seq(int perform);
+/* every counter is keyed by the token of its site: a function, if, loop, switch or case. A site
+   with two counters uses which = 0 and 1 */
+int profileKey(struct token *site, int which) {
+    return 2 * site->index + which;
+}
 
-/* handle id, literals, and (...) */
-void e1(int perform) {
-    if (isLeft()) {
-        consume();
-        expression(perform);
-        if (perform) {
-            printf("    mov %%rax,%%r12\n");
+/* counts one more execution of the site when compiling with --profile-generate */
+void profileCounter(int key) {
+    if (profile_file == 0) {
+        return;
+    }
+    profile_keys = realloc(profile_keys, (profile_size + 1) * sizeof(int));
+    profile_keys[profile_size] = key;
+    printf("    incq profile_counts+%d\n", 8 * profile_size++);
+}
+
+/* how often the site ran in the profiled runs, 0 without --profile-use */
+uint64_t profileCount(int key) {
+    return profile_data != 0 ? profile_data[key] : 0;
+}
+
+/* nonzero if the profiled runs reached the site and took the arm in fewer than a tenth of them */
+int isColdArm(uint64_t arm, uint64_t total) {
+    return profile_data != 0 && total > 0 && arm * 10 < total;
+}
+
+/* nonzero if the site ran at least a hundredth as often as the hottest one */
+int isHotCount(uint64_t count) {
+    return profile_data != 0 && count > 0 && count >= profile_max / 100;
+}
+
+/* nonzero if the profiled runs never called the function being compiled */
+int isColdFunction(void) {
+    return profile_data != 0 && function_token != 0 && profileCount(profileKey(function_token, 0)) == 0;
+}
+
+/* folds a token into a hash of the tokens before it (FNV-1a): its type and, for names and
+   literals, its spelling */
+uint64_t tokenHash(uint64_t hash, struct token *tkn) {
+    char text[32];
+    char *spelling = text;
+    if (tkn->type == ID || tkn->type == TYPE_KWD || tkn->type == STRING) {
+        spelling = tkn->value.id;
+    } else if (tkn->type == INTEGER) {
+        snprintf(text, sizeof(text), "%" PRIu64, tkn->value.integer);
+    } else if (tkn->type == CHAR || tkn->type == USER_OP) {
+        snprintf(text, sizeof(text), "%c", tkn->type == CHAR ? tkn->value.character : tkn->value.user_op);
+    } else {
+        text[0] = 0;
+    }
+    hash = (hash == 0 ? UINT64_C(14695981039346656037) : hash) ^ (uint64_t) tkn->type;
+    hash *= UINT64_C(1099511628211);
+    for (unsigned char *ch = (unsigned char *) spelling; *ch != 0; ch++) {
+        hash = (hash ^ *ch) * UINT64_C(1099511628211);
+    }
+    //ends the spelling, so that "ab" "c" and "a" "bc" differ
+    return (hash ^ 0xff) * UINT64_C(1099511628211);
+}
+
+/* reads a profile written by a program compiled with --profile-generate; counters of the same site
+   (a function and its clones) are added up */
+void readProfile(char *path) {
+    FILE *in = fopen(path, "r");
+    int tokens = -1;
+    uint64_t hash = 0;
+    if (in == 0 || fscanf(in, "hotpi-profile %d %" SCNu64, &tokens, &hash) != 2 || tokens != token_count
+            || hash != token_hash) {
+        fprintf(stderr, "warning: %s does not match this program, compiling without a profile\n", path);
+        if (in != 0) {
+            fclose(in);
         }
-        if (!isRight()) {
-            error(PAREN_MISMATCH, "unclosed parenthesis expression");
+        return;
+    }
+    profile_data = calloc(2 * token_count, sizeof(uint64_t));
+    int key;
+    uint64_t count;
+    while (fscanf(in, "%d %" SCNu64, &key, &count) == 2) {
+        if (key >= 0 && key < 2 * token_count) {
+            profile_data[key] += count;
         }
-        consume();
-    } else if(variableType == 0) { //boolean value
-        if(isTrue()) {
-            if (perform) {
-                printf("   mov $1, %%r12\n");
-            }
-            consume();
-        } else if(isFalse()) {
-            if (perform) {
-                printf("   mov $0, %%r12\n");
-            }
-            consume();
-        } else if (isId()) {
-            char *id = getId();
-            consume();
-            int varType = getVarTypePos(id);
-            if(varType == 0) {
-                if (perform) {
-                    get(id, "mov");
-                    printf("    mov %%rax,%%r12\n");
-                }      
-            } else if(perform) {
-                error(GENERAL, "Given variable is not a boolean");
-            }
-        } else {
-            error(GENERAL, "Type mismatch, expecting boolean");
+    }
+    for (int i = 0; i < 2 * token_count; i++) {
+        profile_max = profile_data[i] > profile_max ? profile_data[i] : profile_max;
+    }
+    fclose(in);
+}
+
+/* the exit hook of an instrumented program, registered with atexit by main */
+void printProfileWriter(void) {
+    printf("profile_write:\n");
+    printf("    push %%rbx\n");
+    printf("    push %%r12\n");
+    printf("    sub $8,%%rsp\n");
+    printf("    mov $profile_path,%%rdi\n");
+    printf("    mov $profile_mode,%%rsi\n");
+    printf("    call fopen\n");
+    printf("    test %%rax,%%rax\n");
+    printf("    je profile_write_done\n");
+    printf("    mov %%rax,%%rbx\n");
+    printf("    mov %%rbx,%%rdi\n");
+    printf("    mov $profile_header,%%rsi\n");
+    printf("    mov $%d,%%rdx\n", token_count);
+    printf("    mov profile_hash,%%rcx\n");
+    printf("    mov $0,%%rax\n");
+    printf("    call fprintf\n");
+    printf("    mov $0,%%r12\n");
+    printf("    jmp profile_write_test\n");
+    printf("profile_write_loop:\n");
+    printf("    mov %%rbx,%%rdi\n");
+    printf("    mov $profile_line,%%rsi\n");
+    printf("    mov profile_keys(,%%r12,8),%%rdx\n");
+    printf("    mov profile_counts(,%%r12,8),%%rcx\n");
+    printf("    mov $0,%%rax\n");
+    printf("    call fprintf\n");
+    printf("    add $1,%%r12\n");
+    printf("profile_write_test:\n");
+    printf("    cmp profile_size,%%r12\n");
+    printf("    jb profile_write_loop\n");
+    printf("    mov %%rbx,%%rdi\n");
+    printf("    call fclose\n");
+    printf("profile_write_done:\n");
+    printf("    add $8,%%rsp\n");
+    printf("    pop %%r12\n");
+    printf("    pop %%rbx\n");
+    printf("    ret\n");
+}
+
+/* the counters of an instrumented program and what the exit hook needs to write them out */
+void printProfileData(void) {
+    printf("profile_path:\n");
+    printf("    .string \"");
+    for (char *ch = profile_file; *ch != 0; ch++) {
+        printf(*ch == '"' || *ch == '\\' ? "\\%c" : "%c", *ch);
+    }
+    printf("\"\n");
+    printf("profile_mode:\n");
+    printf("    .string \"w\"\n");
+    printf("profile_header:\n");
+    printf("    .string \"hotpi-profile %%lu %%lu\\n\"\n");
+    printf("profile_line:\n");
+    printf("    .string \"%%lu %%lu\\n\"\n");
+    printf("    .align 8\n");
+    printf("profile_hash:\n");
+    printf("    .quad %" PRIu64 "\n", token_hash);
+    printf("profile_size:\n");
+    printf("    .quad %d\n", profile_size);
+    printf("profile_keys:\n");
+    for (int i = 0; i < profile_size; i++) {
+        printf("    .quad %d\n", profile_keys[i]);
+    }
+    printf("profile_counts:\n");
+    printf("    .zero %d\n", 8 * profile_size);
+}
+
+/* records the parameters and first token of every function, so that calls can be specialized
+   before the callee has been compiled */
+void collectSignatures(void) {
+    for (struct token *tkn = first_token; tkn->type != END; tkn = tkn->next) {
+        if (tkn->type != FUN_KWD || tkn->next->type != ID || tkn->next->next->type != LEFT) {
+            continue;
         }
-        variableType = 2;
-    } else if (variableType == 1) {
-        if (isChar()) {
-            if(perform){
-                uint64_t v = getChar();
-                printf("    mov $%" PRIu64 ",%%r12\n", v);
+        struct fun_signature *signature = calloc(1, sizeof(struct fun_signature));
+        signature->funId = tkn->next->value.id;
+        signature->start = tkn;
+        struct token *param = tkn->next->next->next;
+        while (param->type == TYPE_KWD && (param->next->type == ID
+                || (param->next->type == MUL && param->next->next->type == ID))) {
+            int count = signature->param_count;
+            struct token *name = param->next->type == MUL ? param->next->next : param->next;
+            signature->variableType = realloc(signature->variableType, (count + 1) * sizeof(char*));
+            signature->paramId = realloc(signature->paramId, (count + 1) * sizeof(char*));
+            signature->variableType[count] = param->value.id;
+            signature->paramId[count] = name->value.id;
+            if (count < 32 && strcmp(param->value.id, "funp") == 0 && name == param->next) {
+                signature->funp_mask |= 1u << count;
             }
-            consume();
-
-        } else if (isId()) {
-            char *id = getId();
-            consume();
-            int varType = getVarTypePos(id);
-            if(varType == 1) {
-                if (perform) {
-                    get(id, "mov");
-                    printf("    mov %%rax,%%r12\n");
-                }
-            } else if(perform) {
-                error(GENERAL, "Given variable is not a char\n");
+            signature->param_count++;
+            param = name->next;
+            if (param->type == COMMA) {
+                param = param->next;
             }
-        } else if(perform) {
-            error(GENERAL, "Type mismatch, expecting char\n");
-        }
-        variableType = 2;
-    } else if (isInt()) {
-        if(perform){
-            uint64_t v = getInt();
-            printf("    mov $%" PRIu64 ",%%r12\n", v);
-        }
-        consume();
-    } else if (isId()) {
-        char *id = getId();
-        consume();
-        if(strcmp(id, "key") == 0 && perform){
-            printf("    mov %%rdi, %%r12\n");
-            return;
         }
-        if (isPlusPlus()){
-		consume();
-		if (perform){
-		get (id, "mov");
-		printf("    add $1, %%rax\n");	
-		}
-	}else if (isMinusMinus()){
-		consume();
-		if (perform){
-		get (id, "mov");
-		printf("   sub $1, %%rax\n");
-		}
-	}else if (isLeft()) {
-            consume();
-            int params = 0;
-            //int paramId = -1;
-            while (!isRight()) {
-                expression(perform);
-                if (isComma()) {
-                    consume();
-                }
-                params++;
-                if (perform) {
-                    if (params % 2 == 0) {
-                        printf("    mov %%rax,(%%rsp)\n");
-                    } else {
-                        printf("    push %%rax\n");
-                        printf("    sub $8,%%rsp\n");
+        //a parameter that is assigned or referenced in the body has to stay a variable
+        int depth = 0;
+        for (struct token *body = param->next; body->type != END && body->type != FUN_KWD; body = body->next) {
+            if (body->type == LEFT_BLOCK) {
+                depth++;
+            } else if (body->type == RIGHT_BLOCK && --depth <= 0) {
+                break;
+            } else if (body->type == ID && (body->next->type == EQ || body->prev->type == REFERENCE)) {
+                for (int i = 0; i < signature->param_count && i < 32; i++) {
+                    if (strcmp(body->value.id, signature->paramId[i]) == 0) {
+                        signature->funp_mask &= ~(1u << i);
                     }
                 }
             }
-            consume();
+        }
+        signature->next = signature_head;
+        signature_head = signature;
+    }
+}
 
-            if (params % 2 != 0) {
-                params++;
-            }
-            if (perform) {
-                for (int index = 0; index < params; index++) {
-                    printf("    pushq %d(%%rsp)\n", 16 * index);
-                }
-                for (int index = 0; index < params; index++) {
-                    printf("    popq %d(%%rsp)\n", 8 * (params - 1));
-                }
-                //TODO
-                //Check here if the id is the name of a parameter, in which case
-                //Return the string that the id points to rather then the id itself
-                int param_index = getVarNum(id);
-                if(param_index > 0){
-                    //printf("    mov %%rax,%d(%%rbp)\n", 8 * var_num);
-                    printf("    call *%d(%%rbp)\n",8*param_index);
-                } else {
-                    printf("    call %s_fun\n", id);
-                }
-                printf("    add $%d,%%rsp\n", 8 * params);
-            }
-        } else if (isDot()) { //Is a struct variable
-            if (perform) {  
-                get(id, "mov");
-            }
-            long resolve_type = getVarType(id);
-            while (isDot()) {
-                consume();
-                if(!isId()){
-                    error(GENERAL, "Invalid use of . syntax, not followed by identifer");
-                }
-                if (perform) {
-                    printf("    movq %d(%%rax), %%rax\n", 8 * getVarIndexInStruct(getId(), resolve_type));
-                    resolve_type = getVarTypeInStruct(getId(), resolve_type);
-                }
-                consume();
-            }
-        } else if (isLeftBracket()) {
-            consume(); // consume [
-            if (perform && !isInt()) {
-                error(GENERAL, "expected number index after [");
-            }
-            int arrIndex = getInt();
-            consume(); // consume int
-            if (perform) {
-                getArr(id, arrIndex);
-                if (!isRightBracket()) {
-                    error(GENERAL, "expected ] after array variable");
-                }
-            }
-            consume(); // consume ]
-            while (isLeftBracket()) {
-                consume(); // consume [
-                int arrIndex = 0;
-                if (perform) {
-                    if (!isInt()) {
-                        error(GENERAL, "expected number index after [");
-                    }
-                    arrIndex = getInt();
-                }
-                consume(); // consume int
-                if (perform) {
-                    printf("    mov %d(%%rax), %%rax\n", arrIndex*8);
-                    if (!isRightBracket()) {
-                        error(GENERAL, "expected ] after array variable");
-                    }
-                }
-                consume(); // consume ]
-            }
-            if (perform) {
-                printf("    mov (%%rax), %%rax\n");
-            }
-        } else {
-            if (perform) {
-                if(isFunctionName(id)){
-                    printf("    mov $%s_fun,%%rax\n",id);
-                } else {
-                    get(id, "mov");
-                }
-            }
+struct fun_signature *findSignature(char *id) {
+    for (struct fun_signature *signature = signature_head; signature != 0; signature = signature->next) {
+        if (strcmp(signature->funId, id) == 0) {
+            return signature;
         }
-        if (perform) {
-            printf("    mov %%rax,%%r12\n");
+    }
+    return 0;
+}
+
+/* returns the function a funp parameter of the clone being compiled is bound to, or 0 */
+char *boundFunction(char *id) {
+    if (current_clone == 0 || getVarNum(id) != 0) {
+        return 0;
+    }
+    struct fun_signature *signature = current_clone->signature;
+    for (int i = 0; i < signature->param_count; i++) {
+        if (current_clone->bound[i] != 0 && strcmp(signature->paramId[i], id) == 0) {
+            return current_clone->bound[i];
         }
-    } else if (isReference()) {
-        consume();
-        if (!isId()) {
-            error(GENERAL, "Cannot reference something that is not an identifier!");
-        }   
-        char *id = getId();
-        consume();
-        if (perform) {
-            get(id, "leaq"); 
-            printf("    mov %%rax, %%r12\n");
-        } 
-    } else if (isDereference()) {
-        consume();
-        if (!isId()) {
-            error(GENERAL, "Cannot dereference something that is not an identifier");
+    }
+    return 0;
+}
+
+/* returns the function an identifier names for certain, or 0 if it is a variable */
+char *constantFunction(char *id) {
+    char *bound = boundFunction(id);
+    if (bound != 0) {
+        return bound;
+    }
+    if (getVarNum(id) == 0 && findSignature(id) != 0) {
+        return id;
+    }
+    return 0;
+}
+
+/* looks at the arguments of a call starting at the current token and returns the clone of the callee
+   specialized on the known functions passed to its funp parameters, or 0 if there is none to use */
+struct fun_clone *specializeCall(char *callee) {
+    struct fun_signature *signature = findSignature(callee);
+    //with a profile, only calls from functions that ran are worth a copy of the callee
+    if (signature == 0 || signature->funp_mask == 0 || isColdFunction()) {
+        return 0;
+    }
+    char **bound = calloc(signature->param_count, sizeof(char*));
+    int any = 0;
+    int index = 0;
+    int depth = 0;
+    for (struct token *tkn = current_token; tkn->type != END && index < signature->param_count; tkn = tkn->next) {
+        if (tkn->type == LEFT) {
+            depth++;
+        } else if (tkn->type == RIGHT && depth-- == 0) {
+            break;
+        } else if (tkn->type == COMMA && depth == 0) {
+            index++;
+        } else if (depth == 0 && tkn->type == ID && (tkn->prev->type == COMMA || tkn == current_token)
+                && (tkn->next->type == COMMA || tkn->next->type == RIGHT)
+                && index < 32 && (signature->funp_mask & (1u << index))) {
+            bound[index] = constantFunction(tkn->value.id);
+            any = any || bound[index] != 0;
         }
-        char *id = getId();
-        consume();
-        if (perform) {
-            get(id, "mov");
-            printf("    mov (%%rax), %%r12\n");
+    }
+    if (!any) {
+        free(bound);
+        return 0;
+    }
+    //the clone is named after the callee and the bound functions; identifiers cannot contain '_'
+    size_t length = strlen(callee) + 1;
+    for (int i = 0; i < signature->param_count; i++) {
+        length += 1 + (bound[i] != 0 ? strlen(bound[i]) : 0);
+    }
+    char *name = malloc(length);
+    strcpy(name, callee);
+    for (int i = 0; i < signature->param_count; i++) {
+        if (signature->funp_mask & (1u << i)) {
+            strcat(name, "_");
+            strcat(name, bound[i] != 0 ? bound[i] : "");
         }
-    } else {
-        error(GENERAL, "Expected expression\n");
     }
+    struct fun_clone *clone = clone_head;
+    while (clone != 0 && strcmp(clone->name, name) != 0) {
+        clone = clone->next;
+    }
+    if (clone == 0 && clone_count < MAX_CLONES) {
+        clone = calloc(1, sizeof(struct fun_clone));
+        clone->name = name;
+        clone->signature = signature;
+        clone->bound = bound;
+        if (clone_tail == 0) {
+            clone_head = clone;
+        } else {
+            clone_tail->next = clone;
+        }
+        clone_tail = clone;
+        clone_count++;
+        return clone;
+    }
+    free(name);
+    free(bound);
+    return clone;
 }
 
-/* handle '*' */
-void e2(int perform) {
-    e1(perform);
-    if (perform) {
-        printf("    mov %%r12,%%r13\n");
+/* nonzero if argument n of a call to the clone is not passed because the clone has it built in */
+int isBoundArgument(struct fun_clone *clone, int arg) {
+    return clone != 0 && arg < clone->signature->param_count && clone->bound[arg] != 0;
+}
+
+/* rejects a call argument that is an array of chars, booleans or packed booleans, or a row of one:
+   the callee indexes the arrays it is passed as words. A string says its elements are bytes */
+void checkArrayArgument(void) {
+    struct trie_node *node_ptr = isId() ? findVar(getId()) : 0;
+    if (node_ptr == 0 || node_ptr->dim_count == 0 || node_ptr->element_bits == 64 || node_ptr->var_type == 4) {
+        return;
     }
-    while (isMul() || isDiv() || isMod()) {
-        if (isMul()) {
-            consume();
-            e1(perform);
-            if (perform) {
-                printf("    imul %%r12,%%r13\n");
-            }
-        } else if (isDiv()) {
-            consume();
-            e1(perform);
-            if (perform) {
-                printf("    mov %%r13, %%rax\n");
-                printf("    mov $0, %%rdx\n");
-                printf("    divq %%r12\n");
-                printf("    mov %%rax, %%r13\n");
-            }     
-        } else {
-            consume();
-            e1(perform);
-            if (perform) {
-                printf("    mov %%r13, %%rax\n");
-                printf("    mov $0, %%rdx\n");
-                printf("    divq %%r12\n");
-                printf("    mov %%rdx, %%r13\n");
-            } 
+    struct token *tkn = current_token->next;
+    int nesting = 0;
+    int indexes = 0;
+    while (tkn->type == LEFT_BRACKET || nesting > 0) {
+        indexes += tkn->type == LEFT_BRACKET && nesting == 0;
+        nesting += (tkn->type == LEFT_BRACKET) - (tkn->type == RIGHT_BRACKET);
+        tkn = tkn->next;
+    }
+    if (indexes < node_ptr->dim_count && (tkn->type == COMMA || tkn->type == RIGHT)) {
+        error(GENERAL, "only arrays of words can be passed; pass a char* or boolean* pointer to the bytes");
+    }
+}
+
+void expression(int perform);
+void seq(int perform);
+void e4(int perform);
+void e5(int perform);
+void e6(int perform);
+int reserveFrameSlots(int count);
+
+/* records where the value of the operand just parsed lives */
+void setValue(char *loc) {
+    strncpy(value_loc, loc, sizeof(value_loc) - 1);
+}
+
+/* returns the operand for the value of a variable without loading it; a constant global is folded
+   into an immediate */
+char *varLocation(char *id) {
+    static char loc[64];
+    struct trie_node *node_ptr = findVar(id);
+    if (node_ptr == 0) {
+        error_missingVariable(id);
+        return "$0";
+    }
+    if (node_ptr->is_constant && node_ptr->init_value <= INT32_MAX) {
+        snprintf(loc, sizeof(loc), "$%" PRIu64, node_ptr->init_value);
+        return loc;
+    }
+    if (node_ptr->table != 0) {
+        snprintf(loc, sizeof(loc), "$%s_table_%d", node_ptr->table->id, node_ptr->table->index);
+        return loc;
+    }
+    int var_num = node_ptr->var_num;
+    switch (var_num) {
+        case 1:
+            snprintf(loc, sizeof(loc), "%s_var", id);
+            break;
+        default:
+            snprintf(loc, sizeof(loc), "%d(%%rbp)", 8 * var_num);
+            break;
+    }
+    return loc;
+}
+
+int isRegisterValue(void) {
+    return value_loc[0] == '%';
+}
+
+int isImmediateValue(void) {
+    return value_loc[0] == '$';
+}
+
+/* nonzero if the current value is a number known at compile time */
+int isConstantValue(void) {
+    return pending_cc == 0 && value_loc[0] == '$' && isdigit(value_loc[1]);
+}
+
+uint64_t constantValue(void) {
+    return strtoull(value_loc + 1, 0, 10);
+}
+
+/* makes a number known at compile time the current value; instructions sign-extend 32-bit
+   immediates, so larger numbers are loaded into %rax */
+void setConstant(int perform, uint64_t v) {
+    if (v <= INT32_MAX) {
+        char loc[32];
+        snprintf(loc, sizeof(loc), "$%" PRIu64, v);
+        setValue(loc);
+    } else {
+        if (perform) {
+            printf("    mov $%" PRIu64 ",%%rax\n", v);
         }
+        setValue("%rax");
     }
 }
 
-/* handle '+' */
-void e3(int perform) {
-    e2(perform);
+/* returns the condition code set by a comparison operator, or 0 if the current token is not one */
+char *comparisonCondition() {
+    if (isEqEq()) {
+        return "e";
+    } else if (isLt()) {
+        return "b";
+    } else if (isGt()) {
+        return "a";
+    } else if (isLtGt()) {
+        return "ne";
+    }
+    return 0;
+}
+
+/* returns the condition code that is set exactly when the given one is not */
+char *invertCondition(char *cc) {
+    if (strcmp(cc, "e") == 0) {
+        return "ne";
+    } else if (strcmp(cc, "ne") == 0) {
+        return "e";
+    } else if (strcmp(cc, "b") == 0) {
+        return "ae";
+    } else if (strcmp(cc, "ae") == 0) {
+        return "b";
+    } else if (strcmp(cc, "a") == 0) {
+        return "be";
+    }
+    return "a";
+}
+
+/* turns a comparison still pending in the flags into a 0/1 value in the given register */
+void materializeCondition(int perform, char *reg8, char *reg64) {
+    if (pending_cc == 0) {
+        return;
+    }
     if (perform) {
-        printf("    mov %%r13,%%r14\n");
+        printf("    set%s %s\n", pending_cc, reg8);
+        printf("    movzbq %s,%s\n", reg8, reg64);
     }
-    while (isPlus() || isMinus()) {
-        if (isPlus()) {
-            consume();
-            e2(perform);
-            if (perform) {
-                printf("    add %%r13,%%r14\n");
-            }
-        } else {
-            consume();
-            e2(perform);
-            if (perform) {
-                printf("    sub %%r13, %%r14\n");
-            }
-        }
+    pending_cc = 0;
+    setValue(reg64);
+}
+
+/* moves the current value into a register, turning a pending comparison into 0/1 */
+void moveValue(int perform, char *reg8, char *reg64) {
+    if (pending_cc != 0) {
+        materializeCondition(perform, reg8, reg64);
+        return;
     }
+    if (perform && strcmp(value_loc, reg64) != 0) {
+        printf("    mov %s,%s\n", value_loc, reg64);
+    }
+    setValue(reg64);
 }
 
-/* handle '==' */
-void e4(int perform) {
-    e3(perform);
+/* returns the current value as a source operand, materializing a pending comparison into %rax */
+char *operandValue(int perform) {
+    if (pending_cc != 0) {
+        materializeCondition(perform, "%al", "%rax");
+    }
+    return value_loc;
+}
+
+/* stores the current value to memory, going through %rax only when it is in memory itself */
+void storeValue(int perform, char *dest) {
+    if (pending_cc != 0 || !(isRegisterValue() || isImmediateValue())) {
+        moveValue(perform, "%al", "%rax");
+    }
     if (perform) {
-        printf("    mov %%r14,%%r15\n");
+        printf("    movq %s,%s\n", value_loc, dest);
     }
-    while (1) {
-        if (isEqEq()) {
-            consume();
-            e3(perform);
-            if (perform) {
-                printf("    cmp %%r14,%%r15\n");
-                printf("    sete %%r15b\n");
-                printf("    movzbq %%r15b,%%r15\n");
-            }
-        } else if (isLt()) {
-            consume();
-            e3(perform);
-            if (perform) {
-                printf("    cmp %%r14,%%r15\n");
-                printf("    setb %%r15b\n");
-                printf("    movzbq %%r15b,%%r15\n");
-            }
-        } else if (isGt()) {
-            consume();
-            e3(perform);
-            if (perform) {
-                printf("    cmp %%r14,%%r15\n");
-                printf("    seta %%r15b\n");
-                printf("    movzbq %%r15b,%%r15\n");
-            }
-        } else if (isLtGt()) {
-            consume();
-            e3(perform);
-            if (perform) {
-                printf("    cmp %%r14,%%r15\n");
-                printf("    setne %%r15b\n");
-                printf("    movzbq %%r15b,%%r15\n");
-            }
+}
+
+/* returns the condition code that is set when the current value is nonzero, testing it if needed */
+char *valueCondition(int perform) {
+    char *cc = pending_cc;
+    pending_cc = 0;
+    if (cc != 0) {
+        return cc;
+    }
+    if (isImmediateValue()) {
+        moveValue(perform, "%al", "%rax");
+    }
+    if (perform) {
+        if (isRegisterValue()) {
+            printf("    test %s,%s\n", value_loc, value_loc);
         } else {
-            break;
+            printf("    cmpq $0,%s\n", value_loc);
         }
     }
+    return "ne";
 }
 
-/* handle '==' */
-void e5(int perform) {
-    e4(perform);
-    if (perform) {
-        printf("    mov %%r15,%%rbx\n");
-    }
-    while (1) {
-        if (isAnd()) {
-            consume();
-            e4(perform);
-            if (perform) {
-                printf("    and %%r15,%%rbx\n");
-            }
-        } else if (isOr()) {
-            consume();
-            e4(perform);
-            if (perform) {
-                printf("    or %%r15,%%rbx\n");
-            }
-        } else if (isXOr()) {
-            consume();
-            e4(perform);
+/* saves the given accumulators around a nested expression, keeping %rsp 16-byte aligned */
+void saveRegisters(int perform, int regs) {
+    int count = 0;
+    for (int i = 0; i < 6; i++) {
+        if (regs & (1 << i)) {
             if (perform) {
-                printf("    xor %%r15,%%rbx\n");
+                printf("    push %s\n", registerNames[i]);
             }
-        } else {
-            break;
+            count++;
         }
     }
+    if (count != 0) {
+        frame_pushes = 1;
+    }
+    if (perform && count % 2 != 0) {
+        printf("    sub $8,%%rsp\n");
+    }
 }
 
-void e6(int perform) {
-    e5(perform);
-    if (isQuestionMark()) {
-        consume();
-        if (perform) {
-            printf("    mov %%rbx, %%r8\n");
-        }
-        e5(perform);
-        if (perform) {
-            printf("    mov %%rbx, %%r9\n");
-        }
-        if (!isColon()) {
-            error(GENERAL, "Requred colon in between arguments when doing ternary operator");
+/* restores the registers saved by saveRegisters without touching the flags */
+void restoreRegisters(int perform, int regs) {
+    int count = 0;
+    for (int i = 0; i < 6; i++) {
+        if (regs & (1 << i)) {
+            count++;
         }
-        consume();
-        e5(perform);
-        if (perform) {
-            printf("    test %%r8, %%r8\n");
-            printf("    cmovne %%r9, %%rbx\n");
+    }
+    if (perform && count % 2 != 0) {
+        printf("    lea 8(%%rsp),%%rsp\n");
+    }
+    for (int i = 5; i >= 0; i--) {
+        if (perform && (regs & (1 << i))) {
+            printf("    pop %s\n", registerNames[i]);
         }
     }
 }
 
+/* parses an expression without emitting code and returns the accumulators it writes */
+int touchedByExpression(void) {
+    struct token *start_token = current_token;
+    char *cc = pending_cc;
+    int type = variableType;
+    int touched = touched_regs;
+    touched_regs = 0;
+    e6(0);
+    int regs = touched_regs;
+    touched_regs = touched;
+    pending_cc = cc;
+    variableType = type;
+    current_token = start_token;
+    return regs;
+}
 
-void expression(int perform) {
-    if (perform) {
-        printf("    push %%r12\n");
-        printf("    push %%r13\n");
-        printf("    push %%r14\n");
-        printf("    push %%r15\n");
-        printf("    push %%rbx\n");
-        printf("    sub $8,%%rsp\n");
+/* evaluates an expression inside another, saving only the live accumulators it would overwrite */
+void nestedExpression(int perform) {
+    int outer_live = live_regs;
+    int saved = 0;
+    if (perform && outer_live != 0) {
+        saved = outer_live & touchedByExpression();
     }
+    saveRegisters(perform, saved);
+    live_regs = 0;
     e6(perform);
-    if (perform) {
-        printf("    mov %%rbx,%%rax\n");
-        printf("    add $8,%%rsp\n");
-        printf("    pop %%rbx\n");
-        printf("    pop %%r15\n");
-        printf("    pop %%r14\n");
-        printf("    pop %%r13\n");
-        printf("    pop %%r12\n");
+    live_regs = outer_live;
+    if (saved != 0 && pending_cc == 0 && isRegisterValue() && strcmp(value_loc, "%rax") != 0) {
+        //the result would be overwritten when the saved registers come back
+        moveValue(perform, "%al", "%rax");
     }
+    restoreRegisters(perform, saved);
 }
 
-int getLeftSideVariable(char* id, int isArr, int perform) {
-    if (isArr) {
-        consume(); // consume [
-        int arrIndex = 0;
-        if (perform) {
-            if (!isInt()) {
-                error(GENERAL, "expected number index after [");
-            }
-            arrIndex = getInt();
+/* parses an operand without emitting code and returns nonzero if it is short and has no
+   calls or memory loads; operand_is_bool is left telling whether it is a 0/1 value */
+int isCheapOperand(void (*level)(int)) {
+    struct token *start_token = current_token;
+    char *cc = pending_cc;
+    int type = variableType;
+    int calls = operand_calls;
+    int loads = operand_loads;
+    int touched = touched_regs;
+    char loc[64];
+    strcpy(loc, value_loc);
+    level(0);
+    int length = 0;
+    for (struct token *tkn = start_token; tkn != current_token; tkn = tkn->next) {
+        length++;
+    }
+    int cheap = operand_calls == calls && operand_loads == loads && length <= 5;
+    pending_cc = cc;
+    variableType = type;
+    operand_calls = calls;
+    operand_loads = loads;
+    touched_regs = touched;
+    setValue(loc);
+    return cheap;
+}
+
+/* the memory operand arrayElement leaves, the type of the value there, the bits it takes (a packed
+   boolean leaves the bit index in %rcx and its array in %rax), and the words of the struct there
+   when it is a struct stored inline, 0 otherwise */
+static char element_operand[64];
+static int element_type;
+static int element_bits;
+static int element_words;
+
+/* loads the base of an array, from a frame slot when an earlier level left it there, and moves the
+   index into %rcx; leaves the address of the element in element_operand. Each index steps scale
+   bytes, and offset bytes are added to the address; a scale of 0 counts bits, so the whole index
+   goes to %rcx for the packed boolean there. */
+void elementOperand(char *id, int base_slot, int index_slot, int index_at, uint64_t constant, int scale,
+        int offset, int perform) {
+    struct trie_node *node_ptr = base_slot == 0 ? findVar(id) : 0;
+    struct table_data *table = node_ptr != 0 ? node_ptr->table : 0;
+    if (perform) {
+        if (index_at == 1) {
+            printf("    mov %%rax,%%rcx\n");
+        } else if (index_at == 2) {
+            printf("    mov %d(%%rbp),%%rcx\n", index_slot);
         }
-        consume(); // consume int
-        if (perform) {
-            getArr(id, arrIndex);
+        if (scale == 0 && index_at == 0) {
+            printf("    mov $%" PRIu64 ",%%rcx\n", constant);
+            index_at = 1;
+            constant = 0;
+        } else if (constant > (uint64_t) (INT32_MAX - offset) / (scale == 0 ? 1 : scale)
+                || (scale == 0 && constant != 0)) {
+            //too far for a displacement, so it goes in the index
+            printf("    mov $%" PRIu64 ",%%rdx\n", constant);
+            printf(index_at != 0 ? "    add %%rdx,%%rcx\n" : "    mov %%rdx,%%rcx\n");
+            index_at = 1;
+            constant = 0;
         }
-        if (perform) {
-            if (!isRightBracket()) {
-                error(GENERAL, "expected ] after array variable");
-            }
+        if (base_slot != 0) {
+            printf("    mov %d(%%rbp),%%rax\n", base_slot);
+        } else if (table == 0) {
+            get(id, "mov");
         }
+    }
+    if (table != 0 && index_at != 0 && scale != 0) {
+        //the address of a table is known, so it is the displacement and no base is loaded
+        snprintf(element_operand, sizeof(element_operand), "%s_table_%d+%" PRIu64 "(,%%rcx,%d)", table->id,
+                table->index, constant * scale + offset, scale);
+    } else if (table != 0) {
+        snprintf(element_operand, sizeof(element_operand), "%s_table_%d+%" PRIu64, table->id, table->index,
+                constant * scale + offset);
+    } else if (index_at != 0 && scale != 0) {
+        snprintf(element_operand, sizeof(element_operand), "%" PRIu64 "(%%rax,%%rcx,%d)",
+                constant * scale + offset, scale);
+    } else {
+        snprintf(element_operand, sizeof(element_operand), "%" PRIu64 "(%%rax)", constant * scale + offset);
+    }
+}
 
-        consume(); // consume ]
-        if (perform) {
-            if (isLeftBracket()) {
-                printf("    mov (%%rax), %%rax//pls no\n");
+/* evaluates the indexes after an array variable and leaves the address of the element in
+   element_operand. An array declared with literal sizes is one block of elements in row-major
+   order, so its indexes combine into one with the strides of the sizes; an array whose sizes are
+   not known here holds the address of each further level. The elements are words, bytes for char
+   and boolean, or bits for a packed boolean. The elements of an array of structs take the words of
+   the struct each, and the fields after them add their offset; with soa each field is a column of
+   one value per element instead, so a field adds the offset of its column. live are registers the
+   index expressions must not clobber. Returns nonzero if the address is not of a value but of a row
+   or a struct stored inline. */
+int arrayElement(char *id, int perform, int live) {
+    struct trie_node *node_ptr = findVar(id);
+    int dim_count = node_ptr != 0 ? node_ptr->dim_count : 0;
+    int element_struct = perform && node_ptr != 0 ? node_ptr->element_struct : 0;
+    int soa = element_struct != 0 && node_ptr->soa;
+    int bits = perform && node_ptr != 0 && dim_count > 0 ? node_ptr->element_bits : 64;
+    uint64_t scale = element_struct != 0 && !soa ? findStructLayout(element_struct)->words : 1;
+    int type = variableType;
+    int outer_live = live_regs;
+    int next_var_num = namespace_head->next_var_num;
+    live_regs |= live;
+    //the part of the index that is not constant is in %rax (1) or in index_slot (2), if any
+    int index_at = 0;
+    int index_slot = 0;
+    int base_slot = 0;
+    uint64_t constant = 0;
+    int level = 0;
+    while (isLeftBracket()) {
+        consume();
+        if (index_at == 1) {
+            //the next index expression may use %rax
+            if (index_slot == 0) {
+                index_slot = reserveFrameSlots(1);
             }
-        }
-        while (isLeftBracket()) {
-            consume(); // consume [
             if (perform) {
-                if (!isInt()) {
-                    error(GENERAL, "expected number index after [");
-                }
-                arrIndex = getInt();
-                printf("    mov %d(%%rax), %%rax\n", arrIndex*8);
+                printf("    mov %%rax,%d(%%rbp)\n", index_slot);
             }
-            consume(); // consume int
-            if (perform) {
-                if (!isRightBracket()) {
-                    error(GENERAL, "expected ] after array variable");
-                }
+            index_at = 2;
+        }
+        variableType = 2;
+        nestedExpression(perform);
+        uint64_t stride = arrayStride(node_ptr != 0 ? node_ptr->dims : 0, dim_count, level) * scale;
+        if (isConstantValue()) {
+            constant += constantValue() * stride;
+        } else {
+            moveValue(perform, "%al", "%rax");
+            if (perform && stride != 1) {
+                printf("    imul $%" PRIu64 ",%%rax\n", stride);
+            }
+            if (perform && index_at == 2) {
+                printf("    add %d(%%rbp),%%rax\n", index_slot);
             }
-            consume(); // consume ]
+            index_at = 1;
         }
-        if (perform) {
-            printf("    mov %%rax, %%r8\n");
+        if (perform && !isRightBracket()) {
+            error(GENERAL, "expected ] after array variable");
         }
-        return 0;
-    }
-    if(perform && isDot()){
-        get(id, "mov");
-    }
-    int displacement = -1;
-    while(isDot()){
         consume();
-        if (perform) {
-            if(!isId()){
-                error(GENERAL, "expected identifier after dot operator");
+        level++;
+        if (isLeftBracket() && level >= (dim_count > 0 ? dim_count : 1)) {
+            if (element_struct != 0 || bits != 64) {
+                error(GENERAL, "too many indexes for an array whose elements are not words");
             }
-            id = getId();
-            if(displacement != -1){
-                printf("    movq %d(%%rax), %%rax\n", displacement); 
+            //the element holds the address of the next level, which is indexed on its own
+            elementOperand(id, base_slot, index_slot, index_at, constant, 8, 0, perform);
+            if (base_slot == 0) {
+                base_slot = reserveFrameSlots(1);
             }
-            displacement = getVarIndexInStruct(id, struct_decode_type) * 8;
-            struct_decode_type = getVarTypeInStruct(id, struct_decode_type);
+            if (perform) {
+                printf("    mov %s,%%rax\n", element_operand);
+                printf("    mov %%rax,%d(%%rbp)\n", base_slot);
+            }
+            index_at = 0;
+            constant = 0;
+            level = 0;
+            dim_count = 0;
         }
-        consume();
-    }
-    printf("    mov %%rax, %%r8\n");
-    return displacement;
-} 
-
-//?ideally this should repeat less code from statement
-void makeArraySpace(char* id, int isInner, int perform) {
-    if (perform && !isLeftBracket()) {
-        error(GENERAL, "expected [ after array");
     }
-    consume(); // consume the [
-    if (perform && !isInt()) {
-        error(GENERAL, "expected number index after [");
+    element_type = 2;
+    element_words = 0;
+    element_bits = level < dim_count ? 64 : bits;
+    if (bits == 1 && level < dim_count) {
+        error(GENERAL, "a row of a packed array has no address");
     }
-    unsigned long size = 0;
-    if (perform) {
-        size = getInt();
-        printf("    mov $%lu, %%rdi\n", 8*size);
-        printf("    call malloc\n");
-        if (!isInner) {
-            setVarNum(id, namespace_head->next_var_num, 2);
-            namespace_head->next_var_num--;
-            set(id);
-        } else {
-            setAddress();
+    int address_scale = bits == 64 ? 8 : bits / 8;
+    int offset = 0;
+    if (element_struct != 0 && level == dim_count) {
+        //fields stored inline add up; one that is a value ends the element, a struct pointer is
+        //followed from there like the field of a struct variable
+        int is_inline = 1;
+        int is_byte = 0;
+        element_type = element_struct;
+        while (is_inline && isDot()) {
+            consume();
+            struct struct_var *field = isId() ? findField(getId(), element_type) : 0;
+            if (field == 0) {
+                error(GENERAL, "Invalid use of . syntax, not followed by identifer");
+                break;
+            }
+            consume();
+            offset += field->offset;
+            element_type = field->type;
+            is_inline = field->is_inline;
+            is_byte = field->is_byte;
+        }
+        if (soa && is_inline) {
+            error(GENERAL, "an element of a soa array has no address of its own, only its fields do");
+        }
+        element_bits = is_byte ? 8 : 64;
+        if (soa) {
+            //the column of the field starts where the field would be in a struct as big as the array
+            offset *= arrayStride(node_ptr->dims, dim_count, -1);
+            address_scale = is_byte ? 1 : 8;
+        }
+        element_words = is_inline ? findStructLayout(element_type)->words : 0;
+    } else if (isDot()) {
+        if (perform) {
+            error(GENERAL, "only an element of an array of structs has fields");
+        }
+        //the dry run does not know the array, so it takes every field that follows
+        while (isDot() && current_token->next->type == ID) {
+            consume();
+            consume();
         }
     }
-    consume(); // consume the int
-    if (perform && !isRightBracket()) {
-        error(GENERAL, "expected ] after array variable");
+    elementOperand(id, base_slot, index_slot, index_at, constant, address_scale, offset, perform);
+    variableType = type;
+    live_regs = outer_live;
+    namespace_head->next_var_num = next_var_num;
+    return level < dim_count || element_words > 0;
+}
+
+/* loads the element arrayElement left into %rax */
+void loadElement(void) {
+    if (element_bits == 1) {
+        printf("    mov %%rcx,%%rdx\n");
+        printf("    shr $6,%%rdx\n");
+        printf("    mov (%%rax,%%rdx,8),%%rax\n");
+        printf("    shr %%cl,%%rax\n");
+        printf("    and $1,%%rax\n");
+    } else {
+        printf("    %s %s,%%rax\n", element_bits == 8 ? "movzbq" : "mov", element_operand);
     }
-    consume(); // consume the ]
-    struct token* currentTokenPast = current_token;
-    if (perform && isLeftBracket()) {
-        for (int i = 0; i < size; i++) {
-            current_token = currentTokenPast;
-            printf("    push %%rax\n");
-            printf("    push %%r8\n");
-            printf("    lea %d(%%rax), %%r8\n", i * 8);
-            makeArraySpace(id, 1, perform);
-            printf("    pop %%r8\n");
-            printf("    pop %%rax\n");
-        }
+}
+
+/* stores %r9 to the element arrayElement left; a packed boolean keeps the lowest bit */
+void storeElement(void) {
+    if (element_bits == 1) {
+        printf("    mov %%rcx,%%rdx\n");
+        printf("    shr $6,%%rdx\n");
+        printf("    lea (%%rax,%%rdx,8),%%rdx\n");
+        printf("    mov (%%rdx),%%rax\n");
+        printf("    btr %%rcx,%%rax\n");
+        printf("    and $1,%%r9\n");
+        printf("    shl %%cl,%%r9\n");
+        printf("    or %%r9,%%rax\n");
+        printf("    mov %%rax,(%%rdx)\n");
+    } else if (element_bits == 8) {
+        printf("    movb %%r9b, %s\n", element_operand);
+    } else {
+        printf("    movq %%r9, %s\n", element_operand);
     }
 }
 
-int statement(int perform) {
-    //fprintf(stderr, "%s\n", current_token->value.id);
+//the memory operand dereference leaves
+static char pointer_operand[64];
+
+/* parses what follows a $: a variable holding an address, or an address in parentheses, and leaves
+   the memory operand at that address in pointer_operand. A pointer plus an index is folded into the
+   addressing mode, with the index in %rcx. Returns the bytes there; the registers in live are kept
+   across calls in the index */
+int dereference(int perform, int live) {
+    int bytes = pointeeBytes(current_token);
+    strcpy(pointer_operand, "(%rax)");
     if (isId()) {
-        printf("    push %%r8\n");
-        printf("    push %%r9\n");
         char *id = getId();
         consume();
-        int isArr = isLeftBracket();
-        int overrideSet = 0;
-        int displacement = -1;
-        if (perform && isDot()) {
-            overrideSet = 1;
-        }
-        if (isArr || isDot()) {
-            struct_decode_type = getVarType(id);
-            struct_decode_type_np = struct_decode_type;
-            displacement = getLeftSideVariable(id, isArr, perform);
+        if (perform) {
+            printf("    mov %s,%%rax\n", varLocation(id));
         }
-        if (overrideSet) {
-            printf("    addq $%d, %%r8\n", displacement);
+        return bytes;
+    } else if (!isLeft()) {
+        error(GENERAL, "Cannot dereference something that is not an identifier or in parentheses");
+        return bytes;
+    }
+    int type = variableType;
+    int outer_live = live_regs;
+    live_regs |= live;
+    variableType = 2;
+    if (isScaledAddress(current_token)) {
+        consume();
+        char *id = getId();
+        int stride = pointerStride(current_token);
+        consume();
+        consume();
+        nestedExpression(perform);
+        if (isConstantValue() && constantValue() * stride <= INT32_MAX) {
+            snprintf(pointer_operand, sizeof(pointer_operand), "%" PRIu64 "(%%rax)", constantValue() * stride);
+        } else {
+            moveValue(perform, "%cl", "%rcx");
+            snprintf(pointer_operand, sizeof(pointer_operand), "(%%rax,%%rcx,%d)", stride);
         }
-        if (!isEq()) {
-            error(GENERAL, "Expected =\n");
+        if (perform) {
+            printf("    mov %s,%%rax\n", varLocation(id));
         }
+    } else {
         consume();
-        int whichType = getVarType(id);
-        variableType = whichType;
-        expression(perform);
-        if (perform) {
-            if (isArr || overrideSet) {
-                setAddress();
-            }  else {
-                set(id);
+        nestedExpression(perform);
+        moveValue(perform, "%al", "%rax");
+    }
+    if (!isRight()) {
+        error(PAREN_MISMATCH, "unclosed parenthesis expression");
+    }
+    consume();
+    variableType = type;
+    live_regs = outer_live;
+    return bytes;
+}
+
+/* follows the fields after a struct replaced by its fields and returns the offset of the last one
+   from %rbp, setting *last to it */
+int replacedField(struct trie_node *node_ptr, struct struct_var **last, int perform) {
+    int offset = node_ptr->fields_at;
+    int type = node_ptr->var_type;
+    *last = 0;
+    while (isDot() && current_token->next->type == ID) {
+        consume();
+        struct struct_var *field = findField(getId(), type);
+        consume();
+        if (field == 0) {
+            if (perform) {
+                error(GENERAL, "no such field in the struct");
             }
+            break;
         }
-        if (isSemi()) {
-            consume();
-        }
-        variableType = 2;
-        printf("    pop %%r9\n");
-        printf("    pop %%r8\n");
-        return 1;
-    } else if (isType()) {
-        if (namespace_head->next_var_num % 2 != 0) {
-            printf("    sub $16,%%rsp\n");
-        }
-        printf("    push %%r8\n");
-        printf("    push %%r9\n");
-        int isStruct = isStructType();
-        char* typeName = current_token->value.id;
+        offset += field->offset;
+        type = field->type;
+        *last = field;
+    }
+    return offset;
+}
+
+/* follows the fields after a struct of the given type whose address is in %rax, leaving the value
+   of the last one there */
+void loadFields(long resolve_type, int perform) {
+    //offsets of inline structs add up, so a chain of them takes a single load
+    int offset = 0;
+    struct struct_var *field = 0;
+    while (isDot()) {
         consume();
         if(!isId()){
-            error(GENERAL, "expected identifier after type name");
-        }
-        //?could probably be improved
-        char *id = getId();
-        consume();
-        if(perform && isStruct){
-            printf("    call %s_struct\n", typeName);
+            error(GENERAL, "Invalid use of . syntax, not followed by identifer");
         }
-        else if (isLeftBracket()) {
-            makeArraySpace(id, 0, perform);
-            printf("    pop %%r9\n");
-            printf("    pop %%r8\n");
-            if (isSemi()) {
-                consume();
+        if (perform) {
+            field = findField(getId(), resolve_type);
+            offset += field != 0 ? field->offset : 0;
+            resolve_type = field != 0 ? field->type : 0;
+            if (field == 0 || !field->is_inline) {
+                printf("    %s %d(%%rax), %%rax\n", field != 0 && field->is_byte ? "movzbq" : "movq", offset);
+                offset = 0;
             }
-            return 1;
         }
-        //?devorpmi eb ylbaborp dlouc
-        int whichVar = findVarType(typeName);
-        variableType = whichVar;
-        if (perform) {
-            setVarNum(id, namespace_head->next_var_num, whichVar);
-            namespace_head->next_var_num--;
+        consume();
+    }
+    if (perform && field != 0 && field->is_inline) {
+        //a struct stored inline is its address
+        printf("    lea %d(%%rax), %%rax\n", offset);
+    }
+}
+
+/* handle id, literals, and (...) */
+void primary(int perform) {
+    operand_is_bool = 0;
+    if ((variableType == 0 || variableType == 1) && (isDereference() || (isId()
+            && (current_token->next->type == LEFT_BRACKET || current_token->next->type == DOT)))) {
+        //an element, field or value through a pointer is read like any other value
+        variableType = 2;
+    }
+    if (isLeft()) {
+        consume();
+        //unlike expression, a comparison inside the parentheses may stay pending in the flags
+        nestedExpression(perform);
+        if (!isRight()) {
+            error(PAREN_MISMATCH, "unclosed parenthesis expression");
         }
-        if (isEq()) {
+        consume();
+    } else if(variableType == 0) { //boolean value
+        if(isTrue()) {
+            setValue("$1");
             consume();
-            expression(perform);
-            if (perform) {
-                set(id);
+        } else if(isFalse()) {
+            setValue("$0");
+            consume();
+        } else if (isId()) {
+            char *id = getId();
+            consume();
+            int varType = getVarTypePos(id);
+            if(varType == 0) {
+                //a dry run must not fold more than the real one, so it never sees a constant
+                setValue(perform ? varLocation(id) : "%rax");      
+            } else if(perform) {
+                error(GENERAL, "Given variable is not a boolean");
             }
         } else {
-            if (isSemi()) {
-                consume();
-            }
-            if (perform) {
-                //?should this be moved into the struct case?
-                set(id);
+            error(GENERAL, "Type mismatch, expecting boolean");
+        }
+        operand_is_bool = 1;
+        variableType = 2;
+    } else if (variableType == 1) {
+        if (isChar()) {
+            char loc[32];
+            snprintf(loc, sizeof(loc), "$%" PRIu64, getChar());
+            setValue(loc);
+            consume();
+
+        } else if (isId()) {
+            char *id = getId();
+            consume();
+            int varType = getVarTypePos(id);
+            if(varType == 1) {
+                setValue(perform ? varLocation(id) : "%rax");
+            } else if(perform) {
+                error(GENERAL, "Given variable is not a char\n");
             }
+        } else if(perform) {
+            error(GENERAL, "Type mismatch, expecting char\n");
         }
         variableType = 2;
-        printf("    pop %%r9\n");
-        printf("    pop %%r8\n");
-        return 1;
-    } else if (isLeftBlock()) {
+    } else if (isInt()) {
+        setConstant(perform, getInt());
         consume();
-        beginVarScope();
-        seq(perform);
-        endVarScope();
-        if (!isRightBlock())
-            error(BRACKET_MISMATCH, "Unclosed statement block\n");
+    } else if (isString()) {
+        //the address of the bytes, which is known once the program is linked
+        char loc[32];
+        snprintf(loc, sizeof(loc), "$string_%d", stringLiteral(current_token->value.id));
+        setValue(loc);
         consume();
-        return 1;
-    } else if (isWindowStart()) {
-        isWindow = 1;
+    } else if (isChar() || isTrue() || isFalse()) {
+        //stored to an element or field, which take any value
+        operand_is_bool = !isChar();
+        setConstant(perform, isChar() ? getChar() : isTrue());
         consume();
-        if(!isInt()){
-            error(GENERAL, "Expected window x size after declaring window start block\n");
-        }
-        uint64_t x_size = getInt();
+    } else if (isId()) {
+        char *id = getId();
         consume();
-        if(!isInt()){
-            error(GENERAL, "Expected window y size after declaring window start block\n");
+        if(strcmp(id, "key") == 0 && perform){
+            setValue("key_store");
+            return;
         }
-        uint64_t y_size = getInt();
-        consume();
-        if(perform){
-            printf("    //WINDOW CODE BLOCK\n");
-            printf("    movq $ineedazero, %%rdi\n");
-            printf("    movq $0, %%rsi\n");
-            printf("    call glutInit\n");
-            printf("    movq $0, %%rdi\n");
-            printf("    call glutInitDisplayMode\n");
-            printf("    movq $0, %%rdi\n");
-            printf("    movq $0, %%rsi\n");
-            printf("    call glutInitWindowPosition\n");
-            printf("    movq $%lu, %%rdi\n", x_size);
-            printf("    movq $%lu, %%rsi\n", y_size);
-            printf("    movq %%rdi, window_x_size\n");
-            printf("    movq %%rsi, window_y_size\n");
-            printf("    call glutInitWindowSize\n");
-            printf("    movq $windowtitle, %%rdi\n");
-            printf("    call glutCreateWindow\n");
-            printf("    movq %%rbp, rbp_store\n");
-            printf("    call bg_setupwindow\n");
-            printf("    movq $windowloop_%u, %%rdi\n", window_count);
-            printf("    call glutDisplayFunc\n");
-            printf("    movq $windowloop_%u, %%rdi\n", window_count);
-            printf("    call glutIdleFunc\n");
-            if(isKBDown()){
-                printf("    movq $keyboard_%u, %%rdi\n", window_count);
-                printf("    call glutKeyboardFunc\n");
-            }
-            printf("    jmp keyboardup_setup_%u\n", window_count);
-            printf("    window_begin_%u:\n", window_count);
-            printf("    call glutMainLoop\n");
-            printf("    jmp windowdone_%u\n", window_count);
-            if(isKBDown()){
-                printf("    keyboard_%u:\n", window_count);
-                consume();
-                while(!isKBDownEnd()){
-                    statement(perform);
+        int in_rax = 1;
+        if (isPlusPlus()){
+		consume();
+		if (perform){
+		get (id, "mov");
+		printf("    add $1, %%rax\n");	
+		}
+	}else if (isMinusMinus()){
+		consume();
+		if (perform){
+		get (id, "mov");
+		printf("   sub $1, %%rax\n");
+		}
+	}else if (isLeft()) {
+            consume();
+            operand_calls++;
+            touched_regs |= REG_R8 | REG_R9;
+            makes_calls = 1;
+            //a known function passed to a funp parameter is compiled into a clone of the callee instead
+            char *callee = constantFunction(id);
+            struct fun_clone *clone = callee != 0 ? specializeCall(callee) : 0;
+            //count the arguments first so the outgoing area can be reserved before evaluating them
+            struct token *args_token = current_token;
+            char *cc = pending_cc;
+            int type = variableType;
+            int touched = touched_regs;
+            int params = 0;
+            for (int arg = 0; !isRight() && !isEnd(); arg++) {
+                e6(0);
+                if (isComma()) {
+                    consume();
                 }
-                printf("    ret\n");
-                consume();
-            }
-            printf("    keyboardup_setup_%u:\n", window_count);
-            if(isKBUp()){
-                printf("    movq $keyboardup_%u, %%rdi\n", window_count);
-                printf("    call glutKeyboardUpFunc\n");
-            }
-            printf("    jmp window_begin_%u\n", window_count);
-            if(isKBUp()){
-                printf("    keyboardup_%u:\n", window_count);
-                consume();
-                while(!isKBUpEnd()){
-                    statement(perform);
+                if (!isBoundArgument(clone, arg)) {
+                    params++;
                 }
-                printf("    ret\n");
-                consume();
             }
-            printf("    windowloop_%u:\n", window_count);
-            printf("    call bg_clear\n");
-            printf("    push %%rbp\n");
-            printf("    push %%rbp\n");
-            printf("    mov rbp_store, %%rbp\n");
-            while(current_token->type != WINDOW_END){
-                statement(perform);
+            //the dry run must not leave a comparison or type behind for the real one
+            pending_cc = cc;
+            variableType = type;
+            touched_regs = touched;
+            current_token = args_token;
+            //stack arguments sit at the bottom of the area and register arguments above them,
+            //both parts padded to 16 bytes so nested calls and this one see an aligned %rsp;
+            //the last register argument is evaluated after all others and goes straight to its register
+            int reg_params = params < 6 ? params : 6;
+            int direct = params > 0 && params <= 6;
+            int stack_slots = (params - reg_params) + (params - reg_params) % 2;
+            int slots = stack_slots + (reg_params - direct) + (reg_params - direct) % 2;
+            if (perform && slots > 0) {
+                printf("    sub $%d,%%rsp\n", 8 * slots);
             }
-            printf("    pop %%rbp\n");
-            printf("    pop %%rbp\n");
-            printf("    call glFlush\n");
-            printf("    ret\n");
-            printf("    windowdone_%u:\n", window_count);
-            printf("    //WINDOW END CODE BLOCK\n");
-            window_count = window_count + 1;
-        } else {
-            if(isKBDown()){
-                consume();
-                while(!isKBDownEnd()){
-                    statement(perform);
+            int index = 0;
+            for (int arg = 0; !isRight(); arg++) {
+                if (isBoundArgument(clone, arg)) {
+                    consume();
+                    if (isComma()) {
+                        consume();
+                    }
+                    continue;
                 }
-                consume();
-            }
-            if(isKBUp()){
-                consume();
-                while(!isKBUpEnd()){
-                    statement(perform);
+                checkArrayArgument();
+                nestedExpression(perform);
+                if (isComma()) {
+                    consume();
                 }
-                consume();
-            }
-            while(current_token->type != WINDOW_END){
-                statement(perform);
+                if (direct && index == params - 1) {
+                    moveValue(perform, "%al", argRegisters[index]);
+                } else {
+                    char dest[32];
+                    int offset = index < 6 ? stack_slots + index : index - 6;
+                    snprintf(dest, sizeof(dest), "%d(%%rsp)", 8 * offset);
+                    storeValue(perform, dest);
+                }
+                index++;
             }
-        }
-        isWindow = 0;
-        consume();
-        return 1;   
-    } else if (isIf()) {
-        unsigned int if_num = if_count++;
-        consume();
-        expression(perform);
-        if (perform) {
-            printf("    test %%rax,%%rax\n");
-            printf("    jz if_end_%u\n", if_num);
-        }
-        beginVarScope();
-        statement(perform);
-        endVarScope();
-        if (perform) {
-            printf("    jmp else_end_%u\n", if_num);
-            printf("if_end_%u:\n", if_num);
-        }
-        if (isElse()) {
             consume();
-            beginVarScope();
-            statement(perform);
-            endVarScope();
+            operand_is_bool = 0;
+
+            if (perform) {
+                for (int index = 0; index < reg_params - direct; index++) {
+                    printf("    mov %d(%%rsp),%s\n", 8 * (stack_slots + index), argRegisters[index]);
+                }
+                int param_index = getVarNum(id);
+                if (clone != 0) {
+                    printf("    call %s_fun\n", clone->name);
+                } else if (callee != 0 && callee != id) {
+                    printf("    call %s_fun\n", callee);
+                } else if (param_index == 1) {
+                    printf("    call *%s_var\n", id);
+                } else if (param_index != 0) {
+                    printf("    call *%d(%%rbp)\n", 8 * param_index);
+                } else if (builtinSymbol(id) != 0) {
+                    printf("    call %s\n", builtinSymbol(id));
+                } else {
+                    printf("    call %s_fun\n", id);
+                }
+                if (slots > 0) {
+                    printf("    add $%d,%%rsp\n", 8 * slots);
+                }
+            }
+        } else if (isDot() && findVar(id) != 0 && findVar(id)->fields_at != 0) {
+            //a field of a struct replaced by its fields is read like a variable
+            struct struct_var *field;
+            char loc[64];
+            snprintf(loc, sizeof(loc), "%d(%%rbp)", replacedField(findVar(id), &field, perform));
+            if (perform && field != 0 && field->is_inline) {
+                printf("    lea %s,%%rax\n", loc);
+            } else if (perform && field != 0 && field->is_byte) {
+                printf("    movzbq %s,%%rax\n", loc);
+            } else if (perform) {
+                setValue(loc);
+                in_rax = 0;
+            }
+        } else if (isDot()) { //Is a struct variable
+            operand_loads++;
+            if (perform) {  
+                get(id, "mov");
+            }
+            loadFields(getVarType(id), perform);
+        } else if (isLeftBracket()) {
+            operand_loads++;
+            int row = arrayElement(id, perform, 0);
+            if (perform && row) {
+                printf("    lea %s,%%rax\n", element_operand);
+            } else if (perform) {
+                loadElement();
+            }
+            if (isDot()) {
+                //a struct pointer in an element of an array of structs
+                loadFields(element_type, perform);
+            }
+        } else {
+            operand_is_bool = getVarTypePos(id) == 0;
+            in_rax = 0;
+            if (!perform) {
+                setValue("%rax");
+            } else if (findVar(id) != 0 && findVar(id)->fields_at != 0) {
+                //a struct replaced by its fields is only ever copied from, through their address
+                printf("    lea %d(%%rbp),%%rax\n", findVar(id)->fields_at);
+                setValue("%rax");
+            } else if(isFunctionName(id) || boundFunction(id) != 0){
+                char loc[64];
+                snprintf(loc, sizeof(loc), "$%s_fun", boundFunction(id) != 0 ? boundFunction(id) : id);
+                setValue(loc);
+            } else {
+                setValue(varLocation(id));
+            }
         }
-        if (perform) {
-            printf("else_end_%u:\n", if_num);
+        if (in_rax) {
+            setValue("%rax");
         }
-        return 1;
-    } else if (isWhile()) {
-        int locwhilenum = while_count;
-        globalbreakcount = while_count;
-        unsigned int while_num = while_count++;
+    } else if (isReference()) {
+        consume();
+        if (!isId()) {
+            error(GENERAL, "Cannot reference something that is not an identifier!");
+        }   
+        char *id = getId();
         consume();
         if (perform) {
-            printf("while_begin_%u:\n", while_num);
-        }
-        expression(perform);
+            get(id, "leaq"); 
+        } 
+        setValue("%rax");
+    } else if (isDereference()) {
+        consume();
+        operand_loads++;
+        int bytes = dereference(perform, 0);
         if (perform) {
-            printf("    test %%rax,%%rax\n");
-            printf("    jz while_end_%u\n", while_num);
+            printf("    %s %s,%%rax\n", bytes == 1 ? "movzbq" : "mov", pointer_operand);
         }
-        beginVarScope();
-        statement(perform);
-        endVarScope();
-        if (perform) {
-            printf("    jmp while_begin_%u\n", while_num);
-            printf("while_end_%u:\n", while_num);
+        setValue("%rax");
+    } else {
+        error(GENERAL, "Expected expression\n");
+    }
+}
+
+struct user_operator *findUserOperator(char symbol) {
+    for (struct user_operator *operator = user_ops; operator != 0; operator = operator->next) {
+        if (operator->symbol == symbol) {
+            return operator;
         }
-        globalbreakcount = locwhilenum;
-        return 1;
-    } else if (isFor()){
-        //test
-        unsigned int for_num = for_count++;
-        consume();
-        if (!isLeft()){
-            //add msg
-            error(PAREN_MISMATCH,"Expected (");
+    }
+    error(GENERAL, "tried to use a user operator without defining it");
+    return 0;
+}
+
+/* where an operand of a user operator was left: a constant, or a copy in a frame slot */
+struct spilled_operand {
+    int slot;
+    int is_constant;
+    uint64_t value;
+};
+
+struct spilled_operand spillOperand(int perform) {
+    struct spilled_operand operand;
+    operand.slot = namespace_head->next_var_num--;
+    operand.is_constant = isConstantValue();
+    operand.value = operand.is_constant ? constantValue() : 0;
+    if (!operand.is_constant) {
+        char dest[32];
+        snprintf(dest, sizeof(dest), "%d(%%rbp)", 8 * operand.slot);
+        storeValue(perform, dest);
+    }
+    return operand;
+}
+
+/* a constant operand is bound to its value so the operator's expression folds */
+void bindOperand(char *var, int type, struct spilled_operand operand) {
+    if (var == 0) {
+        return;
+    }
+    struct trie_node *node_ptr = setVarNum(var, operand.slot, type);
+    node_ptr->is_constant = operand.is_constant;
+    node_ptr->init_value = operand.value;
+}
+
+/* a user operator is compiled as an inlined call: its two operands are evaluated once each,
+   left to right, and its expression is compiled in a scope binding them to its variables */
+void userOperator(int perform) {
+    struct user_operator *operator = findUserOperator(current_token->value.user_op);
+    consume();
+    int next_var_num = namespace_head->next_var_num;
+    struct spilled_operand left = spillOperand(perform);
+    primary(perform);
+    struct spilled_operand right = spillOperand(perform);
+    beginVarScope();
+    bindOperand(operator->var1, operator->type1, left);
+    bindOperand(operator->var2, operator->type2, right);
+    struct token *resume_token = current_token;
+    current_token = operator->expression;
+    nestedExpression(perform);
+    if (!isSemi()) {
+        error(GENERAL, "invalid expression in define statement");
+    }
+    current_token = resume_token;
+    //the slots are released with the scope, so the result must not stay in one
+    if (pending_cc == 0 && !isRegisterValue() && !isConstantValue()) {
+        moveValue(perform, "%al", "%rax");
+    }
+    endVarScope();
+    namespace_head->next_var_num = next_var_num;
+}
+
+/* handle user operators, which bind tighter than the built-in ones */
+void e1(int perform) {
+    primary(perform);
+    while (current_token->type == USER_OP) {
+        userOperator(perform);
+    }
+}
+
+/* handle '*' */
+void e2(int perform) {
+    e1(perform);
+    int outer_live = live_regs;
+    int in_register = 0;
+    while (isMul() || isDiv() || isMod()) {
+        enum token_type op = current_token->type;
+        //a constant left side stays out of %r13 until an operand turns out not to be constant
+        if (!in_register && !isConstantValue()) {
+            moveValue(perform, "%r13b", "%r13");
+            touched_regs |= REG_R13;
+            live_regs |= REG_R13;
+            in_register = 1;
         }
+        uint64_t left = in_register ? 0 : constantValue();
         consume();
-        beginVarScope();
-        statement(perform);
-        if (perform) {
-            printf("for_begin_%u:\n", for_num);
+        e1(perform);
+        operand_is_bool = 0;
+        if (!in_register && isConstantValue() && (op == MUL || constantValue() != 0)) {
+            uint64_t right = constantValue();
+            setConstant(perform, op == MUL ? left * right : op == DIV ? left / right : left % right);
+            continue;
         }
-        expression(perform);
+        char *operand = operandValue(perform);
         if (perform) {
-            printf("    test %%rax,%%rax\n");
-            printf("    jz for_end_%u\n", for_num);
-            printf("    jmp for_code_%u\n", for_num);
-            printf("for_inc_%u:\n", for_num);
-        }
-        statement(perform);
-        if (perform){
-            printf("    jmp for_begin_%u\n", for_num);
-            printf("for_code_%u:\n", for_num);
+            if (op == MUL && in_register) {
+                printf("    imul %s,%%r13\n", operand);
+            } else if (op == MUL) {
+                if (strcmp(operand, "%r13") != 0) {
+                    printf("    mov %s,%%r13\n", operand);
+                }
+                printf("    imul $%" PRIu64 ",%%r13\n", left);
+            } else {
+                printf("    mov %s,%%rcx\n", operand);
+                if (in_register) {
+                    printf("    mov %%r13,%%rax\n");
+                } else {
+                    printf("    mov $%" PRIu64 ",%%rax\n", left);
+                }
+                printf("    mov $0,%%rdx\n");
+                printf("    divq %%rcx\n");
+                printf("    mov %s,%%r13\n", op == DIV ? "%rax" : "%rdx");
+            }
         }
-	//obvious comment
-        if (!isRight()){
-            //add msg
-            error(PAREN_MISMATCH, "Expected )");
+        touched_regs |= REG_R13;
+        live_regs |= REG_R13;
+        in_register = 1;
+    }
+    live_regs = outer_live;
+    if (in_register) {
+        setValue("%r13");
+    }
+}
+
+/* handle '+'; a pointer on its own steps over whole elements, so the operands added to it are
+   scaled by its stride on either side of the +, and the difference of two pointers is a count of
+   elements */
+void e3(int perform) {
+    struct token *first = current_token;
+    e2(perform);
+    int stride = current_token == first->next ? pointerStride(first) : 0;
+    int outer_live = live_regs;
+    int in_register = 0;
+    while (isPlus() || isMinus()) {
+        int is_plus = isPlus();
+        //as in e2, constant operands are folded while the left side is still constant
+        if (!in_register && !isConstantValue()) {
+            moveValue(perform, "%r14b", "%r14");
+            touched_regs |= REG_R14;
+            live_regs |= REG_R14;
+            in_register = 1;
         }
+        uint64_t left = in_register ? 0 : constantValue();
         consume();
-        statement(perform);
-        if (perform) {
-            printf("    jmp for_inc_%u\n", for_num);
-            printf("for_end_%u:\n", for_num);
+        struct token *operand_token = current_token;
+        e2(perform);
+        operand_is_bool = 0;
+        int operand_stride = current_token == operand_token->next ? pointerStride(operand_token) : 0;
+        int scale = operand_stride != 0 ? 1 : stride;
+        int left_scale = stride == 0 && is_plus ? operand_stride : 0;
+        int divide = operand_stride != 0 && !is_plus ? stride : 0;
+        if (left_scale != 0 || divide != 0) {
+            stride = left_scale;
         }
-        endVarScope();
-        return 1;
-    } else if (isSemi()) {
-        consume();
-        return 1;
-    } else if (isReturn()) {
-        consume();
-        expression(perform);
-        if (perform) {
-            printf("    jmp %s_end\n", function_name);
+        if (left_scale > 1 && !in_register) {
+            left *= left_scale;
+        } else if (left_scale == 2 || left_scale == 4 || left_scale == 8) {
+            //n + p is p + n with the roles in the lea swapped
+            moveValue(perform, "%al", "%rax");
+            if (perform) {
+                printf("    lea (%%rax,%%r14,%d),%%r14\n", left_scale);
+            }
+            continue;
+        } else if (left_scale > 1 && perform) {
+            printf("    imul $%d,%%r14\n", left_scale);
         }
-        if (isSemi()) {
-            consume();
+        if (scale > 1 && isConstantValue()) {
+            setConstant(perform, constantValue() * scale);
+        } else if (scale > 1 && in_register && is_plus && (scale == 2 || scale == 4 || scale == 8)) {
+            //the pointer and the index meet in the addressing mode of a lea
+            moveValue(perform, "%al", "%rax");
+            if (perform) {
+                printf("    lea (%%r14,%%rax,%d),%%r14\n", scale);
+            }
+            continue;
+        } else if (scale > 1) {
+            moveValue(perform, "%al", "%rax");
+            if (perform) {
+                printf("    imul $%d,%%rax\n", scale);
+            }
         }
-        return 1;
-    } else if (isPrint()) {
-        consume();
-        expression(perform);
-        if (perform) {
-            printf("    mov $output_format,%%rdi\n");
-            printf("    mov %%rax,%%rsi\n");
-            printf("    call printf\n");
+        if (!in_register && isConstantValue()) {
+            uint64_t right = constantValue();
+            uint64_t value = is_plus ? left + right : left - right;
+            setConstant(perform, divide > 1 ? (uint64_t) ((int64_t) value / divide) : value);
+            continue;
         }
-        if (isSemi()) {
-            consume();
+        char *operand = operandValue(perform);
+        if (perform) {
+            if (in_register) {
+                printf("    %s %s,%%r14\n", is_plus ? "add" : "sub", operand);
+            } else if (is_plus || strcmp(operand, "%r14") == 0) {
+                if (strcmp(operand, "%r14") != 0) {
+                    printf("    mov %s,%%r14\n", operand);
+                } else if (!is_plus) {
+                    printf("    neg %%r14\n");
+                }
+                printf("    add $%" PRIu64 ",%%r14\n", left);
+            } else {
+                printf("    mov $%" PRIu64 ",%%r14\n", left);
+                printf("    sub %s,%%r14\n", operand);
+            }
+            //the distance in bytes is a whole number of elements, which may be negative
+            if (divide > 1 && (divide & (divide - 1)) == 0) {
+                int shift = 0;
+                while ((1 << shift) < divide) {
+                    shift++;
+                }
+                printf("    sar $%d,%%r14\n", shift);
+            } else if (divide > 1) {
+                printf("    mov %%r14,%%rax\n");
+                printf("    mov %%r14,%%rdx\n");
+                printf("    sar $63,%%rdx\n");
+                printf("    mov $%d,%%rcx\n", divide);
+                printf("    idiv %%rcx\n");
+                printf("    mov %%rax,%%r14\n");
+            }
         }
-        return 1;
-    }  else if (isBell()) {
-        printf("    push %%rdi\n");
-        printf("    push %%rsi\n");
-        printf("    push %%rdx\n");
-        printf("    push %%rcx\n");
-        printf("    push %%r8\n");
-        printf("    push %%r9\n");
-        printf("    mov $bell_format,%%rdi\n");
-        printf("    call printf\n");
-        printf("    movq stdout(%%rip), %%rdi\n");
-        printf("    call fflush\n");
-        printf("    pop %%r9\n");
-        printf("    pop %%r8\n");
-        printf("    pop %%rcx\n");
-        printf("    pop %%rdx\n");
-        printf("    pop %%rsi\n");
-        printf("    pop %%rdi\n");
-        consume();
-        return 1;
-    } else if (isDelay()) {
+        touched_regs |= REG_R14;
+        live_regs |= REG_R14;
+        in_register = 1;
+    }
+    live_regs = outer_live;
+    if (in_register) {
+        setValue("%r14");
+    }
+}
+
+/* handle '==' */
+void e4(int perform) {
+    e3(perform);
+    int outer_live = live_regs;
+    char *cc;
+    while ((cc = comparisonCondition()) != 0) {
+        //the comparison result is left in the flags so a branch can use it directly
+        moveValue(perform, "%r15b", "%r15");
+        touched_regs |= REG_R15;
+        live_regs |= REG_R15;
         consume();
-        expression(perform); 
-        printf("    push %%rdi\n");
-        printf("    push %%rsi\n");
-        printf("    push %%rdx\n");
-        printf("    push %%rcx\n");
-        printf("    push %%r8\n");
-        printf("    push %%r9\n");
-        printf("    mov %%rax,%%rdi\n");
-        printf("    call usleep\n");
-        printf("    pop %%r9\n");
-        printf("    pop %%r8\n");
-        printf("    pop %%rcx\n");
-        printf("    pop %%rdx\n");
-        printf("    pop %%rsi\n");
-        printf("    pop %%rdi\n"); 
-        return 1;
-    } else if(isSwitch()){
-        if(perform == 0){
-            consume();
-            expression(0);
-            if(current_token->type != LEFT_BLOCK){
-                error(GENERAL, "Missing left bracket after declaration of switch statement");
-            }
-            int locrunswiflag = runswiflag;
-            runswiflag = 0;
-            statement(0);
-            runswiflag = locrunswiflag;
+        e3(perform);
+        char *operand = operandValue(perform);
+        if (perform) {
+            printf("    cmp %s,%%r15\n", operand);
         }
-        else{
+        pending_cc = cc;
+        operand_is_bool = 1;
+    }
+    live_regs = outer_live;
+}
+
+/* handle '==' */
+void e5(int perform) {
+    e4(perform);
+    if (!(isAnd() || isOr() || isXOr())) {
+        return;
+    }
+    int outer_live = live_regs;
+    moveValue(perform, "%bl", "%rbx");
+    touched_regs |= REG_RBX;
+    live_regs |= REG_RBX;
+    int is_bool = operand_is_bool;
+    while (1) {
+        if (isAnd() || isOr()) {
+            int is_and = isAnd();
             consume();
-            expression(1);
-            case_count = 0;
-            defaultflag = 0;
-            struct  token * res_token = current_token;
-            runswiflag = 1;
-            statement(0);
-            runswiflag = 0;
-            current_token = res_token;
-            if(defaultflag == 0){
-                error(GENERAL, "No switch allowed without default");
-            }
-            if(defaultflag > 1){
-                error(GENERAL, "Only one default statement allowed");
-            }
-            if(caseflag == 0){
-                error(GENERAL, "Switch statement with only default case not allowed");
+            //between two 0/1 values '&' and '|' are logical and may skip an expensive right side
+            int lazy = 0;
+            if (perform && is_bool) {
+                struct token *right_token = current_token;
+                int cheap = isCheapOperand(e4);
+                current_token = right_token;
+                lazy = operand_is_bool && !cheap;
             }
-            printf("    subq $%lu, %%rax\n", switenhead->value);
-            uint64_t lowest = switenhead->value;
-            struct swit_entry * checkgthan = switenhead;
-            while(checkgthan != NULL){
-                if(checkgthan-> value - lowest > 50){
-                    printf("    cmpq $%lu, %%rax\n", checkgthan-> value - lowest);
-                    printf("    je .%dSW%d\n", checkgthan->switchnum, checkgthan->casecount);
-                }
-                checkgthan = checkgthan->next;
-            }
-            printf(".data\n");
-            printf(".SW%d:\n", switch_count);
-            struct swit_entry *cur = switenhead;
-            uint64_t currentval = 0;
-            while(cur != NULL){
-                printf("  .quad    .%dSW%d\n", cur->switchnum, cur->casecount);
-                currentval = cur->value;
-                switenhead = cur;
-                cur = cur->next;
-                free(switenhead);
-                if(cur == NULL || cur-> value - lowest > 50){
-                    break;
-                }
-                while(currentval != cur->value - 1){
-                    printf("  .quad    .%dSWDEF\n", switch_count);
-                    currentval++;
+            if (lazy) {
+                unsigned int logic_num = logic_count++;
+                printf("    test %%rbx,%%rbx\n");
+                printf("    j%s logic_skip_%u\n", is_and ? "z" : "nz", logic_num);
+                e4(perform);
+                moveValue(perform, "%bl", "%rbx");
+                printf("logic_skip_%u:\n", logic_num);
+            } else {
+                e4(perform);
+                char *operand = operandValue(perform);
+                if (perform) {
+                    printf("    %s %s,%%rbx\n", is_and ? "and" : "or", operand);
                 }
             }
-            switenhead = NULL;
-            printf(".text\n");
-            printf("    cmpq $%lu, %%rax\n", currentval - lowest);
-            printf("    ja  .%dSWDEF\n", switch_count);
-            printf("    jmp  *.SW%d(,%%rax, 8)\n", switch_count);
-            int locswitch_count = switch_count;
-            switch_count++;
-            beginVarScope();
-            statement(1);
-            endVarScope();
-            printf(" ESW%d:\n", locswitch_count);
+            is_bool = is_bool && operand_is_bool;
+        } else if (isXOr()) {
+            consume();
+            e4(perform);
+            char *operand = operandValue(perform);
+            if (perform) {
+                printf("    xor %s,%%rbx\n", operand);
+            }
+            is_bool = is_bool && operand_is_bool;
+        } else {
+            break;
         }
-        return 1;
-    } else if(isCase() || isDefault()){
-        if(perform == 0){
-            if(runswiflag){
-                if(isCase()){
-                    caseflag++;
-                    consume();
-                    uint64_t casenum = getInt();
-                    consume();
-                    struct swit_entry * curent = malloc(sizeof(struct swit_entry));
-                    struct swit_token * curtok = malloc(sizeof(struct swit_token));
-                    curent->value = casenum;
-                    curent->casecount = case_count;
-                    curent->switchnum = switch_count;
-                    curtok->casecount = case_count;
-                    curtok->switchnum = switch_count;
-                    case_count++;
-                    if(switenhead == NULL){
-                        switenhead = curent;
-                        curent->next = NULL;
-                    }
-                    else{
-                        struct swit_entry * curentins = switenhead;
-                        struct swit_entry * curentinsprev = NULL;
-                        while(curent->value > curentins->value){
-                            curentinsprev = curentins;
-                            curentins = curentins->next;
-                            if(curentins == NULL){
-                                break;
-                            }
-                        }
-                        if(curentins != NULL && curentins->value == curent->value){
-                            error(GENERAL, "Two identical cases");
-                        }
-                        if(curentinsprev == NULL){
-                            switenhead = curent;
-                            curent-> next = curentins; 
-                        }
-                        else{
-                            curentinsprev->next = curent;
-                            curent->next = curentins;
-                        }
-                    }
-                    if(swithead == NULL){
-                        swithead = curtok;
-                        switinsert = curtok;
-                        curtok->next = NULL;
-                    }
-                    else{
-                        if(switinsert->switchnum != curtok->switchnum){
-                            curtok->next = swithead;
-                            swithead = curtok;
-                            switinsert = curtok;
+    }
+    live_regs = outer_live;
+    setValue("%rbx");
+    operand_is_bool = is_bool;
+}
+
+void e6(int perform) {
+    e5(perform);
+    if (!isQuestionMark()) {
+        return;
+    }
+    consume();
+    //cmov needs both results up front, so only use it when neither side costs much
+    int lazy = 0;
+    if (perform) {
+        struct token *then_token = current_token;
+        lazy = !isCheapOperand(e5);
+        if (isColon()) {
+            consume();
+            lazy = !isCheapOperand(e5) || lazy;
+        }
+        current_token = then_token;
+    }
+    int outer_live = live_regs;
+    unsigned int logic_num = lazy ? logic_count++ : 0;
+    if (lazy) {
+        printf("    j%s ternary_else_%u\n", invertCondition(valueCondition(perform)), logic_num);
+    } else {
+        moveValue(perform, "%r8b", "%r8");
+        touched_regs |= REG_R8;
+        live_regs |= REG_R8;
+    }
+    e5(perform);
+    int is_bool = operand_is_bool;
+    if (lazy) {
+        moveValue(perform, "%al", "%rax");
+        printf("    jmp ternary_end_%u\n", logic_num);
+        printf("ternary_else_%u:\n", logic_num);
+    } else {
+        moveValue(perform, "%r9b", "%r9");
+        touched_regs |= REG_R9;
+        live_regs |= REG_R9;
+    }
+    if (!isColon()) {
+        error(GENERAL, "Requred colon in between arguments when doing ternary operator");
+    }
+    consume();
+    e5(perform);
+    moveValue(perform, "%al", "%rax");
+    if (lazy) {
+        printf("ternary_end_%u:\n", logic_num);
+    } else if (perform) {
+        printf("    test %%r8,%%r8\n");
+        printf("    cmovne %%r9,%%rax\n");
+    }
+    live_regs = outer_live;
+    operand_is_bool = is_bool && operand_is_bool;
+}
+
+/* evaluates a whole expression into %rax; nothing is live at statement level so nothing is saved */
+void expression(int perform) {
+    e6(perform);
+    moveValue(perform, "%al", "%rax");
+}
+
+/* evaluates an expression for a branch and returns the condition code that is set when it is true */
+char *condition(int perform) {
+    e6(perform);
+    return valueCondition(perform);
+}
+
+/* evaluates the right side of an assignment straight into the variable */
+void assign(char *id, int perform) {
+    e6(perform);
+    if (perform) {
+        storeValue(perform, varLocation(id));
+    } else {
+        pending_cc = 0;
+    }
+}
+
+/* evaluates the right side of an assignment to a field of a struct replaced by its fields straight
+   into the slot of the field, whose target starts at target_token */
+void assignReplacedField(struct trie_node *node_ptr, struct token *target_token, int perform) {
+    e6(perform);
+    if (!perform) {
+        pending_cc = 0;
+        return;
+    }
+    struct token *end_token = current_token;
+    current_token = target_token;
+    struct struct_var *field;
+    int offset = replacedField(node_ptr, &field, perform);
+    current_token = end_token;
+    char loc[64];
+    snprintf(loc, sizeof(loc), "%d(%%rbp)", offset);
+    if (field != 0 && field->is_inline) {
+        //a struct stored inline takes a copy of the words of the one assigned to it
+        moveValue(perform, "%al", "%rax");
+        for (int i = 0; i < findStructLayout(field->type)->words; i++) {
+            printf("    movq %d(%%rax), %%r9\n", 8 * i);
+            printf("    movq %%r9, %d(%%rbp)\n", offset + 8 * i);
+        }
+    } else if (field != 0 && field->is_byte && isConstantValue()) {
+        printf("    movb $%d,%s\n", (int) (constantValue() & 0xff), loc);
+    } else if (field != 0 && field->is_byte) {
+        moveValue(perform, "%al", "%rax");
+        printf("    movb %%al,%s\n", loc);
+    } else {
+        storeValue(perform, loc);
+    }
+}
+
+/* parses the target of an assignment to an element or a field. Returns -1 if the target is the
+   element in element_operand, else the displacement from %r8 of the field */
+int getLeftSideVariable(char* id, int isArr, int perform) {
+    if (isArr) {
+        //the value waits in %r9
+        arrayElement(id, perform, REG_R9);
+        if (!isDot()) {
+            return -1;
+        }
+        //a struct pointer in an element of an array of structs leads on to its fields
+        if (perform) {
+            printf("    mov %s,%%rax\n", element_operand);
+        }
+        struct_decode_type = element_type;
+    } else if(perform && isDot()){
+        get(id, "mov");
+    }
+    int displacement = -1;
+    //the field before holds a pointer that the next one is reached through
+    int through_pointer = 0;
+    struct_decode_words = 0;
+    struct_decode_byte = 0;
+    while(isDot()){
+        consume();
+        if (perform) {
+            if(!isId()){
+                error(GENERAL, "expected identifier after dot operator");
+            }
+            id = getId();
+            if(through_pointer){
+                printf("    movq %d(%%rax), %%rax\n", displacement); 
+                displacement = 0;
+            }
+            struct struct_var *field = findField(id, struct_decode_type);
+            displacement = (displacement == -1 ? 0 : displacement) + (field != 0 ? field->offset : 0);
+            struct_decode_type = field != 0 ? field->type : 0;
+            through_pointer = field == 0 || !field->is_inline;
+            struct_decode_words = through_pointer ? 0 : findStructLayout(field->type)->words;
+            struct_decode_byte = field != 0 && field->is_byte;
+        }
+        consume();
+    }
+    if (perform) {
+        printf("    mov %%rax, %%r8\n");
+    }
+    return displacement;
+} 
+
+/* window callbacks are entered from C: keep the registers it expects preserved and use the frame of
+   the function that opened the window; the five pushes also leave %rsp 16-byte aligned */
+void saveWindowRegisters(void) {
+    printf("    push %%rbp\n");
+    printf("    push %%rbx\n");
+    printf("    push %%r13\n");
+    printf("    push %%r14\n");
+    printf("    push %%r15\n");
+    printf("    mov rbp_store, %%rbp\n");
+}
+
+void restoreWindowRegisters(void) {
+    printf("    pop %%r15\n");
+    printf("    pop %%r14\n");
+    printf("    pop %%r13\n");
+    printf("    pop %%rbx\n");
+    printf("    pop %%rbp\n");
+}
+
+/* allocates the words of an array, leaving their address in %rax */
+void makeArraySpace(int words) {
+    makes_calls = 1;
+    printf("    mov $%lu, %%rdi\n", 8 * (unsigned long) words);
+    printf("    call arena_alloc\n");
+}
+
+/* the words an array of total elements takes up, with elements of the given struct type or of
+   element_bits each; 0 if the struct is not defined or the array would be too large */
+int arrayWords(int element_struct, int element_bits, int total) {
+    if (element_struct == 0) {
+        return (int) (((uint64_t) total * element_bits + 63) / 64);
+    }
+    struct struct_data *layout = findStructLayout(element_struct);
+    if (layout == 0 || layout->words == 0 || layout->words > INT32_MAX / 8 / total) {
+        return 0;
+    }
+    return layout->words * total;
+}
+
+/* the bits each element of an array of the given type takes: a char or boolean is a byte, or a bit
+   when the array is packed */
+int elementBits(int type, int packed) {
+    if (type != 0 && type != 1) {
+        return 64;
+    }
+    return packed ? 1 : 8;
+}
+
+//arrays and structs that do not escape live in the frame, up to this many slots each
+#define STACK_STORAGE_SLOTS 512
+
+/* the type of the variable named by use: the last declaration of it after from, or else the
+   variable known now */
+int declaredType(struct token *from, struct token *use) {
+    for (struct token *tkn = use->prev; tkn != from; tkn = tkn->prev) {
+        if (tkn->type == ID && strcmp(tkn->value.id, use->value.id) == 0 && tkn->prev->type == TYPE_KWD) {
+            return findVarType(tkn->prev->value.id);
+        }
+        if (tkn->type == ID && strcmp(tkn->value.id, use->value.id) == 0 && tkn->prev->type == MUL
+                && tkn->prev->prev->type == TYPE_KWD) {
+            int type = findVarType(tkn->prev->prev->value.id);
+            return type >= standardTypeCount ? type : 2;
+        }
+    }
+    struct trie_node *node_ptr = findVar(use->value.id);
+    return node_ptr != 0 ? node_ptr->var_type : 0;
+}
+
+/* nonzero if the value from use up to after is the whole right side of an assignment to a struct
+   stored inline in a struct variable, which only copies the words of the struct it refers to. from
+   is where the block of use was entered */
+int isCopySource(struct token *from, struct token *use, struct token *after) {
+    if (use->prev->type != EQ || (after->type != SEMI && after->type != RIGHT_BLOCK)) {
+        return 0;
+    }
+    struct token *target = use->prev->prev;
+    while (target->type == ID && target->prev->type == DOT && target->prev->prev->type == ID) {
+        target = target->prev->prev;
+    }
+    if (target->type != ID || target->next->type != DOT) {
+        return 0;
+    }
+    int type = declaredType(from, target);
+    struct struct_var *field = 0;
+    for (struct token *tkn = target->next; tkn->type == DOT && type != 0; tkn = tkn->next->next) {
+        field = findField(tkn->next->value.id, type);
+        type = field != 0 ? field->type : 0;
+    }
+    return field != 0 && field->is_inline;
+}
+
+/* nonzero if the storage of the array or struct declared by id_token may be reached once its block
+   is left. Elements and scalar fields may be used freely, but the value of the variable, or a row
+   or nested struct inside it, escapes wherever it is used on its own: when it is returned, stored,
+   passed to a function or printed, but not when it is only copied into a struct stored inline.
+   Taking the address of the variable with @ counts as well.
+   dims is the number of dimensions of an array, 0 for a struct; structType is the type of the
+   struct or of the elements of the array, 0 for words. */
+int escapes(struct token *id_token, int dims, int structType) {
+    int depth = 0;
+    for (struct token *tkn = id_token->next; tkn->type != END; tkn = tkn->next) {
+        if (tkn->type == LEFT_BLOCK) {
+            depth++;
+        } else if (tkn->type == RIGHT_BLOCK && depth-- == 0) {
+            return 0;
+        }
+        //a field of the same name is not the variable, nor is one declared again in an inner block
+        if (tkn->type != ID || strcmp(tkn->value.id, id_token->value.id) != 0 || tkn->prev->type == DOT
+                || tkn->prev->type == TYPE_KWD) {
+            continue;
+        }
+        if (tkn->prev->type == REFERENCE || (tkn->prev->type == DEREFERENCE && dims != 1)) {
+            return 1;
+        }
+        struct token *next = tkn->next;
+        if (tkn->prev->type == DEREFERENCE || next->type == EQ) {
+            continue;
+        }
+        //where the fields of the struct start
+        struct token *fields = next;
+        if (dims > 0) {
+            int indexes = 0;
+            while (next->type == LEFT_BRACKET) {
+                int nesting = 0;
+                do {
+                    nesting += (next->type == LEFT_BRACKET) - (next->type == RIGHT_BRACKET);
+                    next = next->next;
+                } while (nesting > 0 && next->type != END);
+                indexes++;
+            }
+            if (indexes < dims) {
+                return 1;
+            }
+            if (structType == 0) {
+                continue;
+            }
+            fields = next;
+        }
+        int type = structType;
+        while (next->type == DOT && next->next->type == ID) {
+            type = getVarTypeInStruct(next->next->value.id, type);
+            next = next->next->next;
+        }
+        if (next->type != EQ && (next == fields || type >= standardTypeCount)
+                && !isCopySource(id_token, tkn, next)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* nonzero if the struct variable declared by id_token is made to refer to another struct in its
+   block, so that its fields are not always the ones declared with it */
+int isRebound(struct token *id_token) {
+    int depth = 0;
+    for (struct token *tkn = id_token->next; tkn->type != END; tkn = tkn->next) {
+        if (tkn->type == LEFT_BLOCK) {
+            depth++;
+        } else if (tkn->type == RIGHT_BLOCK && depth-- == 0) {
+            return 0;
+        }
+        if (tkn->type == ID && strcmp(tkn->value.id, id_token->value.id) == 0 && tkn->prev->type != DOT
+                && tkn->next->type == EQ) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* reserves consecutive frame slots below the variables declared so far and returns the offset of
+   the lowest one from %rbp, so that the slots read upwards from there like malloc'd memory */
+int reserveFrameSlots(int count) {
+    namespace_head->next_var_num -= count;
+    int lowest = namespace_head->next_var_num + 1;
+    if (-lowest > frame_slots) {
+        frame_slots = -lowest;
+    }
+    return 8 * lowest;
+}
+
+/* prints the call that leaves the arena blocks a break or continue jumps out of */
+void leaveLoopArenas(void) {
+    if (arena_loop_mark != 0) {
+        printf("    mov %d(%%rbp),%%rdi\n", arena_loop_mark);
+        printf("    call arena_leave\n");
+    }
+}
+
+/* the sizes of the array whose declaration starts at the current [, and the words all of them take
+   up; returns the number of dimensions, 0 if a size is not a literal, is 0 or there are too many */
+int arrayDims(int *dims, int *total) {
+    int dim_count = 0;
+    *total = 1;
+    for (struct token *tkn = current_token; tkn->type == LEFT_BRACKET; tkn = tkn->next->next->next) {
+        if (tkn->next->type != INTEGER || tkn->next->next->type != RIGHT_BRACKET || dim_count == MAX_ARRAY_DIMS) {
+            return 0;
+        }
+        uint64_t size = tkn->next->value.integer;
+        if (size == 0 || size > INT32_MAX / 8 || *total > INT32_MAX / 8 / size) {
+            return 0;
+        }
+        *total *= size;
+        dims[dim_count++] = size;
+    }
+    return dim_count;
+}
+
+/* nonzero if the [ at the current token starts the sizes of an array initialized with a list */
+int isTable(void) {
+    struct token *tkn = current_token;
+    while (tkn->type == LEFT_BRACKET) {
+        tkn = tkn->next->type == RIGHT_BRACKET ? tkn->next->next : tkn->next->next->next;
+    }
+    return tkn->type == EQ && tkn->next->type == LEFT_BLOCK;
+}
+
+/* 1 if an element of the array declared at id_token is assigned, or its address taken with @, before
+   the block of the declaration ends; 2 if the array or one of its rows is used as a value, such as an
+   argument, which may be written through; 0 otherwise */
+int tableWritten(struct token *id_token, int dim_count) {
+    int escapes = 0;
+    int depth = 0;
+    for (struct token *tkn = id_token->next; tkn->type != END; tkn = tkn->next) {
+        if (tkn->type == LEFT_BLOCK) {
+            depth++;
+        } else if (tkn->type == RIGHT_BLOCK && depth-- == 0) {
+            return escapes;
+        }
+        if (tkn->type != ID || strcmp(tkn->value.id, id_token->value.id) != 0 || tkn->prev->type == DOT
+                || tkn->prev->type == TYPE_KWD) {
+            continue;
+        }
+        if (tkn->prev->type == REFERENCE) {
+            return 1;
+        }
+        struct token *next = tkn->next;
+        int nesting = 0;
+        int indexes = 0;
+        while (next->type == LEFT_BRACKET || nesting > 0) {
+            indexes += next->type == LEFT_BRACKET && nesting == 0;
+            nesting += (next->type == LEFT_BRACKET) - (next->type == RIGHT_BRACKET);
+            next = next->next;
+        }
+        if (indexes != 0 && next->type == EQ) {
+            return 1;
+        }
+        escapes |= indexes < dim_count ? 2 : 0;
+    }
+    return escapes;
+}
+
+/* parses the sizes of an array of the given type and the list of literals after them, the current
+   token being the first [. A single size can be left out as [], the list then sets it; elements the
+   list does not reach are 0. The table is recorded under the token of the name, so compiling the
+   declaration again gives the same one */
+struct table_data *tableInitializer(struct token *id_token, int type, int is_const) {
+    struct table_data *table = table_head;
+    while (table != 0 && table->index != id_token->index) {
+        table = table->next;
+    }
+    int known = table != 0;
+    if (!known) {
+        table = calloc(1, sizeof(struct table_data));
+        table->id = id_token->value.id;
+        table->index = id_token->index;
+        table->bytes = type == 0 || type == 1 ? 1 : 8;
+        if (type >= standardTypeCount) {
+            error(GENERAL, "tables hold words, chars and booleans, not structs");
+        }
+    }
+    int total = 0;
+    if (current_token->next->type == RIGHT_BRACKET) {
+        consume();
+        consume();
+    } else {
+        table->dim_count = arrayDims(table->dims, &total);
+        if (table->dim_count == 0) {
+            error(GENERAL, "expected number index after [");
+        }
+        while (isLeftBracket()) {
+            consume();
+            consume();
+            consume();
+        }
+    }
+    consume();
+    consume();
+    int count = 0;
+    while (!isRightBlock() && !isEnd()) {
+        int negative = isMinus();
+        if (negative) {
+            consume();
+        }
+        if (!isInt() && !isChar() && !isTrue() && !isFalse()) {
+            error(GENERAL, "a table is initialized with literals only");
+        }
+        uint64_t value = isInt() ? getInt() : isChar() ? getChar() : isTrue();
+        consume();
+        if (!known) {
+            if (count % 256 == 0) {
+                table->values = realloc(table->values, (count + 256) * sizeof(uint64_t));
+            }
+            table->values[count] = negative ? -value : value;
+        }
+        count++;
+        if (isComma()) {
+            consume();
+        } else if (!isRightBlock()) {
+            error(GENERAL, "expected , or } in the list of a table");
+        }
+    }
+    consume();
+    if (known) {
+        return table;
+    }
+    if (table->dim_count == 0) {
+        table->dims[0] = count;
+        table->dim_count = 1;
+        total = count;
+    }
+    if (count == 0 || count > total) {
+        error(GENERAL, "the list of a table has to fit its sizes and hold at least one element");
+    }
+    table->count = count;
+    table->total = total;
+    //a table that escapes may be written by whoever gets it, unless it is const
+    int written = tableWritten(id_token, table->dim_count);
+    if (written == 1 && (is_const || namespace_head->next != 0)) {
+        error(GENERAL, "the elements of a const or local table cannot be written");
+    }
+    table->writable = written != 0 && !is_const;
+    //kept in program order
+    struct table_data **last = &table_head;
+    while (*last != 0) {
+        last = &(*last)->next;
+    }
+    *last = table;
+    return table;
+}
+
+/* assembles the tables in .rodata, or .data for the ones the program writes, each padded to whole
+   words. Several elements go on a line, so that large tables stay short */
+void printTables(void) {
+    for (struct table_data *table = table_head; table != 0; table = table->next) {
+        printf(table->writable ? "    .data\n" : "    .section .rodata\n");
+        printf("    .align 8\n");
+        printf("%s_table_%d:\n", table->id, table->index);
+        int per_line = table->bytes == 1 ? 16 : 8;
+        for (int i = 0; i < table->count; i++) {
+            uint64_t value = table->bytes == 1 ? table->values[i] & 0xff : table->values[i];
+            if (i % per_line == 0) {
+                printf("    %s %" PRIu64, table->bytes == 1 ? ".byte" : ".quad", value);
+            } else {
+                printf(",%" PRIu64, value);
+            }
+            if (i % per_line == per_line - 1 || i == table->count - 1) {
+                printf("\n");
+            }
+        }
+        int size = table->bytes * table->count;
+        int padded = (table->bytes * table->total + 7) / 8 * 8;
+        if (padded > size) {
+            printf("    .zero %d\n", padded - size);
+        }
+        if (table->next == 0) {
+            printf("    .data\n");
+        }
+    }
+}
+
+int compareCases(const void *left, const void *right) {
+    uint64_t left_value = ((const struct swit_entry *) left)->value;
+    uint64_t right_value = ((const struct swit_entry *) right)->value;
+    return left_value < right_value ? -1 : left_value > right_value;
+}
+
+/* nonzero if switch_cases[lo..hi) fill at least a third of their range, so a jump table pays off */
+int isDenseCases(int lo, int hi) {
+    int n = hi - lo;
+    return n >= 4 && (switch_cases[hi - 1].value - switch_cases[lo].value) / 3 < (uint64_t) n;
+}
+
+/* compares the switch value in %rax with a case value */
+void compareCase(uint64_t value) {
+    if (value <= INT32_MAX) {
+        printf("    cmpq $%" PRIu64 ",%%rax\n", value);
+    } else {
+        printf("    movabs $%" PRIu64 ",%%rdx\n", value);
+        printf("    cmp %%rdx,%%rax\n");
+    }
+}
+
+/* jumps through a table in .rodata covering every value from the first case to the last */
+void switchTable(int lo, int hi) {
+    uint64_t first = switch_cases[lo].value;
+    uint64_t range = switch_cases[hi - 1].value - first;
+    unsigned int table = switch_node_count++;
+    printf("    mov %%rax,%%rcx\n");
+    if (first > INT32_MAX) {
+        printf("    movabs $%" PRIu64 ",%%rdx\n", first);
+        printf("    sub %%rdx,%%rcx\n");
+    } else if (first != 0) {
+        printf("    sub $%" PRIu64 ",%%rcx\n", first);
+    }
+    printf("    cmp $%" PRIu64 ",%%rcx\n", range);
+    printf("    ja .%dSWDEF\n", switch_count);
+    printf("    jmp *.SW%d_%u(,%%rcx,8)\n", switch_count, table);
+    printf("    .pushsection .rodata\n");
+    printf("    .align 8\n");
+    printf(".SW%d_%u:\n", switch_count, table);
+    int i = lo;
+    for (uint64_t offset = 0; offset <= range; offset++) {
+        if (switch_cases[i].value - first == offset) {
+            printf("    .quad .%dSW%d\n", switch_count, switch_cases[i].casecount);
+            i++;
+        } else {
+            printf("    .quad .%dSWDEF\n", switch_count);
+        }
+    }
+    printf("    .popsection\n");
+}
+
+/* with a profile, compares the value with the cases that take a third or more of the remaining runs
+   (and a tenth of all of them) before the general dispatch, hottest first */
+void peelHotCases(uint64_t total) {
+    if (profile_data == 0) {
+        return;
+    }
+    uint64_t runs = total;
+    int *peeled = calloc(switch_case_count, sizeof(int));
+    for (int round = 0; round < 3 && total > 0; round++) {
+        int hottest = -1;
+        for (int i = 0; i < switch_case_count; i++) {
+            if (!peeled[i] && (hottest == -1 || profileCount(switch_cases[i].profile_key)
+                    > profileCount(switch_cases[hottest].profile_key))) {
+                hottest = i;
+            }
+        }
+        if (hottest == -1) {
+            break;
+        }
+        uint64_t count = profileCount(switch_cases[hottest].profile_key);
+        if (count == 0 || count * 3 < total || count * 10 < runs) {
+            break;
+        }
+        compareCase(switch_cases[hottest].value);
+        printf("    je .%dSW%d\n", switch_count, switch_cases[hottest].casecount);
+        peeled[hottest] = 1;
+        total -= count < total ? count : total;
+    }
+    free(peeled);
+}
+
+/* groups the sorted cases into clusters: each maximal dense run of at least four cases becomes one
+   jump table cluster, every other case is a cluster of its own; returns the number of clusters */
+int clusterCases(void) {
+    int clusters = 0;
+    int i = 0;
+    switch_clusters = realloc(switch_clusters, (switch_case_count + 1) * sizeof(int));
+    while (i < switch_case_count) {
+        int end = i + 1;
+        for (int j = i + 4; j <= switch_case_count; j++) {
+            if (isDenseCases(i, j)) {
+                end = j;
+            }
+        }
+        switch_clusters[clusters++] = i;
+        i = end;
+    }
+    switch_clusters[clusters] = switch_case_count;
+    return clusters;
+}
+
+/* dispatches on clusters [lo, hi) with a binary search tree over the clusters; a few single cases
+   are compared directly and a dense cluster uses its jump table */
+void switchDispatch(int lo, int hi) {
+    int first_case = switch_clusters[lo];
+    int end_case = switch_clusters[hi];
+    if (hi - lo == 1 && end_case - first_case > 1) {
+        switchTable(first_case, end_case);
+        return;
+    }
+    if (end_case - first_case == hi - lo && hi - lo <= 3) {
+        for (int i = first_case; i < end_case; i++) {
+            compareCase(switch_cases[i].value);
+            printf("    je .%dSW%d\n", switch_count, switch_cases[i].casecount);
+        }
+        printf("    jmp .%dSWDEF\n", switch_count);
+        return;
+    }
+    int split = lo + (hi - lo) / 2;
+    unsigned int node = switch_node_count++;
+    compareCase(switch_cases[switch_clusters[split]].value);
+    printf("    jae .%dSWB%u\n", switch_count, node);
+    switchDispatch(lo, split);
+    printf(".%dSWB%u:\n", switch_count, node);
+    switchDispatch(split, hi);
+}
+
+/* returns the next odd hash multiplier from a splitmix64 sequence */
+uint64_t nextMultiplier(uint64_t *state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return (z ^ (z >> 31)) | 1;
+}
+
+uint64_t hashCase(uint64_t value, uint64_t multiplier, int bits) {
+    return (value * multiplier) >> (64 - bits);
+}
+
+/* dispatches a large sparse switch in constant time with a hash-and-displace perfect hash: the first
+   hash picks a bucket whose displacement is xored into the second hash to get a collision-free slot.
+   Returns 0 without emitting anything if no pair of multipliers works. */
+int switchHash(void) {
+    int n = switch_case_count;
+    int bucket_bits = 1;
+    while ((1 << bucket_bits) < n / 2) {
+        bucket_bits++;
+    }
+    int slot_bits = 1;
+    while ((1 << slot_bits) < 2 * n) {
+        slot_bits++;
+    }
+    int buckets = 1 << bucket_bits;
+    int slots = 1 << slot_bits;
+    int *bucket_first = malloc((buckets + 1) * sizeof(int));
+    int *bucket_fill = malloc(buckets * sizeof(int));
+    int *members = malloc(n * sizeof(int));
+    int *slot_case = malloc(slots * sizeof(int));
+    uint64_t *displacement = malloc(buckets * sizeof(uint64_t));
+    uint64_t state = 0;
+    uint64_t bucket_multiplier = 0;
+    uint64_t slot_multiplier = 0;
+    int found = 0;
+    for (int attempt = 0; attempt < 64 && !found; attempt++) {
+        bucket_multiplier = nextMultiplier(&state);
+        slot_multiplier = nextMultiplier(&state);
+        //group the cases by bucket
+        memset(bucket_fill, 0, buckets * sizeof(int));
+        for (int i = 0; i < n; i++) {
+            bucket_fill[hashCase(switch_cases[i].value, bucket_multiplier, bucket_bits)]++;
+        }
+        int largest = 0;
+        bucket_first[0] = 0;
+        for (int b = 0; b < buckets; b++) {
+            largest = bucket_fill[b] > largest ? bucket_fill[b] : largest;
+            bucket_first[b + 1] = bucket_first[b] + bucket_fill[b];
+            bucket_fill[b] = bucket_first[b];
+        }
+        for (int i = 0; i < n; i++) {
+            members[bucket_fill[hashCase(switch_cases[i].value, bucket_multiplier, bucket_bits)]++] = i;
+        }
+        //place the biggest buckets first while the table is still empty
+        memset(displacement, 0, buckets * sizeof(uint64_t));
+        for (int i = 0; i < slots; i++) {
+            slot_case[i] = -1;
+        }
+        found = 1;
+        for (int size = largest; size > 0 && found; size--) {
+            for (int b = 0; b < buckets && found; b++) {
+                if (bucket_first[b + 1] - bucket_first[b] != size) {
+                    continue;
+                }
+                found = 0;
+                for (int d = 0; d < slots && !found; d++) {
+                    int k = bucket_first[b];
+                    for (; k < bucket_first[b + 1]; k++) {
+                        int slot = hashCase(switch_cases[members[k]].value, slot_multiplier, slot_bits) ^ d;
+                        if (slot_case[slot] != -1) {
+                            break;
                         }
-                        else{
-                            curtok->next = switinsert->next;
-                            switinsert->next = curtok;
-                            switinsert = curtok;
+                        slot_case[slot] = members[k];
+                    }
+                    if (k == bucket_first[b + 1]) {
+                        displacement[b] = d;
+                        found = 1;
+                    } else {
+                        for (int u = bucket_first[b]; u < k; u++) {
+                            slot_case[hashCase(switch_cases[members[u]].value, slot_multiplier, slot_bits) ^ d] = -1;
                         }
                     }
-
                 }
-                if(isDefault()){
-                    defaultflag++;
-                    consume();
-                    struct swit_token * curtok = malloc(sizeof(struct swit_token));
-                    curtok->switchnum = switch_count;
-                    if(swithead == NULL){
-                        swithead = curtok;
-                        switinsert = curtok;
-                        curtok->next = NULL;
-                    }
-                    else{
-                        if(switinsert->switchnum != curtok->switchnum){
-                            curtok->next = swithead;
-                            swithead = curtok;
-                            switinsert = curtok;
-                        }
-                        else{
-                            curtok->next = switinsert->next;
-                            switinsert->next = curtok;
-                            switinsert = curtok;
-                        }
+            }
+        }
+    }
+    if (found) {
+        printf("    mov %%rax,%%rcx\n");
+        printf("    movabs $%" PRIu64 ",%%rdx\n", bucket_multiplier);
+        printf("    imul %%rdx,%%rcx\n");
+        printf("    shr $%d,%%rcx\n", 64 - bucket_bits);
+        printf("    mov .SWD%d(,%%rcx,8),%%rdx\n", switch_count);
+        printf("    movabs $%" PRIu64 ",%%rcx\n", slot_multiplier);
+        printf("    imul %%rax,%%rcx\n");
+        printf("    shr $%d,%%rcx\n", 64 - slot_bits);
+        printf("    xor %%rdx,%%rcx\n");
+        printf("    cmp .SWK%d(,%%rcx,8),%%rax\n", switch_count);
+        printf("    jne .%dSWDEF\n", switch_count);
+        printf("    jmp *.SW%d(,%%rcx,8)\n", switch_count);
+        printf("    .pushsection .rodata\n");
+        printf("    .align 8\n");
+        printf(".SWD%d:\n", switch_count);
+        for (int b = 0; b < buckets; b++) {
+            printf("    .quad %" PRIu64 "\n", displacement[b]);
+        }
+        //an empty slot holds a key that hashes elsewhere, so the compare always fails there
+        printf(".SWK%d:\n", switch_count);
+        for (int i = 0; i < slots; i++) {
+            printf("    .quad %" PRIu64 "\n", switch_cases[slot_case[i] == -1 ? 0 : slot_case[i]].value);
+        }
+        printf(".SW%d:\n", switch_count);
+        for (int i = 0; i < slots; i++) {
+            if (slot_case[i] == -1) {
+                printf("    .quad .%dSWDEF\n", switch_count);
+            } else {
+                printf("    .quad .%dSW%d\n", switch_count, switch_cases[slot_case[i]].casecount);
+            }
+        }
+        printf("    .popsection\n");
+    }
+    free(bucket_first);
+    free(bucket_fill);
+    free(members);
+    free(slot_case);
+    free(displacement);
+    return found;
+}
+
+#define VECTOR_ARRAYS 6
+#define VECTOR_INVARIANTS 8
+#define VECTOR_DEPTH 7
+
+/* a counted for loop whose body is a single map or reduction over arrays, which SSE2 runs two
+   iterations at a time before the loop itself runs the ones left over */
+struct vector_loop {
+    char *index; //the loop variable
+    struct token *bound; //the variable or literal it counts up to
+    char *target; //the array the body assigns an element of, 0 for a reduction
+    char *sum; //the variable a reduction accumulates into, 0 for a map
+    enum token_type op;
+    struct token *value; //the expression the body computes
+    //the arrays used, the target first, and the variables and literals that stay the same
+    char *arrays[VECTOR_ARRAYS];
+    int columns[VECTOR_ARRAYS]; //the bytes from the start of each array to the words used
+    int array_count;
+    struct token *invariants[VECTOR_INVARIANTS];
+    int invariant_count;
+};
+
+//the registers holding the arrays; the invariants are broadcast into %xmm8 onwards, a reduction
+//accumulates in %xmm7 and expressions are evaluated in %xmm0 to %xmm6
+static char *vector_bases[VECTOR_ARRAYS] = {"%rdi", "%rsi", "%r8", "%r9", "%r10", "%r11"};
+
+int isTokenId(struct token *tkn, char *id) {
+    return tkn->type == ID && id != 0 && strcmp(tkn->value.id, id) == 0;
+}
+
+/* nonzero if the variable is a long the vector loop may read as a whole, such as a loop bound */
+int isVectorScalar(char *id) {
+    struct trie_node *node_ptr = findVar(id);
+    return node_ptr != 0 && node_ptr->var_type == 2 && node_ptr->dim_count == 0 && !isFunctionName(id);
+}
+
+/* for an element at the loop index, arr[i] or the field of one in a soa array, pts[i].x, returns
+   the bytes from the start of the array to the consecutive words holding it and leaves *tkn after
+   it; -1 if it is not such an element */
+int vectorColumn(struct vector_loop *loop, struct token **tkn) {
+    struct token *operand = *tkn;
+    struct token *index = operand->next->next;
+    if (operand->type != ID || operand->next->type != LEFT_BRACKET || !isTokenId(index, loop->index)
+            || index->next->type != RIGHT_BRACKET || isFunctionName(operand->value.id)) {
+        return -1;
+    }
+    struct trie_node *node_ptr = findVar(operand->value.id);
+    if (node_ptr == 0 || node_ptr->var_type != 2 || node_ptr->dim_count > 1 || node_ptr->element_bits != 64) {
+        return -1;
+    }
+    struct token *after = index->next->next;
+    if (node_ptr->element_struct == 0) {
+        *tkn = after;
+        return after->type == DOT ? -1 : 0;
+    }
+    if (!node_ptr->soa) {
+        return -1;
+    }
+    int type = node_ptr->element_struct;
+    int offset = 0;
+    struct struct_var *field = 0;
+    while (after->type == DOT && after->next->type == ID && (field == 0 || field->is_inline)) {
+        field = findField(after->next->value.id, type);
+        if (field == 0) {
+            return -1;
+        }
+        offset += field->offset;
+        type = field->type;
+        after = after->next->next;
+    }
+    *tkn = after;
+    if (field == 0 || field->is_inline || field->is_byte || after->type == DOT) {
+        return -1;
+    }
+    return offset * node_ptr->dims[0];
+}
+
+/* the position of an array, at the column of the words used, among the ones the loop uses, adding
+   it on the dry run; -1 if there are too many */
+int vectorArray(struct vector_loop *loop, char *id, int column, int perform) {
+    for (int i = 0; i < loop->array_count; i++) {
+        if (strcmp(loop->arrays[i], id) == 0 && loop->columns[i] == column) {
+            return i;
+        }
+    }
+    if (perform || loop->array_count == VECTOR_ARRAYS) {
+        return -1;
+    }
+    loop->arrays[loop->array_count] = id;
+    loop->columns[loop->array_count] = column;
+    return loop->array_count++;
+}
+
+int vectorInvariant(struct vector_loop *loop, struct token *tkn, int perform) {
+    for (int i = 0; i < loop->invariant_count; i++) {
+        struct token *known = loop->invariants[i];
+        if (known->type == tkn->type && (tkn->type == INTEGER ? known->value.integer == tkn->value.integer
+                : strcmp(known->value.id, tkn->value.id) == 0)) {
+            return i;
+        }
+    }
+    if (perform || loop->invariant_count == VECTOR_INVARIANTS) {
+        return -1;
+    }
+    loop->invariants[loop->invariant_count] = tkn;
+    return loop->invariant_count++;
+}
+
+int vectorExpression(struct vector_loop *loop, struct token **tkn, int depth, enum token_type only, int perform);
+
+/* an operand of the body: the element of an array at the loop index, a variable or literal, or an
+   expression in parentheses. Returns the %xmm register holding it, -1 if it cannot be vectorized. */
+int vectorOperand(struct vector_loop *loop, struct token **tkn, int depth, int perform) {
+    struct token *operand = *tkn;
+    if (operand->type == LEFT) {
+        *tkn = operand->next;
+        int reg = vectorExpression(loop, tkn, depth, END, perform);
+        if (reg < 0 || (*tkn)->type != RIGHT) {
+            return -1;
+        }
+        *tkn = (*tkn)->next;
+        return reg;
+    }
+    if (operand->type == ID && operand->next->type == LEFT_BRACKET) {
+        int column = vectorColumn(loop, tkn);
+        if (depth >= VECTOR_DEPTH || column < 0 || isTokenId(operand, loop->sum)) {
+            return -1;
+        }
+        int array = vectorArray(loop, operand->value.id, column, perform);
+        if (array < 0) {
+            return -1;
+        }
+        if (perform) {
+            printf("    movdqu (%s,%%rax,8),%%xmm%d\n", vector_bases[array], depth);
+        }
+        return depth;
+    }
+    if (operand->type == INTEGER || (operand->type == ID && operand->next->type != LEFT
+            && isVectorScalar(operand->value.id) && !isTokenId(operand, loop->index)
+            && !isTokenId(operand, loop->sum) && !isTokenId(operand, loop->target))) {
+        *tkn = operand->next;
+        int invariant = vectorInvariant(loop, operand, perform);
+        return invariant < 0 ? -1 : 8 + invariant;
+    }
+    return -1;
+}
+
+/* combines the value in the left register with the next operand, leaving the result at depth */
+int vectorCombine(struct vector_loop *loop, struct token **tkn, int left, int depth, int perform,
+        int (*operand)(struct vector_loop *, struct token **, int, int)) {
+    enum token_type op = (*tkn)->type;
+    char *instruction = op == PLUS ? "paddq" : op == MINUS ? "psubq" : op == AND ? "pand" : op == OR ? "por" : "pxor";
+    *tkn = (*tkn)->next;
+    if (perform && left != depth) {
+        printf("    movdqa %%xmm%d,%%xmm%d\n", left, depth);
+    }
+    int right = depth + 1 < VECTOR_DEPTH ? operand(loop, tkn, depth + 1, perform) : -1;
+    if (right < 0) {
+        return -1;
+    }
+    if (perform) {
+        printf("    %s %%xmm%d,%%xmm%d\n", instruction, right, depth);
+    }
+    return depth;
+}
+
+/* '+' and '-', which bind tighter than '&', '|' and '^' as in e3 */
+int vectorSum(struct vector_loop *loop, struct token **tkn, int depth, int perform) {
+    int reg = vectorOperand(loop, tkn, depth, perform);
+    while (reg >= 0 && ((*tkn)->type == PLUS || (*tkn)->type == MINUS)) {
+        reg = vectorCombine(loop, tkn, reg, depth, perform, vectorOperand);
+    }
+    return reg;
+}
+
+/* '&', '|' and '^', or only the one given when a reduction regroups them; multiplication and
+   division have no 64-bit SSE2 instructions, so they stop the expression */
+int vectorExpression(struct vector_loop *loop, struct token **tkn, int depth, enum token_type only, int perform) {
+    int reg = vectorSum(loop, tkn, depth, perform);
+    while (reg >= 0 && ((only == END && ((*tkn)->type == AND || (*tkn)->type == OR || (*tkn)->type == XOR))
+            || (*tkn)->type == only)) {
+        reg = vectorCombine(loop, tkn, reg, depth, perform, vectorSum);
+    }
+    return reg;
+}
+
+/* parses the value of the body, which must end the statement; returns its register or -1 */
+int vectorValue(struct vector_loop *loop, int perform) {
+    struct token *tkn = loop->value;
+    int reg;
+    if (loop->sum == 0) {
+        reg = vectorExpression(loop, &tkn, 0, END, perform);
+    } else if (loop->op == PLUS) {
+        //s = s + a - b is s + (a - b)
+        reg = vectorSum(loop, &tkn, 0, perform);
+    } else if (loop->op == MINUS) {
+        reg = vectorOperand(loop, &tkn, 0, perform);
+    } else {
+        reg = vectorExpression(loop, &tkn, 0, loop->op, perform);
+    }
+    if (tkn->type == SEMI) {
+        tkn = tkn->next;
+    }
+    return tkn->type == RIGHT_BLOCK ? reg : -1;
+}
+
+/* nonzero if the for loop is (long i = ... (i < n) i = i + 1;) with a body that is a block holding
+   one statement a[i] = <expression> or s = s <op> <expression>, using elements at i, variables
+   and literals, '+', '-', '&', '|' and '^'. The fields of a soa array, pts[i].x, are elements as
+   well. Fills in the loop. */
+int matchVectorLoop(struct vector_loop *loop, struct token *cond_token, struct token *inc_token, struct token *body) {
+    memset(loop, 0, sizeof(struct vector_loop));
+    struct token *tkn = cond_token;
+    if (tkn->type != LEFT || tkn->next->type != ID || tkn->next->next->type != LT) {
+        return 0;
+    }
+    loop->index = tkn->next->value.id;
+    loop->bound = tkn->next->next->next;
+    if (loop->bound->next->type != RIGHT || loop->bound->next->next != inc_token || !isVectorScalar(loop->index)
+            || !(loop->bound->type == INTEGER || (loop->bound->type == ID && isVectorScalar(loop->bound->value.id)
+            && !isTokenId(loop->bound, loop->index)))) {
+        return 0;
+    }
+    tkn = inc_token;
+    if (!isTokenId(tkn, loop->index) || tkn->next->type != EQ || !isTokenId(tkn->next->next, loop->index)
+            || tkn->next->next->next->type != PLUS || tkn->next->next->next->next->type != INTEGER
+            || tkn->next->next->next->next->value.integer != 1) {
+        return 0;
+    }
+    tkn = body;
+    if (tkn->type != LEFT_BLOCK || tkn->next->type != ID) {
+        return 0;
+    }
+    tkn = tkn->next;
+    if (tkn->next->type == LEFT_BRACKET) {
+        loop->target = tkn->value.id;
+        int column = vectorColumn(loop, &tkn);
+        if (column < 0 || tkn->type != EQ) {
+            return 0;
+        }
+        vectorArray(loop, loop->target, column, 0);
+        loop->value = tkn->next;
+    } else {
+        struct token *op = tkn->next->next->next;
+        if (tkn->next->type != EQ || !isTokenId(tkn->next->next, tkn->value.id) || !isVectorScalar(tkn->value.id)
+                || isTokenId(tkn, loop->index) || isTokenId(loop->bound, tkn->value.id)
+                || !(op->type == PLUS || op->type == MINUS || op->type == AND || op->type == OR || op->type == XOR)) {
+            return 0;
+        }
+        loop->sum = tkn->value.id;
+        loop->op = op->type;
+        loop->value = op->next;
+    }
+    return vectorValue(loop, 0) >= 0;
+}
+
+/* runs pairs of iterations of a matched loop with SSE2, from the current value of the loop variable
+   up to the last pair before the bound, and leaves the loop variable after them */
+void vectorLoop(struct vector_loop *loop, unsigned int for_num) {
+    char *instructions[] = {"paddq", "psubq", "pand", "por", "pxor"};
+    char *scalar[] = {"add", "sub", "and", "or", "xor"};
+    int op = loop->op == PLUS ? 0 : loop->op == MINUS ? 1 : loop->op == AND ? 2 : loop->op == OR ? 3 : 4;
+    get(loop->index, "mov");
+    if (loop->bound->type == INTEGER) {
+        printf("    mov $%" PRIu64 ",%%rdx\n", loop->bound->value.integer);
+    } else {
+        printf("    mov %s,%%rdx\n", varLocation(loop->bound->value.id));
+    }
+    printf("    cmp %%rdx,%%rax\n");
+    printf("    jae vector_end_%u\n", for_num);
+    //%rcx is where the pairs end
+    printf("    mov %%rdx,%%rcx\n");
+    printf("    sub %%rax,%%rcx\n");
+    printf("    and $-2,%%rcx\n");
+    printf("    je vector_end_%u\n", for_num);
+    printf("    add %%rax,%%rcx\n");
+    for (int i = 0; i < loop->array_count; i++) {
+        printf("    mov %s,%s\n", varLocation(loop->arrays[i]), vector_bases[i]);
+        if (loop->columns[i] != 0) {
+            printf("    add $%d,%s\n", loop->columns[i], vector_bases[i]);
+        }
+    }
+    for (int i = 1; loop->target != 0 && i < loop->array_count; i++) {
+        //another array overlapping the target by less than a pair would see elements the pair writes
+        printf("    mov %%rdi,%%rdx\n");
+        printf("    sub %s,%%rdx\n", vector_bases[i]);
+        printf("    add $15,%%rdx\n");
+        printf("    cmp $30,%%rdx\n");
+        printf("    jbe vector_end_%u\n", for_num);
+    }
+    for (int i = 0; i < loop->invariant_count; i++) {
+        struct token *invariant = loop->invariants[i];
+        if (invariant->type == INTEGER) {
+            printf("    mov $%" PRIu64 ",%%rdx\n", invariant->value.integer);
+        } else {
+            printf("    mov %s,%%rdx\n", varLocation(invariant->value.id));
+        }
+        printf("    movq %%rdx,%%xmm%d\n", 8 + i);
+        printf("    punpcklqdq %%xmm%d,%%xmm%d\n", 8 + i, 8 + i);
+    }
+    if (loop->sum != 0) {
+        printf(op == 2 ? "    pcmpeqd %%xmm7,%%xmm7\n" : "    pxor %%xmm7,%%xmm7\n");
+    }
+    printf("vector_body_%u:\n", for_num);
+    int reg = vectorValue(loop, 1);
+    if (loop->sum != 0) {
+        //a difference is accumulated as a sum and subtracted at the end
+        printf("    %s %%xmm%d,%%xmm7\n", instructions[op == 1 ? 0 : op], reg);
+    } else {
+        printf("    movdqu %%xmm%d,(%%rdi,%%rax,8)\n", reg);
+    }
+    printf("    add $2,%%rax\n");
+    printf("    cmp %%rcx,%%rax\n");
+    printf("    jne vector_body_%u\n", for_num);
+    if (loop->sum != 0) {
+        printf("    pshufd $78,%%xmm7,%%xmm0\n");
+        printf("    %s %%xmm0,%%xmm7\n", instructions[op == 1 ? 0 : op]);
+        printf("    movq %%xmm7,%%rdx\n");
+        printf("    %s %%rdx,%s\n", scalar[op], varLocation(loop->sum));
+    }
+    printf("    mov %%rax,%s\n", varLocation(loop->index));
+    printf("vector_end_%u:\n", for_num);
+}
+
+int statement(int perform) {
+    //fprintf(stderr, "%s\n", current_token->value.id);
+    if (isId()) {
+        char *id = getId();
+        consume();
+        int isArr = isLeftBracket();
+        int isField = isDot();
+        //the target address is computed after the value so that calls on the right side cannot clobber %r8
+        struct token *target_token = current_token;
+        if (isArr || isField) {
+            getLeftSideVariable(id, isArr, 0);
+        }
+        if (!isEq()) {
+            error(GENERAL, "Expected =\n");
+        }
+        consume();
+        struct trie_node *table_node = isArr || isField ? 0 : findVar(id);
+        if (table_node != 0 && table_node->table != 0) {
+            error(GENERAL, "a table cannot be assigned, only its elements can");
+        }
+        int whichType = getVarType(id);
+        variableType = whichType;
+        struct trie_node *replaced = isField ? findVar(id) : 0;
+        if (!(isArr || isField)) {
+            assign(id, perform);
+        } else if (replaced != 0 && replaced->fields_at != 0) {
+            assignReplacedField(replaced, target_token, perform);
+            isField = 0;
+        } else {
+            expression(perform);
+        }
+        if (perform) {
+            if (isArr || isField) {
+                printf("    mov %%rax, %%r9\n");
+                struct token *end_token = current_token;
+                current_token = target_token;
+                struct_decode_type = getVarType(id);
+                struct_decode_type_np = struct_decode_type;
+                int displacement = getLeftSideVariable(id, isArr, perform);
+                current_token = end_token;
+                if (displacement >= 0) {
+                    printf("    addq $%d, %%r8\n", displacement);
+                } else if (element_words > 0) {
+                    printf("    lea %s, %%r8\n", element_operand);
+                    struct_decode_words = element_words;
+                }
+                if (displacement < 0 && element_words == 0) {
+                    storeElement();
+                } else if (struct_decode_words > 0) {
+                    //a struct stored inline takes a copy of the words of the one assigned to it
+                    for (int i = 0; i < struct_decode_words; i++) {
+                        printf("    movq %d(%%r9), %%rax\n", 8 * i);
+                        printf("    movq %%rax, %d(%%r8)\n", 8 * i);
                     }
+                } else if (struct_decode_byte) {
+                    printf("    movb %%r9b, (%%r8)\n");
+                } else {
+                    printf("    movq %%r9, (%%r8)\n");
                 }
             }
-            else{
+        }
+        if (isSemi()) {
+            consume();
+        }
+        variableType = 2;
+        return 1;
+    } else if (isDereference()) {
+        //a store through a pointer: the address is computed after the value, which waits in %r9
+        consume();
+        struct token *target_token = current_token;
+        dereference(0, REG_R9);
+        if (!isEq()) {
+            error(GENERAL, "Expected =\n");
+        }
+        consume();
+        variableType = 2;
+        expression(perform);
+        if (perform) {
+            printf("    mov %%rax,%%r9\n");
+            touched_regs |= REG_R9;
+            struct token *end_token = current_token;
+            current_token = target_token;
+            int bytes = dereference(perform, REG_R9);
+            current_token = end_token;
+            printf(bytes == 1 ? "    movb %%r9b,%s\n" : "    movq %%r9,%s\n", pointer_operand);
+        }
+        if (isSemi()) {
+            consume();
+        }
+        variableType = 2;
+        return 1;
+    } else if (isType() || isSoa() || isPacked() || isConst()) {
+        int is_const = isConst();
+        if (is_const) {
+            consume();
+        }
+        int soa = isSoa();
+        int packed = isPacked();
+        if (soa || packed) {
+            consume();
+        }
+        int isStruct = isType() && isStructType();
+        if (soa && !isStruct) {
+            error(GENERAL, "soa applies to arrays of structs only");
+        } else if (packed && (!isType() || findVarType(current_token->value.id) != 0)) {
+            error(GENERAL, "packed applies to arrays of booleans only");
+        }
+        char* typeName = current_token->value.id;
+        consume();
+        int stride = pointerDeclaration(findVarType(typeName));
+        if(!isId()){
+            error(GENERAL, "expected identifier after type name");
+        }
+        //?could probably be improved
+        char *id = getId();
+        struct token *id_token = current_token;
+        consume();
+        if (isLeftBracket() && stride != 0) {
+            error(GENERAL, "arrays hold words, not pointers of their own type");
+        }
+        if (isLeftBracket() && isTable()) {
+            if (soa || packed) {
+                error(GENERAL, "soa and packed apply to arrays without an initializer");
+            }
+            //a table is static storage, like a global
+            struct table_data *table = tableInitializer(id_token, findVarType(typeName), is_const);
+            if (perform) {
+                setVarNum(id, 1, 2)->table = table;
+                setArrayDims(id, table->dims, table->dim_count, 0, 0, 8 * table->bytes);
+            }
+            if (isSemi()) {
                 consume();
-                if(isInt()){
-                    consume();
+            }
+            return 1;
+        } else if (is_const) {
+            error(GENERAL, "const applies to arrays with an initializer");
+        }
+        int dims[MAX_ARRAY_DIMS];
+        int total = 0;
+        int dim_count = perform && isLeftBracket() ? arrayDims(dims, &total) : 0;
+        if (isLeftBracket()) {
+            int element_struct = isStruct ? findVarType(typeName) : 0;
+            int element_bits = elementBits(findVarType(typeName), packed);
+            int words = dim_count > 0 ? arrayWords(element_struct, element_bits, total) : 0;
+            if (perform && dim_count == 0) {
+                error(GENERAL, "expected number index after [");
+            } else if (perform && words == 0) {
+                error(GENERAL, "arrays of structs take a struct type defined before them");
+            }
+            if (words > 0) {
+                //an array of structs is laid out like one of words, with the fields of each element
+                //together or, with soa, a column of each field after the other
+                if (words <= STACK_STORAGE_SLOTS && !escapes(id_token, dim_count, element_struct)) {
+                    printf("    lea %d(%%rbp),%%rax\n", reserveFrameSlots(words));
+                } else {
+                    makeArraySpace(words);
+                }
+                setVarNum(id, namespace_head->next_var_num, 2);
+                namespace_head->next_var_num--;
+                setArrayDims(id, dims, dim_count, element_struct, soa, element_bits);
+                set(id);
+            }
+            while (isLeftBracket()) {
+                consume();
+                consume();
+                consume();
+            }
+            if (isSemi()) {
+                consume();
+            }
+            return 1;
+        } else if (soa || packed) {
+            error(GENERAL, "soa and packed apply to arrays only");
+        }
+        //the offset of the fields of a struct replaced by them, which are used like locals of their own
+        int fields_at = 0;
+        if(perform && isStruct && stride == 0){
+            int structType = findVarType(typeName);
+            if (isFlatStruct(structType) && findStructLayout(structType)->words <= STACK_STORAGE_SLOTS
+                    && !escapes(id_token, 0, structType)) {
+                //the fields start out like the ones <type>_struct allocates
+                struct struct_data *layout = findStructLayout(structType);
+                int base = reserveFrameSlots(layout->words);
+                for (int i = 0; i < layout->words; i++) {
+                    printf("    movq $%" PRIu64 ",%d(%%rbp)\n", structFillWord(layout, i), base + 8 * i);
+                }
+                if (!isEq() && !isRebound(id_token)) {
+                    fields_at = base;
+                } else {
+                    printf("    lea %d(%%rbp),%%rax\n", base);
                 }
+            } else {
+                makes_calls = 1;
+                printf("    call %s_struct\n", typeName);
+            }
+        }
+        //?devorpmi eb ylbaborp dlouc
+        //a pointer to anything but a struct holds an address like any long
+        int whichVar = stride != 0 && !isStruct ? 2 : findVarType(typeName);
+        variableType = whichVar;
+        if (perform && fields_at != 0) {
+            //the variable has no slot of its own
+            setVarNum(id, fields_at / 8, whichVar)->fields_at = fields_at;
+        } else if (perform) {
+            setVarNum(id, namespace_head->next_var_num, whichVar)->pointer_stride = stride;
+            namespace_head->next_var_num--;
+        }
+        if (isEq()) {
+            consume();
+            assign(id, perform);
+        } else {
+            if (isSemi()) {
+                consume();
+            }
+            if (perform && fields_at == 0) {
+                //?should this be moved into the struct case?
+                set(id);
             }
         }
-        else{
-            if(swithead == NULL){
-                error(GENERAL, "No switch labels to allocate");
-            }
-            if(isCase()){
-                printf(".%dSW%d:\n", swithead->switchnum, swithead->casecount);
-                consume();
-                consume();
-            }
-            if(isDefault()){
-                printf(".%dSWDEF:\n", swithead->switchnum);
-                consume();
-            }
-            int locswitchnum = swithead->switchnum;
-            if(swithead == switinsert){
-                switinsert = switinsert->next;
+        variableType = 2;
+        return 1;
+    } else if (isLeftBlock()) {
+        consume();
+        beginVarScope();
+        seq(perform);
+        endVarScope();
+        if (!isRightBlock())
+            error(BRACKET_MISMATCH, "Unclosed statement block\n");
+        consume();
+        return 1;
+    } else if (isWindowStart()) {
+        isWindow = 1;
+        makes_calls = 1;
+        consume();
+        if(!isInt()){
+            error(GENERAL, "Expected window x size after declaring window start block\n");
+        }
+        uint64_t x_size = getInt();
+        consume();
+        if(!isInt()){
+            error(GENERAL, "Expected window y size after declaring window start block\n");
+        }
+        uint64_t y_size = getInt();
+        consume();
+        if(perform){
+            printf("    //WINDOW CODE BLOCK\n");
+            printf("    movq $ineedazero, %%rdi\n");
+            printf("    movq $0, %%rsi\n");
+            printf("    call glutInit\n");
+            printf("    movq $0, %%rdi\n");
+            printf("    call glutInitDisplayMode\n");
+            printf("    movq $0, %%rdi\n");
+            printf("    movq $0, %%rsi\n");
+            printf("    call glutInitWindowPosition\n");
+            printf("    movq $%lu, %%rdi\n", x_size);
+            printf("    movq $%lu, %%rsi\n", y_size);
+            printf("    movq %%rdi, window_x_size\n");
+            printf("    movq %%rsi, window_y_size\n");
+            printf("    call glutInitWindowSize\n");
+            printf("    movq $windowtitle, %%rdi\n");
+            printf("    call glutCreateWindow\n");
+            printf("    movq %%rbp, rbp_store\n");
+            printf("    call bg_setupwindow\n");
+            printf("    movq $windowloop_%u, %%rdi\n", window_count);
+            printf("    call glutDisplayFunc\n");
+            printf("    movq $windowloop_%u, %%rdi\n", window_count);
+            printf("    call glutIdleFunc\n");
+            if(isKBDown()){
+                printf("    movq $keyboard_%u, %%rdi\n", window_count);
+                printf("    call glutKeyboardFunc\n");
+            }
+            printf("    jmp keyboardup_setup_%u\n", window_count);
+            printf("    window_begin_%u:\n", window_count);
+            printf("    call glutMainLoop\n");
+            printf("    jmp windowdone_%u\n", window_count);
+            if(isKBDown()){
+                printf("    keyboard_%u:\n", window_count);
+                //calls inside the handler pass arguments in %rdi, so the key is kept in memory
+                printf("    movzbq %%dil, %%rax\n");
+                printf("    mov %%rax, key_store\n");
+                saveWindowRegisters();
+                consume();
+                while(!isKBDownEnd()){
+                    statement(perform);
+                }
+                restoreWindowRegisters();
+                printf("    ret\n");
+                consume();
+            }
+            printf("    keyboardup_setup_%u:\n", window_count);
+            if(isKBUp()){
+                printf("    movq $keyboardup_%u, %%rdi\n", window_count);
+                printf("    call glutKeyboardUpFunc\n");
+            }
+            printf("    jmp window_begin_%u\n", window_count);
+            if(isKBUp()){
+                printf("    keyboardup_%u:\n", window_count);
+                //calls inside the handler pass arguments in %rdi, so the key is kept in memory
+                printf("    movzbq %%dil, %%rax\n");
+                printf("    mov %%rax, key_store\n");
+                saveWindowRegisters();
+                consume();
+                while(!isKBUpEnd()){
+                    statement(perform);
+                }
+                restoreWindowRegisters();
+                printf("    ret\n");
+                consume();
+            }
+            printf("    windowloop_%u:\n", window_count);
+            saveWindowRegisters();
+            printf("    call bg_clear\n");
+            while(current_token->type != WINDOW_END){
+                statement(perform);
+            }
+            printf("    call glFlush\n");
+            restoreWindowRegisters();
+            printf("    ret\n");
+            printf("    windowdone_%u:\n", window_count);
+            printf("    //WINDOW END CODE BLOCK\n");
+            window_count = window_count + 1;
+        } else {
+            if(isKBDown()){
+                consume();
+                while(!isKBDownEnd()){
+                    statement(perform);
+                }
+                consume();
+            }
+            if(isKBUp()){
+                consume();
+                while(!isKBUpEnd()){
+                    statement(perform);
+                }
+                consume();
+            }
+            while(current_token->type != WINDOW_END){
+                statement(perform);
+            }
+        }
+        isWindow = 0;
+        consume();
+        return 1;   
+    } else if (isIf()) {
+        unsigned int if_num = if_count++;
+        struct token *if_token = current_token;
+        consume();
+        if (perform) {
+            profileCounter(profileKey(if_token, 0));
+        }
+        char *cc = condition(perform);
+        //with a profile, an arm taken in under a tenth of the runs is moved out of line so the
+        //other one falls through
+        uint64_t total = profileCount(profileKey(if_token, 0));
+        uint64_t taken = profileCount(profileKey(if_token, 1));
+        int cold_then = isColdArm(taken, total);
+        if (perform && cold_then) {
+            printf("    j%s if_then_%u\n", cc, if_num);
+            printf("    .pushsection .text.unlikely,\"ax\",@progbits\n");
+            printf("if_then_%u:\n", if_num);
+        } else if (perform) {
+            printf("    j%s if_end_%u\n", invertCondition(cc), if_num);
+        }
+        beginVarScope();
+        if (perform) {
+            profileCounter(profileKey(if_token, 1));
+        }
+        statement(perform);
+        endVarScope();
+        int has_else = isElse();
+        int cold_else = has_else && !cold_then && isColdArm(total - taken, total);
+        if (perform && cold_then) {
+            printf("    jmp %s_%u\n", has_else ? "else_end" : "if_end", if_num);
+            printf("    .popsection\n");
+        }
+        if (has_else) {
+            if (perform && cold_else) {
+                printf("    .pushsection .text.unlikely,\"ax\",@progbits\n");
+                printf("if_end_%u:\n", if_num);
+            } else if (perform && !cold_then) {
+                printf("    jmp else_end_%u\n", if_num);
+                printf("if_end_%u:\n", if_num);
+            }
+            consume();
+            beginVarScope();
+            statement(perform);
+            endVarScope();
+            if (perform && cold_else) {
+                printf("    jmp else_end_%u\n", if_num);
+                printf("    .popsection\n");
+            }
+            if (perform) {
+                printf("else_end_%u:\n", if_num);
+            }
+        } else if (perform) {
+            printf("if_end_%u:\n", if_num);
+        }
+        return 1;
+    } else if (isWhile()) {
+        //rotated loop: the test sits below the body so each iteration takes a single branch
+        char *outer_kind = loop_kind;
+        unsigned int outer_num = loop_num;
+        unsigned int while_num = while_count++;
+        struct token *while_token = current_token;
+        consume();
+        struct token *cond_token = current_token;
+        expression(0);
+        if (perform) {
+            printf("    jmp while_next_%u\n", while_num);
+            if (isHotCount(profileCount(profileKey(while_token, 0)))) {
+                printf("    .p2align 4\n");
+            }
+            printf("while_body_%u:\n", while_num);
+            profileCounter(profileKey(while_token, 0));
+        }
+        int outer_arena = arena_loop_mark;
+        loop_kind = "while";
+        loop_num = while_num;
+        arena_loop_mark = 0;
+        beginVarScope();
+        statement(perform);
+        endVarScope();
+        loop_kind = outer_kind;
+        loop_num = outer_num;
+        arena_loop_mark = outer_arena;
+        struct token *end_token = current_token;
+        current_token = cond_token;
+        if (perform) {
+            printf("while_next_%u:\n", while_num);
+        }
+        char *cc = condition(perform);
+        if (perform) {
+            printf("    j%s while_body_%u\n", cc, while_num);
+            printf("while_end_%u:\n", while_num);
+        }
+        current_token = end_token;
+        return 1;
+    } else if (isFor()){
+        //rotated like while: body, increment, then the test branching back to the body
+        char *outer_kind = loop_kind;
+        unsigned int outer_num = loop_num;
+        unsigned int for_num = for_count++;
+        struct token *for_token = current_token;
+        consume();
+        if (!isLeft()){
+            //add msg
+            error(PAREN_MISMATCH,"Expected (");
+        }
+        consume();
+        beginVarScope();
+        statement(perform);
+        struct token *cond_token = current_token;
+        expression(0);
+        struct token *inc_token = current_token;
+        statement(0);
+        if (!isRight()){
+            //add msg
+            error(PAREN_MISMATCH, "Expected )");
+        }
+        consume();
+        struct vector_loop vector;
+        if (perform && opt_level >= 2 && profile_file == 0 && matchVectorLoop(&vector, cond_token, inc_token, current_token)) {
+            vectorLoop(&vector, for_num);
+        }
+        if (perform) {
+            printf("    jmp for_test_%u\n", for_num);
+            if (isHotCount(profileCount(profileKey(for_token, 0)))) {
+                printf("    .p2align 4\n");
+            }
+            printf("for_body_%u:\n", for_num);
+            profileCounter(profileKey(for_token, 0));
+        }
+        int outer_arena = arena_loop_mark;
+        loop_kind = "for";
+        loop_num = for_num;
+        arena_loop_mark = 0;
+        statement(perform);
+        loop_kind = outer_kind;
+        loop_num = outer_num;
+        arena_loop_mark = outer_arena;
+        struct token *end_token = current_token;
+        current_token = inc_token;
+        if (perform) {
+            printf("for_next_%u:\n", for_num);
+        }
+        statement(perform);
+        current_token = cond_token;
+        if (perform) {
+            printf("for_test_%u:\n", for_num);
+        }
+        char *cc = condition(perform);
+        if (perform) {
+            printf("    j%s for_body_%u\n", cc, for_num);
+            printf("for_end_%u:\n", for_num);
+        }
+        current_token = end_token;
+        endVarScope();
+        return 1;
+    } else if (isSemi()) {
+        consume();
+        return 1;
+    } else if (isReturn()) {
+        consume();
+        expression(perform);
+        if (perform && arena_function_mark != 0) {
+            //the result waits in the mark's slot while the arena blocks are left
+            printf("    mov %d(%%rbp),%%rdi\n", arena_function_mark);
+            printf("    mov %%rax,%d(%%rbp)\n", arena_function_mark);
+            printf("    call arena_leave\n");
+            printf("    mov %d(%%rbp),%%rax\n", arena_function_mark);
+        }
+        if (perform) {
+            printf("    jmp %s_end\n", function_name);
+        }
+        if (isSemi()) {
+            consume();
+        }
+        return 1;
+    } else if (isPrint()) {
+        consume();
+        int is_string = isStringOperand();
+        expression(perform);
+        makes_calls = 1;
+        if (perform && is_string) {
+            printf("    mov %%rax,%%rdi\n");
+            printf("    call str_print\n");
+        } else if (perform) {
+            printf("    mov $output_format,%%rdi\n");
+            printf("    mov %%rax,%%rsi\n");
+            printf("    call printf\n");
+        }
+        if (isSemi()) {
+            consume();
+        }
+        return 1;
+    }  else if (isBell()) {
+        makes_calls = 1;
+        if (perform) {
+            printf("    mov $bell_format,%%rdi\n");
+            printf("    call printf\n");
+            printf("    movq stdout(%%rip), %%rdi\n");
+            printf("    call fflush\n");
+        }
+        consume();
+        return 1;
+    } else if (isDelay()) {
+        consume();
+        expression(perform); 
+        makes_calls = 1;
+        if (perform) {
+            printf("    mov %%rax,%%rdi\n");
+            printf("    call usleep\n");
+        }
+        return 1;
+    } else if(isSwitch()){
+        if(perform == 0){
+            consume();
+            expression(0);
+            if(current_token->type != LEFT_BLOCK){
+                error(GENERAL, "Missing left bracket after declaration of switch statement");
+            }
+            int locrunswiflag = runswiflag;
+            runswiflag = 0;
+            statement(0);
+            runswiflag = locrunswiflag;
+        }
+        else{
+            struct token *switch_token = current_token;
+            consume();
+            expression(1);
+            profileCounter(profileKey(switch_token, 0));
+            case_count = 0;
+            defaultflag = 0;
+            struct  token * res_token = current_token;
+            runswiflag = 1;
+            statement(0);
+            runswiflag = 0;
+            current_token = res_token;
+            if(defaultflag == 0){
+                error(GENERAL, "No switch allowed without default");
+            }
+            if(defaultflag > 1){
+                error(GENERAL, "Only one default statement allowed");
+            }
+            if(caseflag == 0){
+                error(GENERAL, "Switch statement with only default case not allowed");
+            }
+            qsort(switch_cases, switch_case_count, sizeof(struct swit_entry), compareCases);
+            for (int i = 1; i < switch_case_count; i++) {
+                if (switch_cases[i].value == switch_cases[i - 1].value) {
+                    error(GENERAL, "Two identical cases");
+                }
+            }
+            switch_node_count = 0;
+            peelHotCases(profileCount(profileKey(switch_token, 0)));
+            //a switch with many sparse clusters dispatches through a hash, the rest through a search tree
+            int clusters = clusterCases();
+            if (clusters < 64 || !switchHash()) {
+                switchDispatch(0, clusters);
+            }
+            switch_case_count = 0;
+            int locswitch_count = switch_count;
+            switch_count++;
+            beginVarScope();
+            statement(1);
+            endVarScope();
+            printf(" ESW%d:\n", locswitch_count);
+        }
+        return 1;
+    } else if(isCase() || isDefault()){
+        if(perform == 0){
+            if(runswiflag){
+                if(isCase()){
+                    caseflag++;
+                    int profile_key = profileKey(current_token, 0);
+                    consume();
+                    uint64_t casenum = getInt();
+                    consume();
+                    struct swit_token * curtok = malloc(sizeof(struct swit_token));
+                    if (switch_case_count == switch_case_size) {
+                        switch_case_size = switch_case_size == 0 ? 16 : 2 * switch_case_size;
+                        switch_cases = realloc(switch_cases, switch_case_size * sizeof(struct swit_entry));
+                    }
+                    switch_cases[switch_case_count].value = casenum;
+                    switch_cases[switch_case_count].casecount = case_count;
+                    switch_cases[switch_case_count].switchnum = switch_count;
+                    switch_cases[switch_case_count].profile_key = profile_key;
+                    switch_case_count++;
+                    curtok->casecount = case_count;
+                    curtok->switchnum = switch_count;
+                    case_count++;
+                    if(swithead == NULL){
+                        swithead = curtok;
+                        switinsert = curtok;
+                        curtok->next = NULL;
+                    }
+                    else{
+                        if(switinsert->switchnum != curtok->switchnum){
+                            curtok->next = swithead;
+                            swithead = curtok;
+                            switinsert = curtok;
+                        }
+                        else{
+                            curtok->next = switinsert->next;
+                            switinsert->next = curtok;
+                            switinsert = curtok;
+                        }
+                    }
+
+                }
+                if(isDefault()){
+                    defaultflag++;
+                    consume();
+                    struct swit_token * curtok = malloc(sizeof(struct swit_token));
+                    curtok->switchnum = switch_count;
+                    if(swithead == NULL){
+                        swithead = curtok;
+                        switinsert = curtok;
+                        curtok->next = NULL;
+                    }
+                    else{
+                        if(switinsert->switchnum != curtok->switchnum){
+                            curtok->next = swithead;
+                            swithead = curtok;
+                            switinsert = curtok;
+                        }
+                        else{
+                            curtok->next = switinsert->next;
+                            switinsert->next = curtok;
+                            switinsert = curtok;
+                        }
+                    }
+                }
+            }
+            else{
+                consume();
+                if(isInt()){
+                    consume();
+                }
+            }
+        }
+        else{
+            if(swithead == NULL){
+                error(GENERAL, "No switch labels to allocate");
+            }
+            if(isCase()){
+                printf(".%dSW%d:\n", swithead->switchnum, swithead->casecount);
+                profileCounter(profileKey(current_token, 0));
+                consume();
+                consume();
+            }
+            if(isDefault()){
+                printf(".%dSWDEF:\n", swithead->switchnum);
+                consume();
+            }
+            int locswitchnum = swithead->switchnum;
+            if(swithead == switinsert){
+                switinsert = switinsert->next;
+            }
+            swithead = swithead->next;
+            while(!isCase() && !isBreak() && !isRightBlock()){
+                statement(1);
+            }
+            if(isBreak()){
+                printf("    jmp ESW%d\n", locswitchnum);
+                consume();
+            }
+        }
+        return 1;
+    } else if (isPlay()) {
+        consume();
+        if(!isLeft()) {
+            error(PAREN_MISMATCH, "Missing parenthesis after play\n");
+        }
+
+        consume();
+        /*frequency*/
+        expression(perform);
+        if(perform != 0) {
+            printf("	mov %%rax, %%rdi\n");
+        }
+
+        if(!isComma()) {
+            error(GENERAL, "Missing comma after frequency\n");
+        }
+
+        consume();
+        /*length*/
+        expression(perform);
+        if(perform != 0) {
+            printf("	mov %%rax, %%rsi\n");
+        }
+        if(!isComma()) {
+            error(GENERAL, "Missing comma after frequency\n");
+        }
+
+        consume();
+        /*repetitions*/
+        expression(perform);
+        if(perform != 0) {
+            printf("	mov %%rax, %%rdx\n");
+        }
+        if(!isRight()) {
+            error(GENERAL, "Missing right parenthesis after play\n");
+        }
+        makes_calls = 1;
+        if(perform != 0) {
+            printf("	call play\n");
+        }
+        consume();
+        return 1;
+    } else if (isBreak()){
+        if(perform == 0){
+         consume();
+        }
+        else{
+         leaveLoopArenas();
+         printf("    jmp %s_end_%u\n", loop_kind, loop_num);
+         consume();
+        }
+        return 1;
+    } else if (isContinue()){
+        if(perform == 0){
+         consume();
+        }
+        else{
+         leaveLoopArenas();
+         printf("    jmp %s_next_%u\n", loop_kind, loop_num);
+         consume();
+        }
+        return 1;
+    } else if (isArena()) {
+        //allocations inside the block, including those of the functions it calls, are given back at its end
+        consume();
+        if (!isLeftBlock()) {
+            error(GENERAL, "Expected { after arena\n");
+        }
+        makes_calls = 1;
+        int mark = 0;
+        if (perform) {
+            mark = reserveFrameSlots(1);
+            printf("    call arena_enter\n");
+            printf("    mov %%rax,%d(%%rbp)\n", mark);
+        }
+        int outer_function_mark = arena_function_mark;
+        int outer_loop_mark = arena_loop_mark;
+        arena_function_mark = arena_function_mark != 0 ? arena_function_mark : mark;
+        arena_loop_mark = arena_loop_mark != 0 ? arena_loop_mark : mark;
+        statement(perform);
+        arena_function_mark = outer_function_mark;
+        arena_loop_mark = outer_loop_mark;
+        if (perform) {
+            printf("    mov %d(%%rbp),%%rdi\n", mark);
+            printf("    call arena_leave\n");
+        }
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+void seq(int perform) {
+    while (statement(perform)) { fflush(stdout); }
+}
+
+
+/* Passes run over the generated assembly of each function, one line per entry; a deleted line
+   becomes 0. Labels and directives (section switches, tables) end a basic block. */
+struct pass {
+    char *name;
+    int level; //lowest -O level that runs the pass
+    int (*run)(char **lines, int count); //returns the number of changes made
+    int disabled;
+    int changes;
+    double seconds;
+};
+
+static char *print_after = 0;
+static int pass_stats = 0;
+
+int isLabelLine(char *line) {
+    while (*line == ' ') {
+        line++;
+    }
+    size_t length = strlen(line);
+    return length > 1 && line[length - 1] == ':' && strchr(line, ' ') == 0;
+}
+
+int isDirectiveLine(char *line) {
+    while (*line == ' ') {
+        line++;
+    }
+    return *line == '.' && !isLabelLine(line);
+}
+
+int isCommentLine(char *line) {
+    while (*line == ' ') {
+        line++;
+    }
+    return line[0] == '/' && line[1] == '/';
+}
+
+/* splits an instruction into its mnemonic and up to three operands, honouring the commas inside
+   memory operands; returns the number of operands or -1 for a line that is not an instruction */
+int parseInstruction(char *line, char *mnemonic, char operands[3][64]) {
+    if (line == 0 || isLabelLine(line) || isDirectiveLine(line) || isCommentLine(line)) {
+        return -1;
+    }
+    while (*line == ' ' || *line == '\t') {
+        line++;
+    }
+    int length = 0;
+    while (*line != 0 && *line != ' ' && *line != '\t' && length < 15) {
+        mnemonic[length++] = *line++;
+    }
+    mnemonic[length] = 0;
+    if (length == 0) {
+        return -1;
+    }
+    int count = 0;
+    int depth = 0;
+    length = 0;
+    while (*line == ' ' || *line == '\t') {
+        line++;
+    }
+    if (*line == 0) {
+        return 0;
+    }
+    for (; count < 3; line++) {
+        if (*line == '(') {
+            depth++;
+        } else if (*line == ')') {
+            depth--;
+        }
+        if (*line == 0 || (*line == ',' && depth == 0)) {
+            operands[count][length] = 0;
+            count++;
+            length = 0;
+            if (*line == 0) {
+                break;
+            }
+            while (line[1] == ' ') {
+                line++;
+            }
+        } else if (length < 63) {
+            operands[count][length++] = *line;
+        }
+    }
+    return count;
+}
+
+/* index of the line defining the label, or -1 */
+int findLabel(char **lines, int count, char *name) {
+    size_t length = strlen(name);
+    for (int i = 0; i < count; i++) {
+        if (lines[i] == 0 || !isLabelLine(lines[i])) {
+            continue;
+        }
+        char *label = lines[i];
+        while (*label == ' ') {
+            label++;
+        }
+        if (strncmp(label, name, length) == 0 && label[length] == ':') {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* index of the first instruction at or after i, skipping labels and comments, or -1 if a
+   directive or the end comes first */
+int nextInstruction(char **lines, int count, int i) {
+    for (; i < count; i++) {
+        if (lines[i] == 0 || isLabelLine(lines[i]) || isCommentLine(lines[i])) {
+            continue;
+        }
+        return isDirectiveLine(lines[i]) ? -1 : i;
+    }
+    return -1;
+}
+
+void replaceLine(char **lines, int i, char *text) {
+    free(lines[i]);
+    lines[i] = text != 0 ? strdup(text) : 0;
+}
+
+/* returns the conditional jump taken exactly when the given one is not, or 0 */
+char *invertJump(char *mnemonic) {
+    static char *pairs[][2] = {
+        {"je", "jne"}, {"jb", "jae"}, {"ja", "jbe"}, {"jl", "jge"}, {"jg", "jle"}, {"js", "jns"}
+    };
+    for (int i = 0; i < 6; i++) {
+        for (int j = 0; j < 2; j++) {
+            if (strcmp(mnemonic, pairs[i][j]) == 0) {
+                return pairs[i][1 - j];
+            }
+        }
+    }
+    return 0;
+}
+
+/* jump threading, removal of code after an unconditional jump and of jumps to the next line; a
+   conditional jump over an unconditional one becomes the inverted jump to its target */
+int jumpsPass(char **lines, int count) {
+    int changes = 0;
+    char mnemonic[16];
+    char operands[3][64];
+    for (int i = 0; i < count; i++) {
+        if (parseInstruction(lines[i], mnemonic, operands) != 1 || mnemonic[0] != 'j' || operands[0][0] == '*') {
+            continue;
+        }
+        char target[64];
+        strcpy(target, operands[0]);
+        for (int depth = 0; depth < 8; depth++) {
+            int label = findLabel(lines, count, target);
+            int next = label < 0 ? -1 : nextInstruction(lines, count, label + 1);
+            char next_mnemonic[16];
+            char next_operands[3][64];
+            if (next < 0 || parseInstruction(lines[next], next_mnemonic, next_operands) != 1
+                    || strcmp(next_mnemonic, "jmp") != 0 || next_operands[0][0] == '*'
+                    || strcmp(next_operands[0], target) == 0) {
+                break;
+            }
+            strcpy(target, next_operands[0]);
+        }
+        if (strcmp(target, operands[0]) != 0) {
+            char text[96];
+            snprintf(text, sizeof(text), "    %s %s", mnemonic, target);
+            replaceLine(lines, i, text);
+            changes++;
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        if (parseInstruction(lines[i], mnemonic, operands) < 0
+                || !(strcmp(mnemonic, "jmp") == 0 || strcmp(mnemonic, "ret") == 0)) {
+            continue;
+        }
+        for (int k = i + 1; k < count; k++) {
+            if (lines[k] == 0 || isCommentLine(lines[k])) {
+                continue;
+            }
+            if (isLabelLine(lines[k]) || isDirectiveLine(lines[k])) {
+                break;
+            }
+            replaceLine(lines, k, 0);
+            changes++;
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        if (parseInstruction(lines[i], mnemonic, operands) != 1 || invertJump(mnemonic) == 0) {
+            continue;
+        }
+        int next = i + 1;
+        while (next < count && (lines[next] == 0 || isCommentLine(lines[next]))) {
+            next++;
+        }
+        char next_mnemonic[16];
+        char next_operands[3][64];
+        if (next >= count || parseInstruction(lines[next], next_mnemonic, next_operands) != 1
+                || strcmp(next_mnemonic, "jmp") != 0 || next_operands[0][0] == '*') {
+            continue;
+        }
+        //only labels may stand between the unconditional jump and the target of the conditional one
+        int label = findLabel(lines, count, operands[0]);
+        int between = label > next;
+        for (int k = next + 1; k < label && between; k++) {
+            between = lines[k] == 0 || isCommentLine(lines[k]) || isLabelLine(lines[k]);
+        }
+        if (between) {
+            char text[96];
+            snprintf(text, sizeof(text), "    %s %s", invertJump(mnemonic), next_operands[0]);
+            replaceLine(lines, i, text);
+            replaceLine(lines, next, 0);
+            changes++;
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        if (parseInstruction(lines[i], mnemonic, operands) != 1 || mnemonic[0] != 'j' || operands[0][0] == '*') {
+            continue;
+        }
+        //the jump is dropped if only labels stand between it and its target
+        for (int k = i + 1; k < count; k++) {
+            if (lines[k] == 0 || isCommentLine(lines[k])) {
+                continue;
+            }
+            if (!isLabelLine(lines[k])) {
+                break;
+            }
+            if (findLabel(lines + k, 1, operands[0]) == 0) {
+                replaceLine(lines, i, 0);
+                changes++;
+                break;
+            }
+        }
+    }
+    return changes;
+}
+
+int isNameChar(char ch) {
+    return isalnum(ch) || ch == '_' || ch == '.';
+}
+
+/* removes labels nothing in the function refers to, so they stop splitting basic blocks */
+int labelsPass(char **lines, int count) {
+    int changes = 0;
+    for (int i = 0; i < count; i++) {
+        if (lines[i] == 0 || !isLabelLine(lines[i])) {
+            continue;
+        }
+        char name[64];
+        char *label = lines[i];
+        while (*label == ' ') {
+            label++;
+        }
+        snprintf(name, sizeof(name), "%.*s", (int) strlen(label) - 1, label);
+        size_t length = strlen(name);
+        int used = 0;
+        for (int k = 0; k < count && !used; k++) {
+            if (k == i || lines[k] == 0) {
+                continue;
+            }
+            for (char *use = strstr(lines[k], name); use != 0 && !used; use = strstr(use + 1, name)) {
+                used = (use == lines[k] || !isNameChar(use[-1])) && !isNameChar(use[length]);
+            }
+        }
+        if (!used) {
+            replaceLine(lines, i, 0);
+            changes++;
+        }
+    }
+    return changes;
+}
+
+/* drops moves of a location onto itself, reloads of a value just stored and moves straight back */
+int peepholePass(char **lines, int count) {
+    int changes = 0;
+    char mnemonic[16];
+    char operands[3][64];
+    char next_mnemonic[16];
+    char next_operands[3][64];
+    for (int i = 0; i < count; i++) {
+        if (parseInstruction(lines[i], mnemonic, operands) != 2
+                || !(strcmp(mnemonic, "mov") == 0 || strcmp(mnemonic, "movq") == 0)) {
+            continue;
+        }
+        if (strcmp(operands[0], operands[1]) == 0) {
+            replaceLine(lines, i, 0);
+            changes++;
+            continue;
+        }
+        int next = i + 1;
+        while (next < count && (lines[next] == 0 || isCommentLine(lines[next]))) {
+            next++;
+        }
+        if (next < count && parseInstruction(lines[next], next_mnemonic, next_operands) == 2
+                && (strcmp(next_mnemonic, "mov") == 0 || strcmp(next_mnemonic, "movq") == 0)
+                && strcmp(operands[0], next_operands[1]) == 0 && strcmp(operands[1], next_operands[0]) == 0
+                && operands[0][0] == '%') {
+            replaceLine(lines, next, 0);
+            changes++;
+        }
+    }
+    return changes;
+}
+
+/* returns the 64-bit register an operand names, such as "%rax" for "%al", or 0 */
+char *baseRegister(char *operand) {
+    static char *names[16][4] = {
+        {"%rax", "%eax", "%ax", "%al"}, {"%rbx", "%ebx", "%bx", "%bl"},
+        {"%rcx", "%ecx", "%cx", "%cl"}, {"%rdx", "%edx", "%dx", "%dl"},
+        {"%rsi", "%esi", "%si", "%sil"}, {"%rdi", "%edi", "%di", "%dil"},
+        {"%rbp", "%ebp", "%bp", "%bpl"}, {"%rsp", "%esp", "%sp", "%spl"},
+        {"%r8", "%r8d", "%r8w", "%r8b"}, {"%r9", "%r9d", "%r9w", "%r9b"},
+        {"%r10", "%r10d", "%r10w", "%r10b"}, {"%r11", "%r11d", "%r11w", "%r11b"},
+        {"%r12", "%r12d", "%r12w", "%r12b"}, {"%r13", "%r13d", "%r13w", "%r13b"},
+        {"%r14", "%r14d", "%r14w", "%r14b"}, {"%r15", "%r15d", "%r15w", "%r15b"}
+    };
+    for (int i = 0; i < 16; i++) {
+        for (int j = 0; j < 4; j++) {
+            if (strcmp(operand, names[i][j]) == 0) {
+                return names[i][0];
+            }
+        }
+    }
+    return 0;
+}
+
+/* nonzero for a memory operand whose contents the forward pass follows: a frame slot or a global */
+int isTrackedMemory(char *operand) {
+    size_t length = strlen(operand);
+    return (length > 6 && strcmp(operand + length - 6, "(%rbp)") == 0 && strchr(operand, ',') == 0)
+        || (length > 4 && strcmp(operand + length - 4, "_var") == 0);
+}
+
+#define MAX_FORWARDS 16
+
+/* store-to-load forwarding inside a basic block: a load from a slot or global whose value is still
+   in a register becomes a register move, or disappears if it is already in the destination. A slot
+   last stored an immediate is loaded as that immediate */
+int forwardPass(char **lines, int count) {
+    int changes = 0;
+    char keys[MAX_FORWARDS][64];
+    char holders[MAX_FORWARDS][64];
+    int known = 0;
+    char mnemonic[16];
+    char operands[3][64];
+    for (int i = 0; i < count; i++) {
+        if (lines[i] == 0 || isCommentLine(lines[i])) {
+            continue;
+        }
+        int operand_count = parseInstruction(lines[i], mnemonic, operands);
+        if (operand_count < 0 || strcmp(mnemonic, "call") == 0 || strcmp(mnemonic, "jmp") == 0
+                || strcmp(mnemonic, "ret") == 0 || strcmp(mnemonic, "leave") == 0) {
+            known = 0;
+            continue;
+        }
+        int is_move = operand_count == 2 && (strcmp(mnemonic, "mov") == 0 || strcmp(mnemonic, "movq") == 0);
+        //a conditional jump falls through into the same block
+        if (mnemonic[0] == 'j' || strncmp(mnemonic, "cmp", 3) == 0 || strncmp(mnemonic, "test", 4) == 0
+                || strcmp(mnemonic, "push") == 0) {
+            continue;
+        }
+        char *written[2] = {0, 0};
+        char *stored = 0;
+        if (is_move && isTrackedMemory(operands[0]) && baseRegister(operands[1]) != 0
+                && strcmp(baseRegister(operands[1]), operands[1]) == 0) {
+            char *holder = 0;
+            for (int k = 0; k < known; k++) {
+                if (strcmp(keys[k], operands[0]) == 0) {
+                    holder = holders[k];
+                }
+            }
+            if (holder != 0 && strcmp(holder, operands[1]) == 0) {
+                replaceLine(lines, i, 0);
+                changes++;
+                continue;
+            }
+            if (holder != 0) {
+                char text[160];
+                snprintf(text, sizeof(text), "    mov %s,%s", holder, operands[1]);
+                replaceLine(lines, i, text);
+                changes++;
+            }
+            written[0] = baseRegister(operands[1]);
+        } else if (strncmp(mnemonic, "div", 3) == 0 || strncmp(mnemonic, "idiv", 4) == 0
+                || strcmp(mnemonic, "rdtsc") == 0) {
+            written[0] = "%rax";
+            written[1] = "%rdx";
+        } else if (operand_count >= 1 && (strcmp(mnemonic, "pop") == 0 || strcmp(mnemonic, "neg") == 0
+                || strcmp(mnemonic, "not") == 0 || strncmp(mnemonic, "inc", 3) == 0
+                || strncmp(mnemonic, "dec", 3) == 0 || strncmp(mnemonic, "set", 3) == 0
+                || operand_count >= 2)) {
+            char *destination = operands[operand_count - 1];
+            if (baseRegister(destination) != 0) {
+                written[0] = baseRegister(destination);
+            } else {
+                stored = destination;
+            }
+        } else {
+            known = 0;
+            continue;
+        }
+        //forget what the instruction overwrote
+        for (int k = 0; k < known; k++) {
+            int stale = 0;
+            for (int w = 0; w < 2; w++) {
+                stale |= written[w] != 0 && (strcmp(holders[k], written[w]) == 0 || strstr(keys[k], written[w]) != 0);
+            }
+            if (stored != 0 && !isTrackedMemory(stored) && strchr(stored, '(') != 0
+                    && strstr(stored, "(%rsp") == 0) {
+                //a store through a pointer may hit any variable
+                stale = 1;
+            }
+            //a byte field shares its slot with the bytes next to it
+            stale |= stored != 0 && strcmp(mnemonic, "movb") == 0;
+            stale |= stored != 0 && strcmp(keys[k], stored) == 0;
+            if (stale) {
+                if (k != --known) {
+                    strcpy(keys[k], keys[known]);
+                    strcpy(holders[k], holders[known]);
+                }
+                k--;
+            }
+        }
+        if (is_move && written[0] != 0 && isTrackedMemory(operands[0]) && known < MAX_FORWARDS) {
+            strcpy(keys[known], operands[0]);
+            strcpy(holders[known++], written[0]);
+        } else if (is_move && stored != 0 && isTrackedMemory(stored) && known < MAX_FORWARDS
+                && (operands[0][0] == '$' || (baseRegister(operands[0]) != 0
+                && strcmp(baseRegister(operands[0]), operands[0]) == 0))) {
+            strcpy(keys[known], stored);
+            strcpy(holders[known++], operands[0]);
+        }
+    }
+    return changes;
+}
+
+/* what the scheduler knows about one instruction, or a flags producer glued to its consumers */
+struct sched_node {
+    int first; //first line of the node, the rest follow it in the original order
+    int last;
+    unsigned int reads; //registers as bits in the order of baseRegister, bit 16 is the flags
+    unsigned int writes;
+    char memory[64]; //memory operand, empty if none
+    int width; //bytes the instruction reads or writes at memory
+    int loads;
+    int stores;
+    int latency;
+    int unit; //SCHED_ALU, SCHED_LOAD, SCHED_MUL or SCHED_DIV
+    int priority;
+    int ready; //earliest cycle it can issue
+    int waiting; //unscheduled predecessors
+    int scheduled;
+};
+
+enum sched_unit {
+    SCHED_ALU,
+    SCHED_LOAD,
+    SCHED_MUL,
+    SCHED_DIV
+};
+
+#define SCHED_FLAGS (1u << 16)
+#define MAX_SCHED_REGION 128
+
+/* bit of the register an operand part names, 0 if none */
+unsigned int registerBit(char *name) {
+    static char *order[16] = {"%rax", "%rbx", "%rcx", "%rdx", "%rsi", "%rdi", "%rbp", "%rsp",
+        "%r8", "%r9", "%r10", "%r11", "%r12", "%r13", "%r14", "%r15"};
+    char *base = baseRegister(name);
+    for (int i = 0; base != 0 && i < 16; i++) {
+        if (strcmp(base, order[i]) == 0) {
+            return 1u << i;
+        }
+    }
+    return 0;
+}
+
+/* registers mentioned anywhere in an operand, such as the base and index of a memory operand */
+unsigned int operandRegisters(char *operand) {
+    unsigned int bits = 0;
+    for (char *ch = strchr(operand, '%'); ch != 0; ch = strchr(ch + 1, '%')) {
+        char name[8];
+        int length = 0;
+        name[length++] = '%';
+        while (isalnum(ch[length]) && length < 7) {
+            name[length] = ch[length];
+            length++;
+        }
+        name[length] = 0;
+        bits |= registerBit(name);
+    }
+    return bits;
+}
+
+int isMemoryOperand(char *operand) {
+    return operand[0] != '$' && operand[0] != '%';
+}
+
+/* fills in the effects of an instruction; returns 0 for one the scheduler must not move across */
+int describeInstruction(char *line, struct sched_node *node) {
+    char mnemonic[16];
+    char operands[3][64];
+    int count = parseInstruction(line, mnemonic, operands);
+    //vector instructions stay where they are
+    if (count < 0 || strstr(line, "%xmm") != 0) {
+        return 0;
+    }
+    size_t length = strlen(mnemonic);
+    if (length > 3 && mnemonic[length - 1] == 'q' && strncmp(mnemonic, "movz", 4) != 0 && strncmp(mnemonic, "movs", 4) != 0) {
+        mnemonic[length - 1] = 0; //movq, addq, cmpq, leaq, divq, incq
+    }
+    node->reads = 0;
+    node->writes = 0;
+    node->memory[0] = 0;
+    node->width = strcmp(mnemonic, "movzbq") == 0 || strncmp(mnemonic, "set", 3) == 0 ? 1
+        : strcmp(mnemonic, "movslq") == 0 ? 4 : 8;
+    node->loads = 0;
+    node->stores = 0;
+    node->latency = 1;
+    node->unit = SCHED_ALU;
+    int is_move = strcmp(mnemonic, "mov") == 0 || strcmp(mnemonic, "movzbq") == 0 || strcmp(mnemonic, "movslq") == 0
+        || strcmp(mnemonic, "movabs") == 0;
+    int is_lea = strcmp(mnemonic, "lea") == 0;
+    int is_compare = strcmp(mnemonic, "cmp") == 0 || strcmp(mnemonic, "test") == 0;
+    int is_arith = strcmp(mnemonic, "add") == 0 || strcmp(mnemonic, "sub") == 0 || strcmp(mnemonic, "imul") == 0
+        || strcmp(mnemonic, "and") == 0 || strcmp(mnemonic, "or") == 0 || strcmp(mnemonic, "xor") == 0
+        || strcmp(mnemonic, "shl") == 0 || strcmp(mnemonic, "shr") == 0 || strcmp(mnemonic, "sar") == 0;
+    int is_cmov = strncmp(mnemonic, "cmov", 4) == 0;
+    int is_unary = strcmp(mnemonic, "neg") == 0 || strcmp(mnemonic, "not") == 0 || strcmp(mnemonic, "inc") == 0
+        || strcmp(mnemonic, "dec") == 0;
+    int is_set = strncmp(mnemonic, "set", 3) == 0;
+    int is_div = strcmp(mnemonic, "div") == 0;
+    if (count == 2 && (is_move || is_lea || is_compare || is_arith || is_cmov)) {
+        char *source = operands[0];
+        char *destination = operands[1];
+        node->reads |= operandRegisters(source);
+        if (isMemoryOperand(source) && !is_lea) {
+            strcpy(node->memory, source);
+            node->loads = 1;
+        }
+        if (isMemoryOperand(destination)) {
+            if (node->loads) {
+                return 0;
+            }
+            strcpy(node->memory, destination);
+            node->reads |= operandRegisters(destination);
+            node->loads = !is_move;
+            node->stores = !is_compare;
+        } else if (is_move || is_lea) {
+            node->writes |= operandRegisters(destination);
+        } else {
+            node->reads |= operandRegisters(destination);
+            node->writes |= is_compare ? 0 : operandRegisters(destination);
+        }
+        node->reads |= is_cmov ? SCHED_FLAGS : 0;
+        node->writes |= is_compare || is_arith ? SCHED_FLAGS : 0;
+        if (strcmp(mnemonic, "imul") == 0) {
+            node->latency = 3;
+            node->unit = SCHED_MUL;
+        }
+    } else if (count == 1 && (is_unary || is_set)) {
+        if (isMemoryOperand(operands[0])) {
+            strcpy(node->memory, operands[0]);
+            node->loads = !is_set;
+            node->stores = 1;
+        } else {
+            node->writes |= operandRegisters(operands[0]);
+        }
+        //a byte set keeps the rest of the register, so it reads it too
+        node->reads |= operandRegisters(operands[0]) | (is_set ? SCHED_FLAGS : 0);
+        node->writes |= is_unary && strcmp(mnemonic, "not") != 0 ? SCHED_FLAGS : 0;
+    } else if (count == 1 && is_div && !isMemoryOperand(operands[0])) {
+        node->reads |= operandRegisters(operands[0]) | registerBit("%rax") | registerBit("%rdx");
+        node->writes |= registerBit("%rax") | registerBit("%rdx") | SCHED_FLAGS;
+        node->latency = 40;
+        node->unit = SCHED_DIV;
+    } else {
+        return 0;
+    }
+    if (node->loads) {
+        node->latency += 4;
+        node->unit = node->unit == SCHED_ALU ? SCHED_LOAD : node->unit;
+    }
+    return 1;
+}
+
+/* splits a frame slot, outgoing argument or global operand into what it is relative to and a byte
+   offset; returns 0 for memory addressed through any other register */
+int memoryPlace(char *operand, char *base, long *offset) {
+    while (*operand == ' ') {
+        operand++;
+    }
+    char *open = strchr(operand, '(');
+    if (open != 0) {
+        char *end;
+        *offset = strtol(operand, &end, 10);
+        if (end != open || strchr(open, ',') != 0
+                || (strcmp(open, "(%rbp)") != 0 && strcmp(open, "(%rsp)") != 0)) {
+            return 0;
+        }
+        strcpy(base, open);
+        return 1;
+    }
+    size_t length = strcspn(operand, "+-");
+    memcpy(base, operand, length);
+    base[length] = 0;
+    *offset = operand[length] != 0 ? strtol(operand + length, 0, 10) : 0;
+    return 1;
+}
+
+/* nonzero if the two memory operands may be the same location and one of them writes it */
+int memoryConflict(struct sched_node *a, struct sched_node *b) {
+    if (a->memory[0] == 0 || b->memory[0] == 0 || !(a->stores || b->stores)) {
+        return 0;
+    }
+    if (strcmp(a->memory, b->memory) == 0) {
+        return 1;
+    }
+    //frame slots, the outgoing argument area and globals overlap only where their bytes do, since
+    //byte fields share slots with words; anything addressed through another register may point anywhere
+    char a_base[64];
+    char b_base[64];
+    long a_offset;
+    long b_offset;
+    if (!memoryPlace(a->memory, a_base, &a_offset) || !memoryPlace(b->memory, b_base, &b_offset)) {
+        return 1;
+    }
+    return strcmp(a_base, b_base) == 0 && a_offset < b_offset + b->width && b_offset < a_offset + a->width;
+}
+
+/* latency from a to b if b has to wait for a, -1 if they are independent */
+int dependence(struct sched_node *a, struct sched_node *b) {
+    if (a->writes & b->reads) {
+        return a->latency;
+    }
+    if (memoryConflict(a, b)) {
+        return a->stores && b->loads ? 4 : 0;
+    }
+    if ((a->reads & b->writes) || (a->writes & b->writes)) {
+        return 0;
+    }
+    return -1;
+}
+
+/* list-schedules one region of movable nodes, the last one pinned at the end when it feeds a branch;
+   returns nonzero if the order changed */
+int scheduleRegion(char **lines, struct sched_node *nodes, int count, int pin_last) {
+    static int edges[MAX_SCHED_REGION][MAX_SCHED_REGION];
+    for (int i = 0; i < count; i++) {
+        for (int j = 0; j < count; j++) {
+            edges[i][j] = j > i ? dependence(&nodes[i], &nodes[j]) : -1;
+            if (pin_last && j == count - 1 && i < j && edges[i][j] < 0) {
+                edges[i][j] = 0;
+            }
+        }
+    }
+    //priority: the longest chain of latencies from the node to the end of the region
+    for (int i = count - 1; i >= 0; i--) {
+        nodes[i].priority = nodes[i].latency;
+        nodes[i].waiting = 0;
+        nodes[i].ready = 0;
+        nodes[i].scheduled = 0;
+        for (int j = i + 1; j < count; j++) {
+            if (edges[i][j] >= 0 && edges[i][j] + nodes[j].priority > nodes[i].priority) {
+                nodes[i].priority = edges[i][j] + nodes[j].priority;
+            }
+        }
+        for (int j = 0; j < i; j++) {
+            nodes[i].waiting += edges[j][i] >= 0;
+        }
+    }
+    //each cycle issues up to four nodes, at most two loads, one multiply and one divide
+    int order[MAX_SCHED_REGION];
+    int placed = 0;
+    for (int cycle = 0; placed < count; cycle++) {
+        int capacity[4] = {4, 2, 1, 1};
+        int issued = 0;
+        while (issued < 4) {
+            int best = -1;
+            for (int i = 0; i < count; i++) {
+                if (!nodes[i].scheduled && nodes[i].waiting == 0 && nodes[i].ready <= cycle
+                        && capacity[nodes[i].unit] > 0 && (best == -1 || nodes[i].priority > nodes[best].priority)) {
+                    best = i;
+                }
+            }
+            if (best == -1) {
+                break;
+            }
+            nodes[best].scheduled = 1;
+            capacity[nodes[best].unit]--;
+            issued++;
+            order[placed++] = best;
+            for (int j = best + 1; j < count; j++) {
+                if (edges[best][j] >= 0) {
+                    nodes[j].waiting--;
+                    if (cycle + edges[best][j] > nodes[j].ready) {
+                        nodes[j].ready = cycle + edges[best][j];
+                    }
+                }
+            }
+        }
+    }
+    int changed = 0;
+    for (int i = 0; i < count; i++) {
+        changed |= order[i] != i;
+    }
+    if (!changed) {
+        return 0;
+    }
+    int first = nodes[0].first;
+    int total = nodes[count - 1].last + 1 - first;
+    char **copy = malloc(total * sizeof(char*));
+    int k = 0;
+    for (int i = 0; i < count; i++) {
+        for (int line = nodes[order[i]].first; line <= nodes[order[i]].last; line++) {
+            copy[k++] = lines[line];
+        }
+    }
+    //deleted lines between the nodes end up at the end of the region
+    while (k < total) {
+        copy[k++] = 0;
+    }
+    memcpy(lines + first, copy, total * sizeof(char*));
+    free(copy);
+    return 1;
+}
+
+/* reorders the instructions between branches, labels and calls by their latencies, so independent
+   loads and arithmetic overlap; a flags producer stays glued to the instructions using the flags */
+int schedulePass(char **lines, int count) {
+    int changes = 0;
+    struct sched_node nodes[MAX_SCHED_REGION];
+    int region = 0;
+    for (int i = 0; i <= count; i++) {
+        if (i < count && lines[i] == 0) {
+            continue;
+        }
+        struct sched_node node;
+        int movable = i < count && describeInstruction(lines[i], &node);
+        if (movable && region > 0 && (nodes[region - 1].writes & SCHED_FLAGS) && (node.reads & SCHED_FLAGS)
+                && !(node.writes & SCHED_FLAGS) && !(nodes[region - 1].memory[0] != 0 && node.memory[0] != 0)) {
+            //a flags consumer right after its producer joins the producer's node
+            struct sched_node *producer = &nodes[region - 1];
+            producer->last = i;
+            producer->reads |= node.reads & ~SCHED_FLAGS;
+            producer->writes |= node.writes;
+            producer->latency += node.latency;
+            producer->unit = node.unit != SCHED_ALU ? node.unit : producer->unit;
+            if (node.memory[0] != 0) {
+                strcpy(producer->memory, node.memory);
+                producer->loads |= node.loads;
+                producer->stores |= node.stores;
+            }
+            continue;
+        }
+        if (movable && region < MAX_SCHED_REGION) {
+            node.first = i;
+            node.last = i;
+            nodes[region++] = node;
+            continue;
+        }
+        if (region > 1) {
+            //a compare ending the region before a conditional jump stays next to it for macro-fusion
+            char mnemonic[16];
+            char operands[3][64];
+            int pin = i < count && parseInstruction(lines[i], mnemonic, operands) == 1 && mnemonic[0] == 'j'
+                && (nodes[region - 1].writes & SCHED_FLAGS);
+            changes += scheduleRegion(lines, nodes, region, pin);
+        }
+        region = 0;
+        if (movable) {
+            node.first = i;
+            node.last = i;
+            nodes[region++] = node;
+        }
+    }
+    return changes;
+}
+
+static struct pass passes[] = {
+    {"jumps", 1, jumpsPass, 0, 0, 0},
+    {"labels", 2, labelsPass, 0, 0, 0},
+    {"peephole", 1, peepholePass, 0, 0, 0},
+    {"forward", 2, forwardPass, 0, 0, 0},
+    {"schedule", 2, schedulePass, 0, 0, 0}
+};
+#define PASS_COUNT (int) (sizeof(passes) / sizeof(passes[0]))
+
+struct pass *findPass(char *name) {
+    for (int i = 0; i < PASS_COUNT; i++) {
+        if (strcmp(passes[i].name, name) == 0) {
+            return &passes[i];
+        }
+    }
+    return 0;
+}
+
+int isPassEnabled(struct pass *pass) {
+    return !pass->disabled && pass->level <= opt_level;
+}
+
+/* runs the enabled passes over a function body and returns the body to print instead, which is
+   the same buffer when no pass runs */
+char *optimizeFunction(char *body, char *name) {
+    int any = 0;
+    for (int i = 0; i < PASS_COUNT; i++) {
+        any |= isPassEnabled(&passes[i]);
+    }
+    if (!any) {
+        return body;
+    }
+    int count = 0;
+    char **lines = 0;
+    for (char *line = strtok(body, "\n"); line != 0; line = strtok(0, "\n")) {
+        lines = realloc(lines, (count + 1) * sizeof(char*));
+        lines[count++] = strdup(line);
+    }
+    for (int i = 0; i < PASS_COUNT; i++) {
+        struct pass *pass = &passes[i];
+        if (!isPassEnabled(pass)) {
+            continue;
+        }
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        pass->changes += pass->run(lines, count);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        pass->seconds += (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        if (print_after != 0 && strcmp(print_after, pass->name) == 0) {
+            fprintf(stderr, "*** after %s: %s ***\n", pass->name, name);
+            for (int k = 0; k < count; k++) {
+                if (lines[k] != 0) {
+                    fprintf(stderr, "%s\n", lines[k]);
+                }
+            }
+        }
+    }
+    size_t size = 1;
+    for (int k = 0; k < count; k++) {
+        size += lines[k] != 0 ? strlen(lines[k]) + 1 : 0;
+    }
+    char *optimized = malloc(size);
+    char *end = optimized;
+    for (int k = 0; k < count; k++) {
+        if (lines[k] != 0) {
+            end += sprintf(end, "%s\n", lines[k]);
+            free(lines[k]);
+        }
+    }
+    *end = 0;
+    free(lines);
+    free(body);
+    return optimized;
+}
+
+void printPassStats(void) {
+    fprintf(stderr, "%-10s %8s %10s\n", "pass", "changes", "time(ms)");
+    for (int i = 0; i < PASS_COUNT; i++) {
+        if (isPassEnabled(&passes[i])) {
+            fprintf(stderr, "%-10s %8d %10.3f\n", passes[i].name, passes[i].changes, 1000 * passes[i].seconds);
+        }
+    }
+}
+
+/* prints a leaf function body with its frame addressed from %rsp in the red zone instead of from %rbp */
+void printLeafBody(char *body) {
+    char *rest = body;
+    char *operand;
+    while ((operand = strstr(rest, "(%rbp)")) != 0) {
+        char *start = operand;
+        while (start > rest && (isdigit(start[-1]) || start[-1] == '-')) {
+            start--;
+        }
+        int offset = atoi(start);
+        //without the push of %rbp the return address sits right at (%rsp)
+        printf("%.*s%d(%%rsp)", (int) (start - rest), rest, offset > 0 ? offset - 8 : offset);
+        rest = operand + strlen("(%rbp)");
+    }
+    printf("%s", rest);
+}
+
+void function(void) {
+    if (!isFun()) {
+        error(GENERAL, "Expected fun\n");
+    }
+    function_token = current_token;
+    consume();
+    if (!isId()) {
+        error(GENERAL, "Invalid function name\n");
+    }
+    char *id = getId();
+    if (current_clone == 0) {
+        functionNames = realloc(functionNames,(numFunctions + 1) * sizeof(char*));
+        functionNames[numFunctions] = strdup(id);
+        numFunctions++;
+    } else {
+        id = current_clone->name;
+    }
+    consume();
+    function_name = id;
+    //with a profile, the linker groups hot functions together and moves those that never ran away
+    uint64_t entries = profileCount(profileKey(function_token, 0));
+    int hot = isHotCount(entries);
+    int cold = isColdFunction();
+    if (hot) {
+        printf("    .section .text.hot,\"ax\",@progbits\n");
+        printf("    .p2align 4\n");
+    } else if (cold) {
+        printf("    .section .text.unlikely,\"ax\",@progbits\n");
+    }
+    printf("%s_fun:\n", id);
+    //the body goes to a buffer first, the frame size is only known once it has been generated
+    FILE *out = stdout;
+    char *body = 0;
+    size_t body_size = 0;
+    stdout = open_memstream(&body, &body_size);
+    frame_slots = 0;
+    frame_pushes = 0;
+    makes_calls = 0;
+    touched_regs = 0;
+    live_regs = 0;
+    if (!isLeft()) {
+        error(GENERAL, "Expected function parameter declaration\n");
+    }
+    consume();
+    beginVarScope();
+    int param_count = 0;
+    int passed = 0;
+    while (!isRight()) {
+        if(!isType()) {
+            error(GENERAL, "expected type declaration\n");
+        }
+        char* typeName = current_token->value.id;
+        int whichType = findVarType(typeName);
+        consume();
+        int stride = pointerDeclaration(whichType);
+        whichType = stride != 0 && whichType < standardTypeCount ? 2 : whichType;
+        if (!isId()) {
+            error(GENERAL, "Invalid parameter name\n");
+        }
+        char *param_id = getId();
+        consume();
+        if (isBoundArgument(current_clone, param_count)) {
+            //a bound funp is not passed, boundFunction resolves it
+        } else if (passed < 6) {
+            //register parameters are spilled into the frame like locals
+            setVarNum(param_id, namespace_head->next_var_num, whichType)->pointer_stride = stride;
+            printf("    mov %s,%d(%%rbp)\n", argRegisters[passed], 8 * namespace_head->next_var_num);
+            namespace_head->next_var_num--;
+            passed++;
+        } else {
+            //the seventh parameter onwards is passed on the stack, starting at 16(%rbp)
+            setVarNum(param_id, passed - 4, whichType)->pointer_stride = stride;
+            passed++;
+        }
+        param_count++;
+        if (isComma()) {
+            consume();
+        }
+    }
+    consume();
+    profileCounter(profileKey(function_token, 0));
+    statement(1);
+    endVarScope();
+    printf("%s_end:\n", function_name);
+    fclose(stdout);
+    stdout = out;
+    body = optimizeFunction(body, function_name);
+
+    //callee-saved accumulators the body wrote are kept in slots below the locals
+    char *saved[4];
+    int saved_count = 0;
+    for (int i = 0; i < 4; i++) {
+        if (touched_regs & (1 << i)) {
+            saved[saved_count++] = registerNames[i];
+        }
+    }
+    int slots = frame_slots + saved_count;
+    //a leaf function can keep its whole frame in the 128 bytes below %rsp
+    int leaf = !makes_calls && !frame_pushes && slots <= 16;
+    char *base = leaf ? "%rsp" : "%rbp";
+    if (!leaf) {
+        printf("    push %%rbp\n");
+        printf("    mov %%rsp,%%rbp\n");
+        if (slots > 0) {
+            printf("    sub $%d,%%rsp\n", 8 * (slots + slots % 2));
+        }
+    }
+    for (int i = 0; i < saved_count; i++) {
+        printf("    mov %s,%d(%s)\n", saved[i], -8 * (frame_slots + i + 1), base);
+    }
+    if (leaf) {
+        printLeafBody(body);
+    } else {
+        printf("%s", body);
+    }
+    free(body);
+    for (int i = 0; i < saved_count; i++) {
+        printf("    mov %d(%s),%s\n", -8 * (frame_slots + i + 1), base, saved[i]);
+    }
+    if (!leaf) {
+        printf("    leave\n");
+    }
+    printf("    ret\n");
+    if (hot || cold) {
+        printf("    .text\n");
+    }
+    function_token = 0;
+}
+
+/* fills in the fields of a struct at offset from %r8: words hold 333 and bytes 0, inline structs are filled in
+   place, and struct pointers get a struct of their own */
+void fillStruct(struct struct_data *layout, int offset) {
+    for (int i = 0; i < layout->type_count; i++) {
+        struct struct_var *field = &layout->data[i];
+        if (field->is_inline) {
+            fillStruct(findStructLayout(field->type), offset + field->offset);
+        } else if (field->type >= standardTypeCount) {
+            printf("    call %s_struct\n", definedTypes[field->type]);
+            printf("    movq %%rax, %d(%%r8)\n", offset + field->offset);
+        } else if (field->is_byte) {
+            printf("    movb $0, %d(%%r8)\n", offset + field->offset);
+        } else {
+            printf("    movq $333, %d(%%r8)\n", offset + field->offset);
+        }
+    }
+}
+
+/* a struct is laid out when it is defined: struct fields are stored inline, while struct pointers
+   take a word pointing to a struct of their own. One allocation then holds the struct and every
+   struct inside it. A char or boolean takes a byte, packed with the ones next to it; words and
+   inline structs start at a multiple of 8 bytes, and the struct is padded to whole words. */
+void structDef(void) {
+    if (!isStruct()) {
+        error(GENERAL, "Not a struct\n");
+    }
+    consume();
+    if (!isId()) {
+        error(GENERAL, "Expected struct name\n");
+    }
+    char* structName = getId();
+    struct_info = realloc(struct_info, sizeof(struct struct_data) * (struct_count + 1));
+    struct struct_data *layout = &struct_info[struct_count];
+    layout->id = getTypeId(structName);
+    layout->data = malloc(sizeof(struct struct_var));
+    layout->type_count = 0;
+    layout->words = 0;
+    layout->flat = 1;
+    consume();
+    if (!isLeftBlock()) {
+        error(GENERAL, "Expected struct definition\n");
+    }
+    consume();
+
+    int selfDefined = 0;
+    int bytes = 0;
+    while(isType()){
+        char* type_name = current_token->value.id;
+        int isStructField = isStructType();
+        if(isStructField) {
+            if(strcmp(structName, type_name) == 0){
+                selfDefined = 1;
+            }
+        }
+        consume();
+        //check if pointer
+        int isPointer = 0;
+        while(isMul()){
+            selfDefined = 0;
+            isPointer = 1;
+            consume();
+        }
+        if(selfDefined){
+            error(GENERAL, "Recursive struct definitions disallowed\n");
+        }
+        if(!isId()){
+            error(GENERAL, "expected identifier after type in struct definition\n");
+        }
+        char* var_name = current_token->value.id;
+        layout->type_count++;
+        int _type_count = layout->type_count;
+        layout->data = realloc(layout->data, sizeof(struct struct_var) * (_type_count));
+        struct struct_var *field = &layout->data[_type_count - 1];
+        field->type = getTypeId(type_name);
+        field->name = var_name; 
+        struct struct_data *inner = isStructField && !isPointer ? findStructLayout(field->type) : 0;
+        field->is_inline = inner != 0;
+        field->is_byte = !isPointer && (field->type == 0 || field->type == 1);
+        if (!field->is_byte) {
+            bytes = (bytes + 7) & ~7;
+        }
+        field->offset = bytes;
+        if (inner != 0) {
+            bytes += 8 * inner->words;
+            layout->flat = layout->flat && inner->flat;
+        } else {
+            bytes += field->is_byte ? 1 : 8;
+            layout->flat = layout->flat && !isStructField;
+        }
+        layout->words = (bytes + 7) / 8;
+        consume();
+        if (isSemi()) {
+            consume();
+        }
+    }
+    printf("%s_struct:\n", structName);
+    printf("    push %%r8\n");
+    printf("    movq $%d, %%rdi\n", layout->words == 0 ? 8 : 8 * layout->words);
+    printf("    call arena_alloc\n");
+    printf("    movq %%rax, %%r8\n");
+    fillStruct(layout, 0);
+    printf("    movq %%r8, %%rax\n");
+    printf("    pop %%r8\n");
+    printf("    ret\n");
+    if (!isRightBlock()) {
+        error(BRACKET_MISMATCH, "Unexpected token found before struct closed\n");
+    }
+    struct_count++;
+    consume();
+
+}
+
+/* nonzero if the token after the current '=' is a literal that makes up the whole initializer */
+int isLiteralInitializer(void) {
+    struct token *literal = current_token->next;
+    if (literal->type != INTEGER && literal->type != CHAR && literal->type != TRUE && literal->type != FALSE) {
+        return 0;
+    }
+    enum token_type next = literal->next->type;
+    return next == SEMI || next == FUN_KWD || next == TYPE_KWD || next == STRUCT_KWD || next == DEFINE_KWD
+        || next == CONST_KWD || next == END;
+}
+
+/* nonzero if a variable with the given name is assigned or has its address taken anywhere in the
+   program; locals with the same name count too, which only makes this more conservative */
+int isAssigned(char *id) {
+    for (struct token *tkn = first_token; tkn->type != END; tkn = tkn->next) {
+        if (tkn->type != ID || strcmp(tkn->value.id, id) != 0) {
+            continue;
+        }
+        int declared = tkn->prev != 0 && tkn->prev->type == TYPE_KWD;
+        if ((tkn->next->type == EQ && !declared) || (tkn->prev != 0 && tkn->prev->type == REFERENCE)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void globalVarDef(void) {
+    int is_const = isConst();
+    if (is_const) {
+        consume();
+    }
+    if (!isType()) {
+        error(GENERAL, "Expected global variable type declaration\n");
+    }
+    char* typeName = current_token->value.id;
+    int whichType = findVarType(typeName);
+    int isStruct = isStructType();
+    consume();
+    if (!isId()) {
+        error(GENERAL, "Expected valid identifier\n");
+    }
+    char *id = getId();
+    struct token *id_token = current_token;
+    consume();
+    if (isLeftBracket() && isTable()) {
+        //assembled by printTables, so there is nothing to initialize
+        struct table_data *table = tableInitializer(id_token, whichType, is_const);
+        setVarNum(id, 1, 2)->table = table;
+        setArrayDims(id, table->dims, table->dim_count, 0, 0, 8 * table->bytes);
+        if (isSemi()) {
+            consume();
+        }
+        return;
+    } else if (is_const) {
+        error(GENERAL, "const applies to arrays with an initializer");
+    }
+    setVarNum(id, 1, whichType);
+    if (isEq() && isLiteralInitializer()) {
+        //assembled straight into .data, or .rodata and folded into every use if nothing writes it
+        consume();
+        struct trie_node *node_ptr = findGlobal(id);
+        node_ptr->init_value = isInt() ? getInt() : isChar() ? getChar() : isTrue();
+        node_ptr->is_constant = !isAssigned(id);
+        consume();
+        if (isSemi()) {
+            consume();
+        }
+        return;
+    }
+    if (!isEq() && isStruct && isFlatStruct(whichType)) {
+        //laid out in .data by initVars, with the global pointing at it
+        findGlobal(id)->init_struct = whichType;
+        if (isSemi()) {
+            consume();
+        }
+        return;
+    }
+    FILE *out = stdout;
+    if (global_init == 0) {
+        global_init = open_memstream(&global_init_code, &global_init_size);
+    }
+    stdout = global_init;
+    if (isEq()) {
+        consume();
+        expression(1);
+        set(id);
+    } else if (isStruct) {
+        printf("    call %s_struct\n", typeName);
+        set(id);
+    }
+    stdout = out;
+    if (isSemi()) {
+        consume();
+    }
+}
+
+struct token *copyToken(struct token *curr_token) {
+    struct token *copy = malloc(sizeof(struct token));
+    if(curr_token->type == ID || curr_token->type == TYPE_KWD || curr_token->type == STRING) {
+        copy->value.id = malloc(strlen(curr_token->value.id) + 1);
+        strcpy(copy->value.id, curr_token->value.id);
+    } else if(curr_token->type == INTEGER) {
+        copy->value.integer = curr_token->value.integer;
+    } else if(curr_token->type == CHAR) {
+        copy->value.character = curr_token->value.character;
+    }
+    copy->type = curr_token->type;
+    copy->line_num = curr_token->line_num;
+    copy->index = curr_token->index;
+    return copy;
+}
+
+void definePass(void) {
+    current_token = first_token;
+    struct user_operator *current_op = NULL;
+    while(current_token->type != END) { //look through whole list of tokens
+        //handle define statements
+        if(current_token->type == DEFINE_KWD) {
+            //move to next token
+            current_token = current_token->next;
+            
+            //next token should be a user operator
+            if(current_token->type != USER_OP) {
+                error(GENERAL, "invalid define statement");
+            }
+            //check if the user operator is a valid symbol
+            if(!isupper(current_token->value.user_op)) {
+                error(GENERAL, "invalid user operator symbol");
+            }
+            
+            //create new user operator
+            struct user_operator *operator = calloc(1, sizeof(struct user_operator));
+            operator->symbol = current_token->value.user_op;
+            operator->var1 = NULL;
+            operator->var2 = NULL;
+            //add to list of user operators
+            if(user_ops == NULL) { //no first link in linked list
+                user_ops = operator;
+                current_op = operator;
+            } else { //add links appropriately
+                current_op->next = operator;
+                current_op = operator;
+            }
+            operator->next = NULL;
+            
+            //get type of first variable
+            current_token = current_token->next;
+            if(current_token->type != TYPE_KWD) {
+                error(GENERAL, "no type specified for first variable in define statement");
+            } else {
+                operator->type1 = getTypeId(current_token->value.id);
+            }
+
+            //get type of second variable
+            current_token = current_token->next; 
+            if(current_token->type != TYPE_KWD) {
+                error(GENERAL, "no type specified for first variable in define statement");
+            } else {
+                operator->type2 = getTypeId(current_token->value.id);
+            }
+
+            //get expression
+            current_token = current_token->next;
+            //store previous node while forming linked list
+            struct token *curr_copy = NULL;
+            while(current_token->type != SEMI) { //expression ends with semicolon
+                //copy token
+                struct token *copy = copyToken(current_token);
+                //copy next and previous nodes
+                if(curr_copy == NULL) { //first iteration of while loop
+                    operator->expression = copy;
+                    curr_copy = copy;
+                    copy->next = NULL;
+                    copy->prev = NULL;
+                } else {
+                    copy->prev = curr_copy;
+                    curr_copy->next = copy;
+                    curr_copy = copy;
+                    copy->next = NULL;
+                }
+                //check if token is a variable and store variable names; function names and
+                //struct fields are not variables
+                if(current_token->type == ID && current_token->next->type != LEFT && current_token->prev->type != DOT) {
+                    if(operator->var1 == NULL) {
+                        operator->var1 = (char*)(malloc(strlen(current_token->value.id) + 1));
+                        strcpy(operator->var1, current_token->value.id);
+                    } else if(strcmp(operator->var1, current_token->value.id) == 0) {
+                    } else if(operator->var2 == NULL) {
+                        operator->var2 = (char*)(malloc(strlen(current_token->value.id) + 1));
+                        strcpy(operator->var2, current_token->value.id);
+                    } else if(strcmp(operator->var2, current_token->value.id) != 0) {
+                        //expression can only handle two variables right now
+                        error(GENERAL, "too many variables in this expression");
+                    }
+                }
+                //move to next token
+                current_token = current_token->next;
+            }
+            //keep the semicolon so compiling the expression stops there
+            if(curr_copy == NULL) {
+                error(GENERAL, "missing expression in define statement");
+            }
+            struct token *semi = copyToken(current_token);
+            semi->prev = curr_copy;
+            semi->next = NULL;
+            curr_copy->next = semi;
+        } //end if define
+        //check next token unless we've hit the end
+        if(current_token->type != END) {
+            current_token = current_token->next;
+        }
+    } //end while
+    //reset to first token before exiting method
+    current_token = first_token;
+}
+
+/* The C backend (--emit=c) translates the program into portable C for gcc or clang to optimize. Every
+   value is a uint64_t, variables are <id>_var and functions <id>_fun as in the assembly, and the
+   operands of an operator are evaluated left to right, as the assembly evaluates them. */
+
+static int emit_c = 0;
+//parts of the translation printed apart from the function bodies: declarations, global
+//initializers and user operators
+static FILE *c_decls = 0;
+static FILE *c_init = 0;
+static FILE *c_operators = 0;
+//statics holding the locals of a function that opens a window, and the window's callbacks
+static FILE *c_hoist = 0;
+static FILE *c_callbacks = 0;
+//the C function being translated: its indentation, the temporaries it needs to keep the order of
+//evaluation, whether its locals are hoisted into statics and whether it is a window callback
+static int c_indent = 0;
+static int c_temps = 0;
+static int c_init_temps = 0;
+static int c_hoisted = 0;
+static int c_callback = 0;
+//the scope of the function body, which shares its C block with the parameters
+static struct var_namespace *c_body_scope = 0;
+//calls translated so far, to tell whether an operand has side effects
+static int c_calls = 0;
+//switches entered since the innermost loop, and whether that loop's break and continue need labels
+static int c_loop_switches = 0;
+static int c_loop_break = 0;
+static int c_loop_continue = 0;
+static int c_arenas = 0;
+//the size in words of the inline struct the last fields translated by cFields end in, 0 if they do not
+static int c_field_words = 0;
+//the address and index of the packed boolean cElement translated last, 0 for other elements
+static char *c_bit_element = 0;
+
+int cStatement(void);
+char *cE6(void);
+char *cPrimary(void);
+
+/* returns a newly allocated string formatted like printf */
+char *cFormat(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(0, 0, format, args);
+    va_end(args);
+    char *text = malloc(length + 1);
+    va_start(args, format);
+    vsnprintf(text, length + 1, format, args);
+    va_end(args);
+    return text;
+}
+
+void cIndent(void) {
+    printf("%*s", 4 * c_indent, "");
+}
+
+char *cLiteral(uint64_t value) {
+    return cFormat("UINT64_C(%" PRIu64 ")", value);
+}
+
+int cIsLiteral(char *operand) {
+    return strncmp(operand, "UINT64_C(", 9) == 0 && strchr(operand, ')')[1] == 0;
+}
+
+char *cTemporary(void) {
+    return cFormat("tmp_%d", c_temps++);
+}
+
+void cDeclareTemporaries(void) {
+    for (int i = 0; i < c_temps; i++) {
+        printf(i == 0 ? "    uint64_t tmp_%d" : ", tmp_%d", i);
+    }
+    if (c_temps > 0) {
+        printf(";\n");
+    }
+}
+
+/* returns the trie node of a variable declared in the given scope, or 0 */
+struct trie_node *findInScope(struct var_namespace *scope, char *id) {
+    struct trie_node *node_ptr = scope->root_ptr;
+    for (char* ch_ptr = id; *ch_ptr != 0 && node_ptr != 0; ch_ptr++) {
+        int child_num;
+        if (isdigit(*ch_ptr)) {
+            child_num = *ch_ptr - '0';
+        } else {
+            child_num = *ch_ptr - 'a' + 10;
+        }
+        node_ptr = node_ptr->children[child_num];
+    }
+    return node_ptr != 0 && node_ptr->var_num != 0 ? node_ptr : 0;
+}
+
+/* returns the C name of a variable; the locals of a function that opens a window are statics named
+   after the function and their slot, so that the window callbacks can reach them */
+char *cVariable(char *id) {
+    struct trie_node *node_ptr = findVar(id);
+    if (node_ptr == 0) {
+        error_missingVariable(id);
+        return cLiteral(0);
+    }
+    if (node_ptr->table != 0) {
+        return cFormat("((uint64_t) (uintptr_t) %s_table_%d)", node_ptr->table->id, node_ptr->table->index);
+    }
+    if (node_ptr->var_num == 1 || !c_hoisted) {
+        return cFormat("%s_var", id);
+    }
+    return cFormat("%s_%s_%d", function_name, id, -node_ptr->var_num);
+}
+
+/* declares a local and returns what goes before its '='. C does not allow a name twice in one
+   block, so a local declared again in the same scope (or over a parameter) is assigned instead */
+char *cDeclare(char *id, int type) {
+    int redeclared = findInScope(namespace_head, id) != 0
+        || (namespace_head == c_body_scope && findInScope(namespace_head->next, id) != 0);
+    setVarNum(id, namespace_head->next_var_num, type);
+    namespace_head->next_var_num--;
+    char *name = cVariable(id);
+    if (c_hoisted) {
+        fprintf(c_hoist, "static uint64_t %s;\n", name);
+        return name;
+    }
+    if (redeclared) {
+        return name;
+    }
+    char *declaration = cFormat("uint64_t %s", name);
+    free(name);
+    return declaration;
+}
+
+/* combines two operands with a format taking the left and the right one. When the right one makes
+   calls, the left one goes to a temporary first: C leaves the order of evaluation open */
+char *cCombine(char *format, char *left, char *right, int right_calls) {
+    char *combined;
+    if (!right_calls || cIsLiteral(left)) {
+        combined = cFormat(format, left, right);
+    } else {
+        char *temp = cTemporary();
+        char *operation = cFormat(format, temp, right);
+        combined = cFormat("(%s = %s, %s)", temp, left, operation);
+        free(operation);
+        free(temp);
+    }
+    free(left);
+    free(right);
+    return combined;
+}
+
+/* parses an operand with the dry run of the assembly backend, so the choices it makes depend on
+   the same analysis; returns whether the operand is a 0/1 value and sets *cheap as isCheapOperand */
+int cOperandIsBool(struct token *start, int type, void (*level)(int), int *cheap) {
+    struct token *resume_token = current_token;
+    int resume_type = variableType;
+    current_token = start;
+    variableType = type;
+    int is_cheap = isCheapOperand(level);
+    current_token = resume_token;
+    variableType = resume_type;
+    if (cheap != 0) {
+        *cheap = is_cheap;
+    }
+    return operand_is_bool;
+}
+
+/* translates the arguments of a call up to and including the ')'. Arguments before one that makes
+   calls go to temporaries, so they are evaluated first as in the assembly; the stores are returned
+   in *prefix and the number of arguments in *count. With wanted >= 0 the list is fitted to that
+   many parameters: extra arguments are still evaluated, missing ones are 0 */
+char *cArguments(char **prefix, int *count, int wanted) {
+    char **args = 0;
+    int last_effect = 0;
+    int n = 0;
+    while (!isRight() && !isEnd()) {
+        args = realloc(args, (n + 1) * sizeof(char*));
+        int calls = c_calls;
+        checkArrayArgument();
+        args[n] = cE6();
+        if (c_calls != calls || (wanted >= 0 && n >= wanted && !cIsLiteral(args[n]))) {
+            last_effect = n;
+        }
+        n++;
+        if (isComma()) {
+            consume();
+        }
+    }
+    if (!isRight()) {
+        error(PAREN_MISMATCH, "unclosed argument list");
+    }
+    consume();
+    *prefix = strdup("");
+    char *list = strdup("");
+    for (int i = 0; i < n; i++) {
+        char *arg = args[i];
+        if (wanted >= 0 && i >= wanted) {
+            if (!cIsLiteral(arg)) {
+                char *stores = cFormat("%s(void) %s, ", *prefix, arg);
+                free(*prefix);
+                *prefix = stores;
+            }
+            free(arg);
+            continue;
+        }
+        if (i < last_effect && !cIsLiteral(arg)) {
+            char *temp = cTemporary();
+            char *stores = cFormat("%s%s = %s, ", *prefix, temp, arg);
+            free(*prefix);
+            free(arg);
+            *prefix = stores;
+            arg = temp;
+        }
+        char *longer = cFormat("%s%s%s", list, i == 0 ? "" : ", ", arg);
+        free(list);
+        free(arg);
+        list = longer;
+    }
+    for (int i = n; i < wanted; i++) {
+        char *longer = cFormat("%s%sUINT64_C(0)", list, i == 0 ? "" : ", ");
+        free(list);
+        list = longer;
+    }
+    free(args);
+    *count = n;
+    return list;
+}
+
+/* returns the C parameter list of a function taking the given number of words */
+char *cParameterTypes(int count) {
+    char *types = strdup(count == 0 ? "void" : "uint64_t");
+    for (int i = 1; i < count; i++) {
+        char *longer = cFormat("%s, uint64_t", types);
+        free(types);
+        types = longer;
+    }
+    return types;
+}
+
+/* translates a call to id once its '(' has been consumed: a funp variable is called through a
+   pointer, a graphics builtin straight in graphicfuncs.c, anything else is a function */
+char *cCall(char *id) {
+    char *prefix;
+    int count;
+    struct fun_signature *signature = findVar(id) == 0 && builtinSymbol(id) == 0 ? findSignature(id) : 0;
+    char *args = cArguments(&prefix, &count, signature != 0 ? signature->param_count : -1);
+    char *call;
+    if (findVar(id) != 0) {
+        char *params = cParameterTypes(count);
+        char *pointer = cVariable(id);
+        call = cFormat("((uint64_t (*)(%s)) (uintptr_t) %s)(%s)", params, pointer, args);
+        free(pointer);
+        free(params);
+    } else if (builtinReturns(id)) {
+        call = cFormat("%s(%s)", builtinSymbol(id), args);
+    } else if (builtinSymbol(id) != 0) {
+        //the other builtins return nothing, the assembly leaves whatever was in %rax
+        call = cFormat("(%s(%s), UINT64_C(0))", builtinSymbol(id), args);
+    } else {
+        call = cFormat("%s_fun(%s)", id, args);
+    }
+    c_calls++;
+    if (*prefix != 0) {
+        char *sequenced = cFormat("(%s%s)", prefix, call);
+        free(call);
+        call = sequenced;
+    }
+    free(prefix);
+    free(args);
+    return call;
+}
+
+/* translates the fields after the address of a struct of the given type, as loadFields reads them;
+   a field that is a struct stored inline is its address, and c_field_words is set to its size in
+   words */
+char *cFieldChain(char *value, int type) {
+    int offset = 0;
+    struct struct_var *field = 0;
+    c_field_words = 0;
+    while (isDot()) {
+        consume();
+        if (!isId()) {
+            error(GENERAL, "Invalid use of . syntax, not followed by identifer");
+            break;
+        }
+        field = findField(getId(), type);
+        offset += field != 0 ? field->offset : 0;
+        type = field != 0 ? field->type : 0;
+        if (field == 0 || !field->is_inline) {
+            char *word = field != 0 && field->is_byte ? cFormat("BYTE(%s, %d)", value, offset)
+                : cFormat("WORD(%s, %d)", value, offset / 8);
+            free(value);
+            value = word;
+            offset = 0;
+        }
+        consume();
+    }
+    if (field != 0 && field->is_inline) {
+        char *address = cFormat("((%s) + %d)", value, offset);
+        free(value);
+        value = address;
+        c_field_words = findStructLayout(field->type)->words;
+    }
+    return value;
+}
+
+char *cFields(char *id) {
+    struct trie_node *node_ptr = findVar(id);
+    return cFieldChain(cVariable(id), node_ptr != 0 ? node_ptr->var_type : -1);
+}
+
+/* translates the indexes after an array variable, as arrayElement computes them: the indexes of
+   an array with known sizes combine with their strides, fewer of them give the address of a row,
+   and an array whose sizes are not known holds the address of each further level. The fields of
+   an element of an array of structs add the offset of their word or column. For a packed boolean,
+   c_bit_element is set to the address and index that bitStore takes. */
+char *cElement(char *id) {
+    struct trie_node *node_ptr = findVar(id);
+    int dim_count = node_ptr != 0 ? node_ptr->dim_count : 0;
+    int element_struct = node_ptr != 0 ? node_ptr->element_struct : 0;
+    int bits = node_ptr != 0 && dim_count > 0 ? node_ptr->element_bits : 64;
+    int soa = element_struct != 0 && node_ptr->soa;
+    uint64_t scale = element_struct != 0 && !soa ? findStructLayout(element_struct)->words : 1;
+    int type = variableType;
+    char *base = cVariable(id);
+    char *index = 0;
+    int level = 0;
+    while (isLeftBracket()) {
+        consume();
+        int calls = c_calls;
+        variableType = 2;
+        char *term = cE6();
+        uint64_t stride = arrayStride(node_ptr != 0 ? node_ptr->dims : 0, dim_count, level) * scale;
+        if (stride != 1) {
+            char *scaled = cFormat("(%s * UINT64_C(%" PRIu64 "))", term, stride);
+            free(term);
+            term = scaled;
+        }
+        index = index == 0 ? term : cCombine("(%s + %s)", index, term, c_calls != calls);
+        if (!isRightBracket()) {
+            error(GENERAL, "expected ] after array variable");
+            break;
+        }
+        consume();
+        level++;
+        if (isLeftBracket() && level >= (dim_count > 0 ? dim_count : 1)) {
+            if (element_struct != 0 || bits != 64) {
+                error(GENERAL, "too many indexes for an array whose elements are not words");
+            }
+            char *element = cFormat("WORD(%s, %s)", base, index);
+            free(base);
+            free(index);
+            base = element;
+            index = 0;
+            level = 0;
+            dim_count = 0;
+        }
+    }
+    variableType = type;
+    if (element_struct != 0 && level == dim_count) {
+        int is_inline = 1;
+        int is_byte = 0;
+        uint64_t offset = 0;
+        int field_type = element_struct;
+        while (is_inline && isDot()) {
+            consume();
+            struct struct_var *field = isId() ? findField(getId(), field_type) : 0;
+            if (field == 0) {
+                error(GENERAL, "Invalid use of . syntax, not followed by identifer");
+                break;
+            }
+            consume();
+            offset += field->offset;
+            field_type = field->type;
+            is_inline = field->is_inline;
+            is_byte = field->is_byte;
+        }
+        if (soa && is_inline) {
+            error(GENERAL, "an element of a soa array has no address of its own, only its fields do");
+        }
+        //the index counts words, except in the column of a char or boolean
+        if (soa) {
+            offset *= arrayStride(node_ptr->dims, dim_count, -1);
+        } else if (is_byte) {
+            char *bytes = cFormat("(%s * 8)", index);
+            free(index);
+            index = bytes;
+        }
+        offset = is_byte ? offset : offset / 8;
+        char *at = offset == 0 ? strdup(index) : cFormat("(%s + UINT64_C(%" PRIu64 "))", index, offset);
+        char *value;
+        if (is_inline) {
+            value = cFormat("(%s + 8 * %s)", base, at);
+            c_field_words = findStructLayout(field_type)->words;
+        } else if (is_byte) {
+            value = cFormat("BYTE(%s, %s)", base, at);
+        } else {
+            value = cFormat("WORD(%s, %s)", base, at);
+            if (isDot()) {
+                value = cFieldChain(value, field_type);
+            }
+        }
+        free(base);
+        free(index);
+        free(at);
+        return value;
+    } else if (isDot()) {
+        error(GENERAL, "only an element of an array of structs has fields");
+    }
+    char *value;
+    if (bits == 1 && level < dim_count) {
+        error(GENERAL, "a row of a packed array has no address");
+        value = cLiteral(0);
+    } else if (bits == 1) {
+        c_bit_element = cFormat("%s, %s", base, index);
+        value = cFormat("bitLoad(%s)", c_bit_element);
+    } else if (level < dim_count) {
+        value = cFormat(bits == 8 ? "(%s + %s)" : "(%s + 8 * %s)", base, index);
+    } else {
+        value = cFormat(bits == 8 ? "BYTE(%s, %s)" : "WORD(%s, %s)", base, index);
+    }
+    free(base);
+    free(index);
+    return value;
+}
+
+/* the word or byte at the address that follows a $, as dereference finds it */
+char *cDereference(void) {
+    int bytes = pointeeBytes(current_token);
+    char *address = 0;
+    if (isId()) {
+        address = cVariable(getId());
+        consume();
+    } else if (isLeft()) {
+        int type = variableType;
+        variableType = 2;
+        address = cPrimary();
+        variableType = type;
+    } else {
+        error(GENERAL, "Cannot dereference something that is not an identifier or in parentheses");
+        return cLiteral(0);
+    }
+    char *value = cFormat(bytes == 1 ? "BYTE(%s, 0)" : "WORD(%s, 0)", address);
+    free(address);
+    return value;
+}
+
+char *cPrimary(void) {
+    if ((variableType == 0 || variableType == 1) && (isDereference() || (isId()
+            && (current_token->next->type == LEFT_BRACKET || current_token->next->type == DOT)))) {
+        variableType = 2;
+    }
+    if (isLeft()) {
+        consume();
+        char *inner = cE6();
+        if (!isRight()) {
+            error(PAREN_MISMATCH, "unclosed parenthesis expression");
+        }
+        consume();
+        char *value = cFormat("(%s)", inner);
+        free(inner);
+        return value;
+    } else if (variableType == 0) {
+        char *value = 0;
+        if (isTrue() || isFalse()) {
+            value = cLiteral(isTrue());
+            consume();
+        } else if (isId()) {
+            if (getVarTypePos(getId()) != 0) {
+                error(GENERAL, "Given variable is not a boolean");
+            }
+            value = cVariable(getId());
+            consume();
+        } else {
+            error(GENERAL, "Type mismatch, expecting boolean");
+            value = cLiteral(0);
+        }
+        variableType = 2;
+        return value;
+    } else if (variableType == 1) {
+        char *value = 0;
+        if (isChar()) {
+            value = cLiteral(getChar());
+            consume();
+        } else if (isId()) {
+            if (getVarTypePos(getId()) != 1) {
+                error(GENERAL, "Given variable is not a char\n");
+            }
+            value = cVariable(getId());
+            consume();
+        } else {
+            error(GENERAL, "Type mismatch, expecting char\n");
+            value = cLiteral(0);
+        }
+        variableType = 2;
+        return value;
+    } else if (isInt()) {
+        char *value = cLiteral(getInt());
+        consume();
+        return value;
+    } else if (isChar() || isTrue() || isFalse()) {
+        char *value = cLiteral(isChar() ? getChar() : isTrue());
+        consume();
+        return value;
+    } else if (isString()) {
+        char *value = cFormat("(uint64_t) (uintptr_t) string_%d.bytes", stringLiteral(current_token->value.id));
+        consume();
+        return value;
+    } else if (isId()) {
+        char *id = getId();
+        consume();
+        if (strcmp(id, "key") == 0) {
+            return strdup("key_store");
+        }
+        if (isPlusPlus() || isMinusMinus()) {
+            //like the assembly, the operand is incremented but the variable is left alone
+            char *op = isPlusPlus() ? "+" : "-";
+            consume();
+            char *variable = cVariable(id);
+            char *value = cFormat("(%s %s UINT64_C(1))", variable, op);
+            free(variable);
+            return value;
+        } else if (isLeft()) {
+            consume();
+            return cCall(id);
+        } else if (isDot()) {
+            return cFields(id);
+        } else if (isLeftBracket()) {
+            return cElement(id);
+        } else if (findVar(id) == 0 && findSignature(id) != 0) {
+            return cFormat("(uint64_t) (uintptr_t) %s_fun", id);
+        }
+        return cVariable(id);
+    } else if (isReference()) {
+        consume();
+        if (!isId()) {
+            error(GENERAL, "Cannot reference something that is not an identifier!");
+            return cLiteral(0);
+        }
+        char *variable = cVariable(getId());
+        consume();
+        char *value = cFormat("(uint64_t) (uintptr_t) &%s", variable);
+        free(variable);
+        return value;
+    } else if (isDereference()) {
+        consume();
+        return cDereference();
+    }
+    error(GENERAL, "Expected expression\n");
+    consume();
+    return cLiteral(0);
+}
+
+/* nonzero if the expression of a user operator calls a function or another user operator */
+int cOperatorCalls(struct user_operator *operator) {
+    for (struct token *tkn = operator->expression; tkn != 0; tkn = tkn->next) {
+        if (tkn->type == USER_OP || (tkn->type == ID && tkn->next != 0 && tkn->next->type == LEFT)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* a user operator becomes a call of the function translated from its expression */
+char *cE1(void) {
+    char *value = cPrimary();
+    while (current_token->type == USER_OP) {
+        struct user_operator *operator = findUserOperator(current_token->value.user_op);
+        consume();
+        int calls = c_calls;
+        char *right = cPrimary();
+        char *format = cFormat("%c_op(%%s, %%s)", operator->symbol);
+        value = cCombine(format, value, right, c_calls != calls);
+        free(format);
+        if (cOperatorCalls(operator)) {
+            c_calls++;
+        }
+    }
+    return value;
+}
+
+/* '*', '/' and '%' are unsigned, as divq is */
+char *cE2(void) {
+    char *value = cE1();
+    while (isMul() || isDiv() || isMod()) {
+        char *format = isMul() ? "(%s * %s)" : isDiv() ? "(%s / %s)" : "(%s %% %s)";
+        consume();
+        int calls = c_calls;
+        char *right = cE1();
+        value = cCombine(format, value, right, c_calls != calls);
+    }
+    return value;
+}
+
+/* a pointer on its own scales what is added to it by its stride, and the difference of two pointers
+   is divided by it, as e3 does */
+char *cE3(void) {
+    struct token *first = current_token;
+    char *value = cE2();
+    int stride = current_token == first->next ? pointerStride(first) : 0;
+    while (isPlus() || isMinus()) {
+        int is_plus = isPlus();
+        char *format = is_plus ? "(%s + %s)" : "(%s - %s)";
+        consume();
+        struct token *operand_token = current_token;
+        int calls = c_calls;
+        char *right = cE2();
+        int operand_stride = current_token == operand_token->next ? pointerStride(operand_token) : 0;
+        int scale = operand_stride != 0 ? 1 : stride;
+        int left_scale = stride == 0 && is_plus ? operand_stride : 0;
+        int divide = operand_stride != 0 && !is_plus ? stride : 0;
+        if (left_scale != 0 || divide != 0) {
+            stride = left_scale;
+        }
+        if (scale > 1) {
+            char *scaled = cFormat("(%s * UINT64_C(%d))", right, scale);
+            free(right);
+            right = scaled;
+        }
+        if (left_scale > 1) {
+            char *scaled = cFormat("(%s * UINT64_C(%d))", value, left_scale);
+            free(value);
+            value = scaled;
+        }
+        value = cCombine(format, value, right, c_calls != calls);
+        if (divide > 1) {
+            char *count = cFormat("(uint64_t) ((int64_t) %s / %d)", value, divide);
+            free(value);
+            value = count;
+        }
+    }
+    return value;
+}
+
+/* comparisons are unsigned, as setb and seta are, and give a 0/1 word */
+char *cE4(void) {
+    char *value = cE3();
+    while (isEqEq() || isLt() || isGt() || isLtGt()) {
+        char *format = isEqEq() ? "(uint64_t) (%s == %s)" : isLt() ? "(uint64_t) (%s < %s)"
+            : isGt() ? "(uint64_t) (%s > %s)" : "(uint64_t) (%s != %s)";
+        consume();
+        int calls = c_calls;
+        char *right = cE3();
+        value = cCombine(format, value, right, c_calls != calls);
+    }
+    return value;
+}
+
+/* '&' and '|' skip their right side exactly where e5 does: between 0/1 values, when it is expensive */
+char *cE5(void) {
+    struct token *start = current_token;
+    int type = variableType;
+    char *value = cE4();
+    if (!(isAnd() || isOr() || isXOr())) {
+        return value;
+    }
+    int is_bool = cOperandIsBool(start, type, e4, 0);
+    while (isAnd() || isOr() || isXOr()) {
+        enum token_type op = current_token->type;
+        consume();
+        int cheap;
+        int right_bool = cOperandIsBool(current_token, variableType, e4, &cheap);
+        int lazy = op != XOR && is_bool && right_bool && !cheap;
+        int calls = c_calls;
+        char *right = cE4();
+        if (lazy) {
+            value = cCombine(op == AND ? "(uint64_t) (%s && %s)" : "(uint64_t) (%s || %s)", value, right, 0);
+        } else {
+            value = cCombine(op == AND ? "(%s & %s)" : op == OR ? "(%s | %s)" : "(%s ^ %s)", value, right,
+                    c_calls != calls);
+        }
+        is_bool = is_bool && right_bool;
+    }
+    return value;
+}
+
+/* e6 only evaluates both sides of a ternary when neither has side effects, so ?: matches it */
+char *cE6(void) {
+    char *value = cE5();
+    if (!isQuestionMark()) {
+        return value;
+    }
+    consume();
+    char *then = cE5();
+    if (!isColon()) {
+        error(GENERAL, "Requred colon in between arguments when doing ternary operator");
+    }
+    consume();
+    char *otherwise = cE5();
+    char *selected = cFormat("(%s ? %s : %s)", value, then, otherwise);
+    free(value);
+    free(then);
+    free(otherwise);
+    return selected;
+}
+
+/* translates a block's statements, without the braces, in a scope of their own */
+void cBlockContents(void) {
+    consume();
+    beginVarScope();
+    while (cStatement()) {
+    }
+    endVarScope();
+    if (!isRightBlock()) {
+        error(BRACKET_MISMATCH, "Unclosed statement block\n");
+    }
+    consume();
+}
+
+/* translates the body of an if, else or while between braces the caller printed; it gets a scope of
+   its own as in the assembly, and a block is not wrapped in a second pair of braces */
+void cBody(void) {
+    c_indent++;
+    beginVarScope();
+    if (isLeftBlock()) {
+        cBlockContents();
+    } else {
+        cStatement();
+    }
+    endVarScope();
+    c_indent--;
+}
+
+/* translates the statements up to the end token into a window callback */
+void cCallback(char *head, char *first, char *last, enum token_type end) {
+    FILE *out = stdout;
+    int temps = c_temps;
+    int indent = c_indent;
+    char *body = 0;
+    size_t body_size = 0;
+    stdout = open_memstream(&body, &body_size);
+    c_temps = 0;
+    c_indent = 1;
+    c_callback = 1;
+    while (current_token->type != end && cStatement()) {
+    }
+    fclose(stdout);
+    stdout = c_callbacks;
+    printf("%s {\n", head);
+    cDeclareTemporaries();
+    printf("%s%s%s}\n\n", first, body, last);
+    free(body);
+    stdout = out;
+    c_temps = temps;
+    c_indent = indent;
+    c_callback = 0;
+}
+
+/* translates a loop body, followed by the increment of a for loop if inc_token is set. break and
+   continue become gotos where C would take them to a switch or past the increment */
+void cLoopBody(char *kind, unsigned int num, struct token *inc_token) {
+    char *outer_kind = loop_kind;
+    unsigned int outer_num = loop_num;
+    int outer_switches = c_loop_switches;
+    int outer_break = c_loop_break;
+    int outer_continue = c_loop_continue;
+    int outer_arena = arena_loop_mark;
+    loop_kind = kind;
+    loop_num = num;
+    arena_loop_mark = 0;
+    c_loop_switches = 0;
+    c_loop_break = 0;
+    c_loop_continue = 0;
+    if (inc_token == 0) {
+        cBody();
+    } else {
+        c_indent++;
+        cStatement();
+        if (c_loop_continue) {
+            cIndent();
+            printf("%s_next_%u:;\n", kind, num);
+        }
+        struct token *end_token = current_token;
+        current_token = inc_token;
+        cStatement();
+        current_token = end_token;
+        c_indent--;
+    }
+    int needs_end = c_loop_break;
+    loop_kind = outer_kind;
+    loop_num = outer_num;
+    arena_loop_mark = outer_arena;
+    c_loop_switches = outer_switches;
+    c_loop_break = outer_break;
+    c_loop_continue = outer_continue;
+    cIndent();
+    printf("}\n");
+    if (needs_end) {
+        cIndent();
+        printf("%s_end_%u:;\n", kind, num);
+    }
+}
+
+/* prints the call that leaves the arena blocks a break or continue jumps out of */
+void cLeaveLoopArenas(void) {
+    if (arena_loop_mark != 0) {
+        cIndent();
+        printf("arena_leave(arena_%d);\n", arena_loop_mark);
+    }
+}
+
+int cStatement(void) {
+    if (isId()) {
+        char *id = getId();
+        consume();
+        int is_element = isLeftBracket() || isDot();
+        struct trie_node *table_node = is_element ? 0 : findVar(id);
+        if (table_node != 0 && table_node->table != 0) {
+            error(GENERAL, "a table cannot be assigned, only its elements can");
+        }
+        c_field_words = 0;
+        c_bit_element = 0;
+        char *target = isLeftBracket() ? cElement(id) : isDot() ? cFields(id) : cVariable(id);
+        int words = c_field_words;
+        char *bit_element = c_bit_element;
+        if (!isEq()) {
+            error(GENERAL, "Expected =\n");
+        }
+        consume();
+        variableType = getVarType(id);
+        int calls = c_calls;
+        char *value = cE6();
+        cIndent();
+        if (is_element && c_calls != calls) {
+            //the assembly computes the address after the value, which may change it
+            char *temp = cTemporary();
+            printf("%s = %s;\n", temp, value);
+            cIndent();
+            free(value);
+            value = temp;
+        }
+        if (words > 0) {
+            //a struct stored inline takes a copy of the one assigned to it
+            printf("memcpy((void *) (uintptr_t) %s, (const void *) (uintptr_t) %s, %d);\n", target, value,
+                    8 * words);
+        } else if (bit_element != 0) {
+            printf("bitStore(%s, %s);\n", bit_element, value);
+        } else {
+            //a byte keeps the low 8 bits of the value, as movb does
+            printf(strncmp(target, "BYTE(", 5) == 0 ? "%s = (uint8_t) (%s);\n" : "%s = %s;\n", target, value);
+        }
+        free(bit_element);
+        free(target);
+        free(value);
+        if (isSemi()) {
+            consume();
+        }
+        variableType = 2;
+        return 1;
+    } else if (isDereference()) {
+        consume();
+        char *target = cDereference();
+        if (!isEq()) {
+            error(GENERAL, "Expected =\n");
+        }
+        consume();
+        variableType = 2;
+        int calls = c_calls;
+        char *value = cE6();
+        cIndent();
+        if (c_calls != calls) {
+            //the assembly computes the address after the value, which may change it
+            char *temp = cTemporary();
+            printf("%s = %s;\n", temp, value);
+            cIndent();
+            free(value);
+            value = temp;
+        }
+        printf(strncmp(target, "BYTE(", 5) == 0 ? "%s = (uint8_t) (%s);\n" : "%s = %s;\n", target, value);
+        free(target);
+        free(value);
+        if (isSemi()) {
+            consume();
+        }
+        variableType = 2;
+        return 1;
+    } else if (isType() || isSoa() || isPacked() || isConst()) {
+        int is_const = isConst();
+        if (is_const) {
+            consume();
+        }
+        int soa = isSoa();
+        int packed = isPacked();
+        if (soa || packed) {
+            consume();
+        }
+        int isStruct = isType() && isStructType();
+        if (soa && !isStruct) {
+            error(GENERAL, "soa applies to arrays of structs only");
+        } else if (packed && (!isType() || findVarType(current_token->value.id) != 0)) {
+            error(GENERAL, "packed applies to arrays of booleans only");
+        }
+        char *typeName = current_token->value.id;
+        consume();
+        int stride = pointerDeclaration(findVarType(typeName));
+        if (!isId()) {
+            error(GENERAL, "expected identifier after type name");
+            return 0;
+        }
+        char *id = getId();
+        struct token *id_token = current_token;
+        consume();
+        if (isLeftBracket() && stride != 0) {
+            error(GENERAL, "arrays hold words, not pointers of their own type");
+        }
+        if (isLeftBracket() && isTable()) {
+            if (soa || packed) {
+                error(GENERAL, "soa and packed apply to arrays without an initializer");
+            }
+            struct table_data *table = tableInitializer(id_token, findVarType(typeName), is_const);
+            setVarNum(id, 1, 2)->table = table;
+            setArrayDims(id, table->dims, table->dim_count, 0, 0, 8 * table->bytes);
+            if (isSemi()) {
+                consume();
+            }
+            return 1;
+        } else if (is_const) {
+            error(GENERAL, "const applies to arrays with an initializer");
+        }
+        if (isLeftBracket()) {
+            //one block, row after row, as makeArraySpace allocates
+            int dims[MAX_ARRAY_DIMS];
+            int total = 0;
+            int dim_count = arrayDims(dims, &total);
+            int element_struct = isStruct ? findVarType(typeName) : 0;
+            int element_bits = elementBits(findVarType(typeName), packed);
+            int words = dim_count > 0 ? arrayWords(element_struct, element_bits, total) : 0;
+            if (dim_count == 0) {
+                error(GENERAL, "expected number index after [");
+            } else if (words == 0) {
+                error(GENERAL, "arrays of structs take a struct type defined before them");
+            }
+            while (isLeftBracket()) {
+                consume();
+                consume();
+                consume();
+            }
+            char *declaration = cDeclare(id, 2);
+            setArrayDims(id, dims, dim_count, element_struct, soa, element_bits);
+            cIndent();
+            printf("%s = (uint64_t) (uintptr_t) arena_alloc(%d);\n", declaration, 8 * words);
+            free(declaration);
+            if (isSemi()) {
+                consume();
+            }
+            return 1;
+        } else if (soa || packed) {
+            error(GENERAL, "soa and packed apply to arrays only");
+        }
+        int whichVar = stride != 0 && !isStruct ? 2 : findVarType(typeName);
+        variableType = whichVar;
+        char *declaration = cDeclare(id, whichVar);
+        findVar(id)->pointer_stride = stride;
+        char *value;
+        if (isEq()) {
+            consume();
+            value = cE6();
+        } else {
+            if (isSemi()) {
+                consume();
+            }
+            value = isStruct && stride == 0 ? cFormat("%s_struct()", typeName) : cLiteral(0);
+        }
+        cIndent();
+        printf("%s = %s;\n", declaration, value);
+        free(declaration);
+        free(value);
+        variableType = 2;
+        return 1;
+    } else if (isLeftBlock()) {
+        cIndent();
+        printf("{\n");
+        c_indent++;
+        cBlockContents();
+        c_indent--;
+        cIndent();
+        printf("}\n");
+        return 1;
+    } else if (isWindowStart()) {
+        unsigned int window_num = window_count++;
+        consume();
+        if (!isInt()) {
+            error(GENERAL, "Expected window x size after declaring window start block\n");
+        }
+        uint64_t x_size = getInt();
+        consume();
+        if (!isInt()) {
+            error(GENERAL, "Expected window y size after declaring window start block\n");
+        }
+        uint64_t y_size = getInt();
+        consume();
+        cIndent();
+        printf("glutInit(&glut_argc, 0);\n");
+        cIndent();
+        printf("glutInitDisplayMode(0);\n");
+        cIndent();
+        printf("glutInitWindowPosition(0, 0);\n");
+        cIndent();
+        printf("window_x_size = %" PRIu64 ";\n", x_size);
+        cIndent();
+        printf("window_y_size = %" PRIu64 ";\n", y_size);
+        cIndent();
+        printf("glutInitWindowSize(%" PRIu64 ", %" PRIu64 ");\n", x_size, y_size);
+        cIndent();
+        printf("glutCreateWindow(\"Potato, the Epic Window\");\n");
+        cIndent();
+        printf("bg_setupwindow();\n");
+        cIndent();
+        printf("glutDisplayFunc(windowloop_%u);\n", window_num);
+        cIndent();
+        printf("glutIdleFunc(windowloop_%u);\n", window_num);
+        char head[64];
+        if (isKBDown()) {
+            consume();
+            snprintf(head, sizeof(head), "static void keyboard_%u(unsigned char key, int x, int y)", window_num);
+            cCallback(head, "    key_store = key;\n", "", KBDOWNEND);
+            consume();
+            cIndent();
+            printf("glutKeyboardFunc(keyboard_%u);\n", window_num);
+        }
+        if (isKBUp()) {
+            consume();
+            snprintf(head, sizeof(head), "static void keyboardup_%u(unsigned char key, int x, int y)", window_num);
+            cCallback(head, "    key_store = key;\n", "", KBUPEND);
+            consume();
+            cIndent();
+            printf("glutKeyboardUpFunc(keyboardup_%u);\n", window_num);
+        }
+        snprintf(head, sizeof(head), "static void windowloop_%u(void)", window_num);
+        cCallback(head, "    bg_clear();\n", "    glFlush();\n", WINDOW_END);
+        consume();
+        cIndent();
+        printf("glutMainLoop();\n");
+        return 1;
+    } else if (isIf()) {
+        consume();
+        char *cond = cE6();
+        cIndent();
+        printf("if (%s) {\n", cond);
+        free(cond);
+        cBody();
+        if (isElse()) {
+            consume();
+            cIndent();
+            printf("} else {\n");
+            cBody();
+        }
+        cIndent();
+        printf("}\n");
+        return 1;
+    } else if (isWhile()) {
+        unsigned int while_num = while_count++;
+        consume();
+        char *cond = cE6();
+        cIndent();
+        printf("while (%s) {\n", cond);
+        free(cond);
+        cLoopBody("while", while_num, 0);
+        return 1;
+    } else if (isFor()) {
+        unsigned int for_num = for_count++;
+        consume();
+        if (!isLeft()) {
+            error(PAREN_MISMATCH, "Expected (");
+        }
+        consume();
+        cIndent();
+        printf("{\n");
+        c_indent++;
+        beginVarScope();
+        cStatement();
+        char *cond = cE6();
+        //the increment is translated after the body, in the scope the body leaves
+        struct token *inc_token = current_token;
+        statement(0);
+        if (!isRight()) {
+            error(PAREN_MISMATCH, "Expected )");
+        }
+        consume();
+        cIndent();
+        printf("while (%s) {\n", cond);
+        free(cond);
+        cLoopBody("for", for_num, inc_token);
+        endVarScope();
+        c_indent--;
+        cIndent();
+        printf("}\n");
+        return 1;
+    } else if (isSemi()) {
+        consume();
+        return 1;
+    } else if (isReturn()) {
+        consume();
+        char *value = cE6();
+        if (arena_function_mark != 0) {
+            cIndent();
+            printf("{\n");
+            c_indent++;
+            cIndent();
+            printf("uint64_t arena_result = %s;\n", value);
+            cIndent();
+            printf("arena_leave(arena_%d);\n", arena_function_mark);
+            free(value);
+            value = strdup("arena_result");
+        }
+        cIndent();
+        if (c_callback) {
+            printf("(void) %s;\n", value);
+            cIndent();
+            printf("return;\n");
+        } else {
+            printf("return %s;\n", value);
+        }
+        if (arena_function_mark != 0) {
+            c_indent--;
+            cIndent();
+            printf("}\n");
+        }
+        free(value);
+        if (isSemi()) {
+            consume();
+        }
+        return 1;
+    } else if (isPrint()) {
+        consume();
+        int is_string = isStringOperand();
+        char *value = cE6();
+        cIndent();
+        //byte elements and fields are uint8_t, which printf must not get for a uint64_t
+        printf(is_string ? "str_print(%s);\n" : "printf(\"%%\" PRIu64 \"\\n\", (uint64_t) (%s));\n", value);
+        free(value);
+        if (isSemi()) {
+            consume();
+        }
+        return 1;
+    } else if (isBell()) {
+        consume();
+        cIndent();
+        printf("printf(\"\\a\");\n");
+        cIndent();
+        printf("fflush(stdout);\n");
+        return 1;
+    } else if (isDelay()) {
+        consume();
+        char *value = cE6();
+        cIndent();
+        printf("usleep(%s);\n", value);
+        free(value);
+        return 1;
+    } else if (isSwitch()) {
+        consume();
+        char *value = cE6();
+        if (!isLeftBlock()) {
+            error(GENERAL, "Missing left bracket after declaration of switch statement");
+            free(value);
+            return 0;
+        }
+        cIndent();
+        printf("switch (%s) {\n", value);
+        free(value);
+        c_loop_switches++;
+        beginVarScope();
+        c_indent++;
+        cBlockContents();
+        c_indent--;
+        endVarScope();
+        c_loop_switches--;
+        cIndent();
+        printf("}\n");
+        return 1;
+    } else if (isCase() || isDefault()) {
+        //a case runs on into the next one unless a break at its own level ends the switch
+        if (isCase()) {
+            consume();
+            char *value = cLiteral(getInt());
+            cIndent();
+            printf("case %s:;\n", value);
+            free(value);
+            consume();
+        }
+        if (isDefault()) {
+            consume();
+            cIndent();
+            printf("default:;\n");
+        }
+        while (!isCase() && !isBreak() && !isRightBlock() && cStatement()) {
+        }
+        if (isBreak()) {
+            cIndent();
+            printf("break;\n");
+            consume();
+        }
+        return 1;
+    } else if (isPlay()) {
+        consume();
+        if (!isLeft()) {
+            error(PAREN_MISMATCH, "Missing parenthesis after play\n");
+        }
+        consume();
+        char *prefix;
+        int count;
+        char *args = cArguments(&prefix, &count, -1);
+        if (count != 3) {
+            error(GENERAL, "play takes a frequency, a length and a number of repetitions\n");
+        }
+        cIndent();
+        printf("%splay(%s);\n", prefix, args);
+        free(prefix);
+        free(args);
+        return 1;
+    } else if (isBreak()) {
+        consume();
+        cLeaveLoopArenas();
+        cIndent();
+        if (c_loop_switches > 0) {
+            printf("goto %s_end_%u;\n", loop_kind, loop_num);
+            c_loop_break = 1;
+        } else {
+            printf("break;\n");
+        }
+        return 1;
+    } else if (isContinue()) {
+        consume();
+        cLeaveLoopArenas();
+        cIndent();
+        if (strcmp(loop_kind, "for") == 0) {
+            printf("goto for_next_%u;\n", loop_num);
+            c_loop_continue = 1;
+        } else {
+            printf("continue;\n");
+        }
+        return 1;
+    } else if (isArena()) {
+        consume();
+        if (!isLeftBlock()) {
+            error(GENERAL, "Expected { after arena\n");
+        }
+        int mark = ++c_arenas;
+        cIndent();
+        printf("{\n");
+        c_indent++;
+        cIndent();
+        printf("void *arena_%d = arena_enter();\n", mark);
+        int outer_function_mark = arena_function_mark;
+        int outer_loop_mark = arena_loop_mark;
+        arena_function_mark = arena_function_mark != 0 ? arena_function_mark : mark;
+        arena_loop_mark = arena_loop_mark != 0 ? arena_loop_mark : mark;
+        cStatement();
+        arena_function_mark = outer_function_mark;
+        arena_loop_mark = outer_loop_mark;
+        cIndent();
+        printf("arena_leave(arena_%d);\n", mark);
+        c_indent--;
+        cIndent();
+        printf("}\n");
+        return 1;
+    }
+    return 0;
+}
+
+/* nonzero if the function starting at the given token opens a window */
+int cOpensWindow(struct token *fun_token) {
+    int depth = 0;
+    for (struct token *tkn = fun_token->next; tkn->type != END && tkn->type != FUN_KWD; tkn = tkn->next) {
+        if (tkn->type == LEFT_BLOCK) {
+            depth++;
+        } else if (tkn->type == RIGHT_BLOCK && --depth <= 0) {
+            break;
+        } else if (tkn->type == WINDOW_START) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* translates a function; when it opens a window its locals are statics the callbacks share, and
+   those are printed before it along with the callbacks */
+void cFunction(void) {
+    struct token *fun_token = current_token;
+    consume();
+    if (!isId()) {
+        error(GENERAL, "Invalid function name\n");
+    }
+    char *id = getId();
+    consume();
+    function_name = id;
+    c_hoisted = cOpensWindow(fun_token);
+    FILE *out = stdout;
+    char *hoist = 0, *callbacks = 0, *body = 0;
+    size_t hoist_size = 0, callbacks_size = 0, body_size = 0;
+    c_hoist = open_memstream(&hoist, &hoist_size);
+    c_callbacks = open_memstream(&callbacks, &callbacks_size);
+    stdout = open_memstream(&body, &body_size);
+    c_temps = 0;
+    c_indent = 1;
+    if (!isLeft()) {
+        error(GENERAL, "Expected function parameter declaration\n");
+    }
+    consume();
+    beginVarScope();
+    char *params = strdup("");
+    while (!isRight() && !isEnd()) {
+        if (!isType()) {
+            error(GENERAL, "expected type declaration\n");
+        }
+        int whichType = findVarType(current_token->value.id);
+        consume();
+        int stride = pointerDeclaration(whichType);
+        whichType = stride != 0 && whichType < standardTypeCount ? 2 : whichType;
+        if (!isId()) {
+            error(GENERAL, "Invalid parameter name\n");
+        }
+        char *param_id = getId();
+        consume();
+        setVarNum(param_id, namespace_head->next_var_num, whichType)->pointer_stride = stride;
+        namespace_head->next_var_num--;
+        char *longer = cFormat("%s%suint64_t %s_var", params, *params == 0 ? "" : ", ", param_id);
+        free(params);
+        params = longer;
+        if (c_hoisted) {
+            char *name = cVariable(param_id);
+            fprintf(c_hoist, "static uint64_t %s;\n", name);
+            printf("    %s = %s_var;\n", name, param_id);
+            free(name);
+        }
+        if (isComma()) {
+            consume();
+        }
+    }
+    consume();
+    //the parameters and the outermost block of the body share a C block
+    if (isLeftBlock()) {
+        consume();
+        beginVarScope();
+        c_body_scope = namespace_head;
+        while (cStatement()) {
+        }
+        endVarScope();
+        if (!isRightBlock()) {
+            error(BRACKET_MISMATCH, "Unclosed statement block\n");
+        }
+        consume();
+    } else {
+        cStatement();
+    }
+    endVarScope();
+    c_body_scope = 0;
+    fclose(stdout);
+    fclose(c_hoist);
+    fclose(c_callbacks);
+    stdout = out;
+    printf("%s%s%s", hoist, *hoist == 0 ? "" : "\n", callbacks);
+    printf("static uint64_t %s_fun(%s) {\n", id, *params == 0 ? "void" : params);
+    cDeclareTemporaries();
+    printf("%s    return 0;\n}\n\n", body);
+    free(hoist);
+    free(callbacks);
+    free(body);
+    free(params);
+    c_hoisted = 0;
+}
+
+/* fills in the fields of a struct starting at word index of fields, as fillStruct does */
+void cFillStruct(struct struct_data *layout, int index) {
+    for (int i = 0; i < layout->type_count; i++) {
+        struct struct_var *field = &layout->data[i];
+        if (field->is_inline) {
+            cFillStruct(findStructLayout(field->type), index + field->offset / 8);
+        } else if (field->type >= standardTypeCount) {
+            printf("    fields[%d] = %s_struct();\n", index + field->offset / 8, definedTypes[field->type]);
+        } else if (field->is_byte) {
+            printf("    ((uint8_t *) fields)[%d] = 0;\n", 8 * index + field->offset);
+        } else {
+            printf("    fields[%d] = UINT64_C(333);\n", index + field->offset / 8);
+        }
+    }
+}
+
+/* translates a struct definition into its constructor; the assembly backend records the layout */
+void cStructDef(void) {
+    FILE *out = stdout;
+    char *discarded = 0;
+    size_t discarded_size = 0;
+    stdout = open_memstream(&discarded, &discarded_size);
+    structDef();
+    fclose(stdout);
+    free(discarded);
+    stdout = out;
+    struct struct_data *layout = &struct_info[struct_count - 1];
+    char *name = definedTypes[layout->id];
+    fprintf(c_decls, "static uint64_t %s_struct(void);\n", name);
+    printf("static uint64_t %s_struct(void) {\n", name);
+    printf("    uint64_t *fields = arena_alloc(%d);\n", layout->words == 0 ? 8 : 8 * layout->words);
+    cFillStruct(layout, 0);
+    printf("    return (uint64_t) (uintptr_t) fields;\n}\n\n");
+}
+
+/* a global with a literal initializer is initialized statically, and is const if nothing writes
+   it; any other initializer runs in globals_init before main_fun */
+void cGlobalVarDef(void) {
+    int is_const = isConst();
+    if (is_const) {
+        consume();
+    }
+    char *typeName = current_token->value.id;
+    int whichType = findVarType(typeName);
+    int isStruct = isStructType();
+    consume();
+    if (!isId()) {
+        error(GENERAL, "Expected valid identifier\n");
+    }
+    char *id = getId();
+    struct token *id_token = current_token;
+    consume();
+    if (isLeftBracket() && isTable()) {
+        struct table_data *table = tableInitializer(id_token, whichType, is_const);
+        setVarNum(id, 1, 2)->table = table;
+        setArrayDims(id, table->dims, table->dim_count, 0, 0, 8 * table->bytes);
+        if (isSemi()) {
+            consume();
+        }
+        return;
+    } else if (is_const) {
+        error(GENERAL, "const applies to arrays with an initializer");
+    }
+    setVarNum(id, 1, whichType);
+    if (isEq() && isLiteralInitializer()) {
+        consume();
+        uint64_t value = isInt() ? getInt() : isChar() ? getChar() : isTrue();
+        fprintf(c_decls, "static %suint64_t %s_var = UINT64_C(%" PRIu64 ");\n",
+                isAssigned(id) ? "" : "const ", id, value);
+        consume();
+    } else {
+        fprintf(c_decls, "static uint64_t %s_var;\n", id);
+        char *value = 0;
+        if (isEq()) {
+            consume();
+            int temps = c_temps;
+            c_temps = c_init_temps;
+            variableType = whichType;
+            value = cE6();
+            variableType = 2;
+            c_init_temps = c_temps;
+            c_temps = temps;
+        } else if (isStruct) {
+            value = cFormat("%s_struct()", typeName);
+        }
+        if (value != 0) {
+            fprintf(c_init, "    %s_var = %s;\n", id, value);
+            free(value);
+        }
+    }
+    if (isSemi()) {
+        consume();
+    }
+}
+
+/* defines the tables as arrays of words or bytes, each padded to whole words. The ones the program
+   does not write are const, which puts them in .rodata */
+void cTables(void) {
+    for (struct table_data *table = table_head; table != 0; table = table->next) {
+        int padded = table->bytes == 1 ? (table->total + 7) / 8 * 8 : table->total;
+        printf("static %s%s %s_table_%d[%d] __attribute__((aligned(8))) = {", table->writable ? "" : "const ",
+                table->bytes == 1 ? "uint8_t" : "uint64_t", table->id, table->index, padded);
+        for (int i = 0; i < table->count; i++) {
+            printf(i % 8 == 0 ? "\n    " : " ");
+            printf(table->bytes == 1 ? "%" PRIu64 "," : "UINT64_C(%" PRIu64 "),",
+                    table->bytes == 1 ? table->values[i] & 0xff : table->values[i]);
+        }
+        printf("\n};\n");
+    }
+    if (table_head != 0) {
+        printf("\n");
+    }
+}
+
+/* defines the string literals, laid out as the assembly lays them out */
+void cStringLiterals(void) {
+    for (int i = 0; i < string_literal_count; i++) {
+        size_t length = strlen(string_literals[i]);
+        printf("static const struct { uint64_t length; char bytes[%zu]; } string_%d = {%zu, \"", length + 1, i,
+                length);
+        for (unsigned char *ch = (unsigned char *) string_literals[i]; *ch != 0; ch++) {
+            if (*ch == '"' || *ch == '\\' || *ch == '?') {
+                printf("\\%c", *ch);
+            } else if (*ch < ' ' || *ch > '~') {
+                printf("\\%03o", *ch);
+            } else {
+                printf("%c", *ch);
+            }
+        }
+        printf("\"};\n");
+    }
+    if (string_literal_count != 0) {
+        printf("\n");
+    }
+}
+
+/* translates each user operator into a function of its two variables */
+void cOperators(void) {
+    FILE *out = stdout;
+    stdout = c_operators;
+    for (struct user_operator *operator = user_ops; operator != 0; operator = operator->next) {
+        fprintf(c_decls, "static uint64_t %c_op(uint64_t, uint64_t);\n", operator->symbol);
+        char *body = 0;
+        size_t body_size = 0;
+        stdout = open_memstream(&body, &body_size);
+        c_temps = 0;
+        beginVarScope();
+        if (operator->var1 != 0) {
+            setVarNum(operator->var1, -1, operator->type1);
+        }
+        if (operator->var2 != 0) {
+            setVarNum(operator->var2, -2, operator->type2);
+        }
+        current_token = operator->expression;
+        variableType = 2;
+        char *value = cE6();
+        if (!isSemi()) {
+            error(GENERAL, "invalid expression in define statement");
+        }
+        endVarScope();
+        fclose(stdout);
+        stdout = c_operators;
+        printf("static uint64_t %c_op(uint64_t %s%s, uint64_t %s%s) {\n", operator->symbol,
+                operator->var1 != 0 ? operator->var1 : "unused1", operator->var1 != 0 ? "_var" : "",
+                operator->var2 != 0 ? operator->var2 : "unused2", operator->var2 != 0 ? "_var" : "");
+        cDeclareTemporaries();
+        printf("%s    return %s;\n}\n\n", body, value);
+        free(body);
+        free(value);
+    }
+    stdout = out;
+}
+
+/* prints the declarations every translated program needs: the runtime in graphicfuncs.c and
+   playSound.c, and the standard functions of the assembly backend */
+void cPrelude(int opens_window) {
+    printf("#include <stdio.h>\n");
+    printf("#include <stdlib.h>\n");
+    printf("#include <stdint.h>\n");
+    printf("#include <inttypes.h>\n");
+    printf("#include <string.h>\n");
+    printf("#include <time.h>\n");
+    printf("#include <unistd.h>\n");
+    if (opens_window) {
+        printf("#include <glut.h>\n\n");
+        //older glut.h headers leave it out
+        printf("void glutKeyboardUpFunc(void (*)(unsigned char, int, int));\n");
+    }
+    printf("\n");
+    printf("#define WORD(address, index) (((uint64_t *) (uintptr_t) (address))[index])\n");
+    printf("#define BYTE(address, index) (((uint8_t *) (uintptr_t) (address))[index])\n\n");
+    //the booleans of a packed array, 64 to a word
+    printf("static inline uint64_t bitLoad(uint64_t address, uint64_t index) {\n");
+    printf("    return (WORD(address, index >> 6) >> (index & 63)) & 1;\n");
+    printf("}\n\n");
+    printf("static inline void bitStore(uint64_t address, uint64_t index, uint64_t value) {\n");
+    printf("    uint64_t bit = UINT64_C(1) << (index & 63);\n");
+    printf("    WORD(address, index >> 6) = (WORD(address, index >> 6) & ~bit) | ((value & 1) << (index & 63));\n");
+    printf("}\n\n");
+    printf("void bg_drawrect(long, long, long, long);\n");
+    printf("void bg_setcolor(long, long, long);\n");
+    printf("void bg_setupwindow(void);\n");
+    printf("void bg_startpolygon(void);\n");
+    printf("void bg_addpoint(long, long);\n");
+    printf("void bg_endpolygon(void);\n");
+    printf("void bg_drawngon(long, long, long, long);\n");
+    printf("void bg_clear(void);\n");
+    printf("int play(int, int, int);\n");
+    printf("void *arena_alloc(uint64_t);\n");
+    printf("uint64_t str_new(uint64_t);\n");
+    printf("uint64_t str_length(uint64_t);\n");
+    printf("uint64_t str_find(uint64_t, uint64_t);\n");
+    printf("uint64_t str_compare(uint64_t, uint64_t);\n");
+    printf("uint64_t str_copy(uint64_t, uint64_t, uint64_t);\n");
+    printf("uint64_t str_read(uint64_t);\n");
+    printf("uint64_t str_write(uint64_t, uint64_t);\n");
+    printf("void str_print(uint64_t);\n");
+    printf("void *arena_enter(void);\n");
+    printf("void arena_leave(void *);\n");
+    printf("void arena_stats(void);\n");
+    printf("extern long window_x_size, window_y_size;\n\n");
+    printf("static uint64_t rand_seed = 10;\n");
+    printf("static uint64_t key_store;\n");
+    if (opens_window) {
+        printf("static int glut_argc;\n");
+    }
+    printf("\n");
+    printf("static inline uint64_t random_fun(void) {\n");
+    printf("    rand_seed ^= rand_seed << 21;\n");
+    printf("    rand_seed ^= rand_seed >> 35;\n");
+    printf("    rand_seed ^= rand_seed << 4;\n");
+    printf("    return rand_seed;\n");
+    printf("}\n\n");
+    printf("static inline uint64_t getchar_fun(void) {\n");
+    printf("    return (uint64_t) (int64_t) getchar();\n");
+    printf("}\n\n");
+    printf("static inline uint64_t printchar_fun(uint64_t c) {\n");
+    printf("    return (uint64_t) printf(\"%%c\", (int) c);\n");
+    printf("}\n\n");
+}
+
+void cProgram(void) {
+    definePass();
+    collectSignatures();
+    int opens_window = 0;
+    for (struct token *tkn = first_token; tkn->type != END; tkn = tkn->next) {
+        opens_window |= tkn->type == WINDOW_START;
+    }
+    FILE *out = stdout;
+    char *decls = 0, *init = 0, *operators = 0, *body = 0;
+    size_t decls_size = 0, init_size = 0, operators_size = 0, body_size = 0;
+    c_decls = open_memstream(&decls, &decls_size);
+    c_init = open_memstream(&init, &init_size);
+    c_operators = open_memstream(&operators, &operators_size);
+    stdout = open_memstream(&body, &body_size);
+    for (struct fun_signature *signature = signature_head; signature != 0; signature = signature->next) {
+        char *types = cParameterTypes(signature->param_count);
+        fprintf(c_decls, "static uint64_t %s_fun(%s);\n", signature->funId, types);
+        free(types);
+    }
+    while (1) {
+        if (isDefine()) {
+            while (!isSemi()) {
+                current_token = current_token->next;
+            }
+            current_token = current_token->next;
+        } else if (isFun()) {
+            cFunction();
+        } else if (isStruct()) {
+            cStructDef();
+        } else if (isType() || isConst()) {
+            cGlobalVarDef();
+        } else {
+            break;
+        }
+    }
+    if (!isEnd()) {
+        error(GENERAL, "Expected end of file\n");
+    }
+    cOperators();
+    fclose(stdout);
+    fclose(c_decls);
+    fclose(c_init);
+    fclose(c_operators);
+    stdout = out;
+    cPrelude(opens_window);
+    cTables();
+    cStringLiterals();
+    printf("%s\n%s%s", decls, operators, body);
+    printf("static void globals_init(void) {\n");
+    c_temps = c_init_temps;
+    cDeclareTemporaries();
+    printf("%s}\n\n", init);
+    printf("int main(void) {\n");
+    printf("    rand_seed = (uint64_t) time(0) ^ (uint64_t) clock();\n");
+    if (print_arena_stats) {
+        printf("    atexit(arena_stats);\n");
+    }
+    printf("    globals_init();\n");
+    printf("    main_fun();\n");
+    printf("    return 0;\n");
+    printf("}\n");
+    free(decls);
+    free(init);
+    free(operators);
+    free(body);
+}
+
+/* The object writer (--emit=obj) encodes the generated assembly into a relocatable ELF object
+   itself, so no assembler has to parse the program again. It knows the instructions, operand forms
+   and directives that the code generator and the passes print, not the whole of gas: anything else
+   is reported as an error. Short jumps are used wherever the target is close enough, as gas does. */
+
+static int emit_obj = 0;
+
+enum asm_operand_kind { ASM_REGISTER, ASM_IMMEDIATE, ASM_MEMORY };
+enum asm_item_kind { ASM_INSTRUCTION, ASM_LABEL, ASM_BYTES, ASM_QUAD, ASM_ALIGN };
+enum asm_fixup_kind { ASM_PC32, ASM_CALL32, ASM_ABS32S, ASM_REL8 };
+
+//base of a %rip-relative operand
+#define ASM_RIP 16
+#define ASM_SYMBOL_BUCKETS 1024
+#define ASM_MAX_SECTIONS 16
+
+static char *asm_register_names[4][16] = {
+    {"rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+     "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"},
+    {"eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi",
+     "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d"},
+    {"al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil",
+     "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b"},
+    {"xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7",
+     "xmm8", "xmm9", "xmm10", "xmm11", "xmm12", "xmm13", "xmm14", "xmm15"}
+};
+static int asm_register_sizes[4] = {8, 4, 1, 16};
+
+//condition codes in the order of their encodings, with their aliases
+static char *asm_conditions[][3] = {
+    {"o"}, {"no"}, {"b", "c", "nae"}, {"ae", "nb", "nc"}, {"e", "z"}, {"ne", "nz"}, {"be", "na"},
+    {"a", "nbe"}, {"s"}, {"ns"}, {"p", "pe"}, {"np", "po"}, {"l", "nge"}, {"ge", "nl"},
+    {"le", "ng"}, {"g", "nle"}
+};
+
+//recommended multi-byte nops for padding code
+static unsigned char asm_nops[9][9] = {
+    {0x90},
+    {0x66, 0x90},
+    {0x0f, 0x1f, 0x00},
+    {0x0f, 0x1f, 0x40, 0x00},
+    {0x0f, 0x1f, 0x44, 0x00, 0x00},
+    {0x66, 0x0f, 0x1f, 0x44, 0x00, 0x00},
+    {0x0f, 0x1f, 0x80, 0x00, 0x00, 0x00, 0x00},
+    {0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00},
+    {0x66, 0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00}
+};
+
+struct asm_operand {
+    enum asm_operand_kind kind;
+    //a register operand's number and width in bytes
+    int reg;
+    int size;
+    //a memory operand's registers, -1 when missing
+    int base;
+    int index;
+    int scale;
+    //the immediate or displacement, relative to symbol when there is one
+    int64_t value;
+    char *symbol;
+    //'*' before the target of an indirect jump or call
+    int indirect;
+};
+
+struct asm_instruction {
+    char mnemonic[16];
+    int count;
+    struct asm_operand operands[3];
+};
+
+/* a field of an instruction that refers to a symbol */
+struct asm_fixup {
+    int offset;
+    enum asm_fixup_kind kind;
+    char *symbol;
+    int64_t addend;
+};
+
+struct asm_encoding {
+    unsigned char bytes[16];
+    int length;
+    struct asm_fixup fixups[2];
+    int fixup_count;
+};
+
+struct asm_symbol {
+    char *name;
+    //-1 until a label defines it
+    int section;
+    int offset;
+    int global;
+    //the symbol of a whole section, which relocations against local labels refer to
+    int is_section;
+    //position in the symbol table
+    int index;
+    struct asm_symbol *next;
+};
+
+struct asm_reloc {
+    int offset;
+    int type;
+    struct asm_symbol *symbol;
+    int64_t addend;
+};
+
+struct asm_section {
+    char *name;
+    struct asm_symbol *symbol;
+    int flags;
+    int align;
+    unsigned char *bytes;
+    int size;
+    struct asm_reloc *relocs;
+    int reloc_count;
+};
+
+/* a line of the assembly: an instruction, a label or data */
+struct asm_item {
+    enum asm_item_kind kind;
+    int section;
+    int line;
+    int offset;
+    int size;
+    struct asm_instruction instruction;
+    //a jump to a label of its own section, which can be short
+    int relaxable;
+    int long_jump;
+    struct asm_symbol *label;
+    unsigned char *bytes;
+    //the symbol of a .quad
+    char *symbol;
+    int64_t value;
+};
+
+static struct asm_symbol *asm_symbols[ASM_SYMBOL_BUCKETS];
+static struct asm_section asm_sections[ASM_MAX_SECTIONS];
+static int asm_section_count = 0;
+static struct asm_item *asm_items = 0;
+static int asm_item_count = 0;
+static int asm_errors = 0;
+
+/* returns the symbol with the given name, creating an undefined one if there is none */
+struct asm_symbol *asmSymbol(char *name) {
+    unsigned int hash = 5381;
+    for (char *ch = name; *ch != 0; ch++) {
+        hash = hash * 33 + (unsigned char) *ch;
+    }
+    hash %= ASM_SYMBOL_BUCKETS;
+    for (struct asm_symbol *symbol = asm_symbols[hash]; symbol != 0; symbol = symbol->next) {
+        if (strcmp(symbol->name, name) == 0) {
+            return symbol;
+        }
+    }
+    struct asm_symbol *symbol = calloc(1, sizeof(struct asm_symbol));
+    symbol->name = strdup(name);
+    symbol->section = -1;
+    symbol->next = asm_symbols[hash];
+    asm_symbols[hash] = symbol;
+    return symbol;
+}
+
+/* returns the index of the section with the given name, adding it if it is new */
+int asmSection(char *name) {
+    for (int i = 0; i < asm_section_count; i++) {
+        if (strcmp(asm_sections[i].name, name) == 0) {
+            return i;
+        }
+    }
+    if (asm_section_count == ASM_MAX_SECTIONS) {
+        fprintf(stderr, "too many sections\n");
+        exit(1);
+    }
+    struct asm_section *section = &asm_sections[asm_section_count];
+    memset(section, 0, sizeof(struct asm_section));
+    section->name = strdup(name);
+    section->symbol = calloc(1, sizeof(struct asm_symbol));
+    section->symbol->name = section->name;
+    section->symbol->section = asm_section_count;
+    section->symbol->is_section = 1;
+    section->align = 1;
+    if (strncmp(name, ".text", 5) == 0) {
+        section->flags = SHF_ALLOC | SHF_EXECINSTR;
+    } else if (strncmp(name, ".rodata", 7) == 0) {
+        section->flags = SHF_ALLOC;
+    } else {
+        section->flags = SHF_ALLOC | SHF_WRITE;
+    }
+    return asm_section_count++;
+}
+
+void asmError(int line, char *message, char *text) {
+    fprintf(stderr, "cannot encode line %d: %s: %s\n", line, message, text);
+    asm_errors++;
+}
+
+/* returns the register named after the '%', or -1; *size gets its width in bytes */
+int asmRegister(char *name, int *size) {
+    for (int width = 0; width < 4; width++) {
+        for (int reg = 0; reg < 16; reg++) {
+            if (strcmp(name, asm_register_names[width][reg]) == 0) {
+                *size = asm_register_sizes[width];
+                return reg;
+            }
+        }
+    }
+    return -1;
+}
+
+/* parses a symbol, a number or a symbol plus or minus a number; returns nonzero on success */
+int asmExpression(char *text, char **symbol, int64_t *value) {
+    *symbol = 0;
+    *value = 0;
+    while (isspace(*text)) {
+        text++;
+    }
+    if (isalpha(*text) || *text == '_' || *text == '.') {
+        char *end = text;
+        while (isalnum(*end) || *end == '_' || *end == '.') {
+            end++;
+        }
+        *symbol = strndup(text, end - text);
+        text = end;
+        if (*text == 0) {
+            return 1;
+        }
+        if (*text != '+' && *text != '-') {
+            return 0;
+        }
+    }
+    if (*text == 0) {
+        return 0;
+    }
+    char *end;
+    //the code generator prints numbers unsigned, up to 2^64 - 1
+    *value = *text == '-' ? strtoll(text, &end, 0) : (int64_t) strtoull(text + (*text == '+'), &end, 0);
+    while (isspace(*end)) {
+        end++;
+    }
+    return *end == 0;
+}
+
+/* parses an AT&T operand; returns nonzero on success */
+int asmOperand(char *text, struct asm_operand *operand) {
+    memset(operand, 0, sizeof(struct asm_operand));
+    operand->base = -1;
+    operand->index = -1;
+    operand->scale = 1;
+    while (isspace(*text)) {
+        text++;
+    }
+    if (*text == '*') {
+        operand->indirect = 1;
+        text++;
+    }
+    if (*text == '%') {
+        operand->kind = ASM_REGISTER;
+        operand->reg = asmRegister(text + 1, &operand->size);
+        return operand->reg >= 0;
+    }
+    if (*text == '$') {
+        operand->kind = ASM_IMMEDIATE;
+        return asmExpression(text + 1, &operand->symbol, &operand->value);
+    }
+    operand->kind = ASM_MEMORY;
+    char *paren = strchr(text, '(');
+    if (paren == 0) {
+        return asmExpression(text, &operand->symbol, &operand->value);
+    }
+    if (paren != text) {
+        char *displacement = strndup(text, paren - text);
+        int valid = asmExpression(displacement, &operand->symbol, &operand->value);
+        free(displacement);
+        if (!valid) {
+            return 0;
+        }
+    }
+    char *close = strchr(paren, ')');
+    if (close == 0) {
+        return 0;
+    }
+    char *inside = strndup(paren + 1, close - paren - 1);
+    char *parts[3] = {inside, 0, 0};
+    for (int i = 1; i < 3; i++) {
+        char *comma = parts[i - 1] != 0 ? strchr(parts[i - 1], ',') : 0;
+        if (comma != 0) {
+            *comma = 0;
+            parts[i] = comma + 1;
+        }
+    }
+    int valid = 1;
+    int size;
+    for (int i = 0; i < 2; i++) {
+        char *name = parts[i];
+        while (name != 0 && isspace(*name)) {
+            name++;
+        }
+        if (name == 0 || *name == 0) {
+            continue;
+        }
+        int reg = strcmp(name, "%rip") == 0 && i == 0 ? ASM_RIP : asmRegister(name + 1, &size);
+        valid = valid && *name == '%' && reg >= 0 && (reg == ASM_RIP || size == 8);
+        if (i == 0) {
+            operand->base = reg;
+        } else {
+            operand->index = reg;
+        }
+    }
+    if (parts[2] != 0) {
+        operand->scale = atoi(parts[2]);
+        valid = valid && (operand->scale == 1 || operand->scale == 2 || operand->scale == 4 || operand->scale == 8);
+    }
+    free(inside);
+    return valid;
+}
+
+/* returns the encoding of a condition code suffix, or -1 */
+int asmCondition(char *suffix) {
+    for (int cc = 0; cc < 16; cc++) {
+        for (int i = 0; i < 3 && asm_conditions[cc][i] != 0; i++) {
+            if (strcmp(suffix, asm_conditions[cc][i]) == 0) {
+                return cc;
+            }
+        }
+    }
+    return -1;
+}
+
+int asmFitsInt8(int64_t value) {
+    return value >= -128 && value <= 127;
+}
+
+int asmFitsInt32(int64_t value) {
+    return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+void asmByte(struct asm_encoding *enc, int byte) {
+    enc->bytes[enc->length++] = byte;
+}
+
+void asmWord(struct asm_encoding *enc, int64_t value, int size) {
+    for (int i = 0; i < size; i++) {
+        asmByte(enc, (value >> (8 * i)) & 0xff);
+    }
+}
+
+/* appends a 32-bit field holding value, or value plus the address of symbol */
+void asmField32(struct asm_encoding *enc, char *symbol, int64_t value, enum asm_fixup_kind kind) {
+    if (symbol != 0) {
+        struct asm_fixup *fixup = &enc->fixups[enc->fixup_count++];
+        fixup->offset = enc->length;
+        fixup->kind = kind;
+        fixup->symbol = symbol;
+        fixup->addend = value;
+        value = 0;
+    }
+    asmWord(enc, value, 4);
+}
+
+/* nonzero if the operand is %spl, %bpl, %sil or %dil, which only exist with a REX prefix */
+int asmNeedsRex(struct asm_operand *operand) {
+    return operand != 0 && operand->kind == ASM_REGISTER && operand->size == 1
+        && operand->reg >= 4 && operand->reg < 8;
+}
+
+/* appends the REX prefix for a 64-bit operand size, extended registers or byte registers */
+void asmRex(struct asm_encoding *enc, int w, int reg, struct asm_operand *rm, struct asm_operand *other) {
+    int rex = (w ? 8 : 0) | (reg >= 8 ? 4 : 0);
+    if (rm->kind == ASM_REGISTER) {
+        rex |= rm->reg >= 8 ? 1 : 0;
+    } else if (rm->kind == ASM_MEMORY) {
+        rex |= rm->index >= 8 ? 2 : 0;
+        rex |= rm->base >= 8 && rm->base != ASM_RIP ? 1 : 0;
+    }
+    if (rex != 0 || asmNeedsRex(rm) || asmNeedsRex(other)) {
+        asmByte(enc, 0x40 | rex);
+    }
+}
+
+/* appends the ModRM byte, the SIB byte and the displacement addressing rm */
+void asmModRM(struct asm_encoding *enc, int reg, struct asm_operand *rm) {
+    reg &= 7;
+    if (rm->kind == ASM_REGISTER) {
+        asmByte(enc, 0xc0 | reg << 3 | (rm->reg & 7));
+        return;
+    }
+    int scale = rm->scale == 8 ? 3 : rm->scale == 4 ? 2 : rm->scale == 2 ? 1 : 0;
+    int index = rm->index < 0 ? 4 : rm->index & 7;
+    if (rm->base == ASM_RIP) {
+        asmByte(enc, reg << 3 | 5);
+        asmField32(enc, rm->symbol, rm->value, ASM_PC32);
+    } else if (rm->base < 0) {
+        //an absolute address, through a SIB byte without a base
+        asmByte(enc, reg << 3 | 4);
+        asmByte(enc, scale << 6 | index << 3 | 5);
+        asmField32(enc, rm->symbol, rm->value, ASM_ABS32S);
+    } else {
+        int mod = rm->symbol != 0 ? 2 : rm->value == 0 && (rm->base & 7) != 5 ? 0 : asmFitsInt8(rm->value) ? 1 : 2;
+        int sib = rm->index >= 0 || (rm->base & 7) == 4;
+        asmByte(enc, mod << 6 | reg << 3 | (sib ? 4 : rm->base & 7));
+        if (sib) {
+            asmByte(enc, scale << 6 | index << 3 | (rm->base & 7));
+        }
+        if (mod == 1) {
+            asmByte(enc, rm->value & 0xff);
+        } else if (mod == 2) {
+            asmField32(enc, rm->symbol, rm->value, ASM_ABS32S);
+        }
+    }
+}
+
+/* appends an instruction with a ModRM operand: REX, opcode bytes, then the addressing */
+void asmOpModRM(struct asm_encoding *enc, int w, char *opcode, int opcode_length, int reg,
+        struct asm_operand *rm, struct asm_operand *other) {
+    //a mandatory 0x66 or 0xf2 prefix would go before the REX, none of the instructions here has one
+    asmRex(enc, w, reg, rm, other);
+    for (int i = 0; i < opcode_length; i++) {
+        asmByte(enc, (unsigned char) opcode[i]);
+    }
+    asmModRM(enc, reg, rm);
+}
+
+/* appends an immediate of the given size, 8 or 32 bits */
+void asmImmediate(struct asm_encoding *enc, struct asm_operand *imm, int size) {
+    if (size == 1) {
+        asmByte(enc, imm->value & 0xff);
+    } else {
+        asmField32(enc, imm->symbol, imm->value, ASM_ABS32S);
+    }
+}
+
+/* nonzero if an immediate operand can be encoded in a sign-extended byte */
+int asmSmallImmediate(struct asm_operand *imm) {
+    return imm->symbol == 0 && asmFitsInt8(imm->value);
+}
+
+/* encodes the SSE2 instructions of vector loops: a mandatory prefix, the REX, 0x0f and the opcode,
+   with the %xmm register in the reg field. Returns nonzero if the instruction is not one of them */
+int asmEncodeVector(struct asm_instruction *inst, struct asm_encoding *enc) {
+    static struct {
+        char *name;
+        int prefix;
+        int opcode;
+    } vector[] = {
+        {"paddq", 0x66, 0xd4}, {"psubq", 0x66, 0xfb}, {"pand", 0x66, 0xdb}, {"por", 0x66, 0xeb},
+        {"pxor", 0x66, 0xef}, {"pcmpeqd", 0x66, 0x76}, {"punpcklqdq", 0x66, 0x6c}, {"pshufd", 0x66, 0x70},
+        {"movdqa", 0x66, 0x6f}, {"movdqu", 0xf3, 0x6f}
+    };
+    int count = inst->count;
+    struct asm_operand *src = &inst->operands[count == 3 ? 1 : 0];
+    struct asm_operand *dst = &inst->operands[count > 0 ? count - 1 : 0];
+    if (strcmp(inst->mnemonic, "movq") == 0 && count == 2 && src->kind == ASM_REGISTER && dst->kind == ASM_REGISTER) {
+        //between a general register and the low quadword of an %xmm register
+        int to_vector = dst->size == 16;
+        struct asm_operand *general = to_vector ? src : dst;
+        struct asm_operand *xmm = to_vector ? dst : src;
+        if (general->size != 8 || xmm->size != 16) {
+            return 1;
+        }
+        asmByte(enc, 0x66);
+        asmRex(enc, 1, xmm->reg, general, 0);
+        asmByte(enc, 0x0f);
+        asmByte(enc, to_vector ? 0x6e : 0x7e);
+        asmModRM(enc, xmm->reg, general);
+        return 0;
+    }
+    for (int i = 0; i < sizeof(vector) / sizeof(vector[0]); i++) {
+        if (strcmp(inst->mnemonic, vector[i].name) != 0 || (count != 2 && !(count == 3 && vector[i].opcode == 0x70))) {
+            continue;
+        }
+        //a move to memory is the store form, with the source in the reg field
+        int store = dst->kind == ASM_MEMORY && vector[i].opcode == 0x6f;
+        struct asm_operand *reg = store ? src : dst;
+        struct asm_operand *rm = store ? dst : src;
+        if (reg->kind != ASM_REGISTER || reg->size != 16 || rm->kind == ASM_IMMEDIATE
+                || (rm->kind == ASM_REGISTER && rm->size != 16)) {
+            return 1;
+        }
+        asmByte(enc, vector[i].prefix);
+        asmRex(enc, 0, reg->reg, rm, 0);
+        asmByte(enc, 0x0f);
+        asmByte(enc, store ? 0x7f : vector[i].opcode);
+        asmModRM(enc, reg->reg, rm);
+        if (count == 3) {
+            if (inst->operands[0].kind != ASM_IMMEDIATE || inst->operands[0].symbol != 0) {
+                return 1;
+            }
+            asmByte(enc, inst->operands[0].value & 0xff);
+        }
+        return 0;
+    }
+    return 1;
+}
+
+/* encodes an instruction; a relaxable jump is encoded short unless long_jump is set. Returns
+   nonzero if the instruction is not one this encoder knows */
+int asmEncode(struct asm_instruction *inst, struct asm_encoding *enc, int long_jump) {
+    static char *alu[8] = {"add", "or", "adc", "sbb", "and", "sub", "xor", "cmp"};
+    static char *unary[8] = {0, 0, "not", "neg", "mul", "imul", "div", "idiv"};
+    static char *shifts[8] = {"rol", "ror", "rcl", "rcr", "shl", "shr", "sal", "sar"};
+    enc->length = 0;
+    enc->fixup_count = 0;
+    char name[16];
+    strcpy(name, inst->mnemonic);
+    int count = inst->count;
+    struct asm_operand *src = &inst->operands[0];
+    struct asm_operand *dst = &inst->operands[count > 0 ? count - 1 : 0];
+    //the operand size is 64 bits unless a register says otherwise
+    int w = 1;
+    for (int i = 0; i < count; i++) {
+        if (inst->operands[i].kind == ASM_REGISTER && inst->operands[i].size == 16) {
+            return asmEncodeVector(inst, enc);
+        }
+        if (inst->operands[i].kind == ASM_REGISTER && inst->operands[i].size != 8) {
+            w = 0;
+        }
+    }
+    size_t length = strlen(name);
+    if (length > 1 && name[length - 1] == 'q' && strcmp(name, "movabsq") != 0) {
+        //movq is mov, addq is add, ... but movzbq and movslq keep their suffix
+        if (strcmp(name, "movzbq") != 0 && strcmp(name, "movslq") != 0) {
+            name[length - 1] = 0;
+            w = 1;
+        }
+    }
+    for (int n = 0; n < 8; n++) {
+        if (strcmp(name, alu[n]) == 0 && count == 2) {
+            if (src->kind == ASM_IMMEDIATE && !asmSmallImmediate(src) && dst->kind == ASM_REGISTER && dst->reg == 0) {
+                //%rax has a form without a ModRM byte
+                asmRex(enc, w, 0, dst, 0);
+                asmByte(enc, 8 * n + 5);
+                asmImmediate(enc, src, 4);
+            } else if (src->kind == ASM_IMMEDIATE) {
+                int small = asmSmallImmediate(src);
+                asmOpModRM(enc, w, small ? "\x83" : "\x81", 1, n, dst, 0);
+                asmImmediate(enc, src, small ? 1 : 4);
+            } else if (src->kind == ASM_REGISTER) {
+                char opcode = 8 * n + 1;
+                asmOpModRM(enc, w, &opcode, 1, src->reg, dst, 0);
+            } else if (dst->kind == ASM_REGISTER) {
+                char opcode = 8 * n + 3;
+                asmOpModRM(enc, w, &opcode, 1, dst->reg, src, 0);
+            } else {
+                return 1;
+            }
+            return 0;
+        }
+        if (unary[n] != 0 && strcmp(name, unary[n]) == 0 && count == 1 && src->kind != ASM_IMMEDIATE) {
+            asmOpModRM(enc, w, "\xf7", 1, n, src, 0);
+            return 0;
+        }
+        if (strcmp(name, shifts[n]) == 0 && (count == 1 || count == 2) && dst->kind != ASM_IMMEDIATE) {
+            if (count == 1 || (src->kind == ASM_IMMEDIATE && src->symbol == 0 && src->value == 1)) {
+                asmOpModRM(enc, w, "\xd1", 1, n, dst, 0);
+            } else if (src->kind == ASM_IMMEDIATE && src->symbol == 0) {
+                asmOpModRM(enc, w, "\xc1", 1, n, dst, 0);
+                asmByte(enc, src->value & 0xff);
+            } else if (src->kind == ASM_REGISTER && src->reg == 1 && src->size == 1) {
+                //the count in %cl says nothing of the operand size
+                asmOpModRM(enc, dst->kind == ASM_REGISTER ? dst->size == 8 : 1, "\xd3", 1, n, dst, 0);
+            } else {
+                return 1;
+            }
+            return 0;
+        }
+    }
+    if (strcmp(name, "mov") == 0 && count == 2) {
+        if (src->kind == ASM_IMMEDIATE && dst->kind == ASM_REGISTER && w && src->symbol == 0
+                && !asmFitsInt32(src->value)) {
+            //a value that does not sign extend from 32 bits needs the 64-bit immediate
+            asmRex(enc, 1, 0, dst, 0);
+            asmByte(enc, 0xb8 + (dst->reg & 7));
+            asmWord(enc, src->value, 8);
+        } else if (src->kind == ASM_IMMEDIATE) {
+            if (src->symbol == 0 && !asmFitsInt32(src->value)) {
+                return 1;
+            }
+            asmOpModRM(enc, w, "\xc7", 1, 0, dst, 0);
+            asmImmediate(enc, src, 4);
+        } else if (src->kind == ASM_REGISTER) {
+            asmOpModRM(enc, w, "\x89", 1, src->reg, dst, 0);
+        } else if (dst->kind == ASM_REGISTER) {
+            asmOpModRM(enc, w, "\x8b", 1, dst->reg, src, 0);
+        } else {
+            return 1;
+        }
+        return 0;
+    }
+    if ((strcmp(name, "movabs") == 0 || strcmp(name, "movabsq") == 0) && count == 2
+            && src->kind == ASM_IMMEDIATE && src->symbol == 0 && dst->kind == ASM_REGISTER) {
+        asmRex(enc, 1, 0, dst, 0);
+        asmByte(enc, 0xb8 + (dst->reg & 7));
+        asmWord(enc, src->value, 8);
+        return 0;
+    }
+    if (strcmp(name, "movb") == 0 && count == 2 && dst->kind == ASM_MEMORY) {
+        //stores of char and boolean elements and fields
+        if (src->kind == ASM_IMMEDIATE && src->symbol == 0) {
+            asmOpModRM(enc, 0, "\xc6", 1, 0, dst, 0);
+            asmByte(enc, src->value & 0xff);
+        } else if (src->kind == ASM_REGISTER && src->size == 1) {
+            asmOpModRM(enc, 0, "\x88", 1, src->reg, dst, src);
+        } else {
+            return 1;
+        }
+        return 0;
+    }
+    if ((strcmp(name, "bt") == 0 || strcmp(name, "bts") == 0 || strcmp(name, "btr") == 0) && count == 2
+            && src->kind == ASM_REGISTER && dst->kind != ASM_IMMEDIATE) {
+        char opcode[2] = {0x0f, name[2] == 0 ? 0xa3 : name[2] == 's' ? 0xab : 0xb3};
+        asmOpModRM(enc, w, opcode, 2, src->reg, dst, 0);
+        return 0;
+    }
+    if (strcmp(name, "movzbq") == 0 && count == 2 && dst->kind == ASM_REGISTER && src->kind != ASM_IMMEDIATE) {
+        asmOpModRM(enc, 1, "\x0f\xb6", 2, dst->reg, src, 0);
+        return 0;
+    }
+    if (strcmp(name, "movslq") == 0 && count == 2 && dst->kind == ASM_REGISTER && src->kind != ASM_IMMEDIATE) {
+        asmOpModRM(enc, 1, "\x63", 1, dst->reg, src, 0);
+        return 0;
+    }
+    if (strcmp(name, "lea") == 0 && count == 2 && src->kind == ASM_MEMORY && dst->kind == ASM_REGISTER) {
+        asmOpModRM(enc, w, "\x8d", 1, dst->reg, src, 0);
+        return 0;
+    }
+    if (strcmp(name, "test") == 0 && count == 2) {
+        if (src->kind == ASM_IMMEDIATE && dst->kind == ASM_REGISTER && dst->reg == 0) {
+            asmRex(enc, w, 0, dst, 0);
+            asmByte(enc, 0xa9);
+            asmImmediate(enc, src, 4);
+        } else if (src->kind == ASM_IMMEDIATE) {
+            asmOpModRM(enc, w, "\xf7", 1, 0, dst, 0);
+            asmImmediate(enc, src, 4);
+        } else if (src->kind == ASM_REGISTER) {
+            asmOpModRM(enc, w, "\x85", 1, src->reg, dst, 0);
+        } else if (dst->kind == ASM_REGISTER) {
+            asmOpModRM(enc, w, "\x85", 1, dst->reg, src, 0);
+        } else {
+            return 1;
+        }
+        return 0;
+    }
+    if (strcmp(name, "imul") == 0 && (count == 2 || count == 3) && dst->kind == ASM_REGISTER) {
+        if (src->kind == ASM_IMMEDIATE) {
+            //the source is the middle operand, or the destination itself
+            struct asm_operand *factor = count == 3 ? &inst->operands[1] : dst;
+            int small = asmSmallImmediate(src);
+            asmOpModRM(enc, w, small ? "\x6b" : "\x69", 1, dst->reg, factor, 0);
+            asmImmediate(enc, src, small ? 1 : 4);
+        } else if (count == 2) {
+            asmOpModRM(enc, w, "\x0f\xaf", 2, dst->reg, src, 0);
+        } else {
+            return 1;
+        }
+        return 0;
+    }
+    if ((strcmp(name, "inc") == 0 || strcmp(name, "dec") == 0) && count == 1 && src->kind != ASM_IMMEDIATE) {
+        asmOpModRM(enc, w, "\xff", 1, name[0] == 'd', src, 0);
+        return 0;
+    }
+    if ((strcmp(name, "push") == 0 || strcmp(name, "pop") == 0) && count == 1) {
+        int push = name[1] == 'u';
+        if (src->kind == ASM_REGISTER && src->size == 8) {
+            if (src->reg >= 8) {
+                asmByte(enc, 0x41);
             }
-            swithead = swithead->next;
-            while(!isCase() && !isBreak() && !isRightBlock()){
-                statement(1);
+            asmByte(enc, (push ? 0x50 : 0x58) + (src->reg & 7));
+        } else if (src->kind == ASM_IMMEDIATE && push) {
+            int small = asmSmallImmediate(src);
+            asmByte(enc, small ? 0x6a : 0x68);
+            asmImmediate(enc, src, small ? 1 : 4);
+        } else if (src->kind == ASM_MEMORY) {
+            asmOpModRM(enc, 0, push ? "\xff" : "\x8f", 1, push ? 6 : 0, src, 0);
+        } else {
+            return 1;
+        }
+        return 0;
+    }
+    if (strcmp(name, "jmp") == 0 || strcmp(name, "call") == 0) {
+        int call = name[0] == 'c';
+        if (count != 1) {
+            return 1;
+        }
+        if (src->indirect) {
+            if (src->kind == ASM_IMMEDIATE) {
+                return 1;
             }
-            if(isBreak()){
-                printf("    jmp ESW%d\n", locswitchnum);
-                consume();
+            asmOpModRM(enc, 0, "\xff", 1, call ? 2 : 4, src, 0);
+        } else if (src->kind == ASM_MEMORY && src->base < 0 && src->index < 0 && src->symbol != 0) {
+            if (!call && !long_jump) {
+                asmByte(enc, 0xeb);
+                enc->fixups[enc->fixup_count++] = (struct asm_fixup) {enc->length, ASM_REL8, src->symbol, src->value};
+                asmByte(enc, 0);
+            } else {
+                asmByte(enc, call ? 0xe8 : 0xe9);
+                asmField32(enc, src->symbol, src->value, call ? ASM_CALL32 : ASM_PC32);
             }
+        } else {
+            return 1;
         }
-        return 1;
-    } else if (isPlay()) {
-        consume();
-        if(!isLeft()) {
-            error(PAREN_MISMATCH, "Missing parenthesis after play\n");
+        return 0;
+    }
+    if (name[0] == 'j' && asmCondition(name + 1) >= 0) {
+        int cc = asmCondition(name + 1);
+        if (count != 1 || src->kind != ASM_MEMORY || src->indirect || src->base >= 0 || src->index >= 0
+                || src->symbol == 0) {
+            return 1;
+        }
+        if (!long_jump) {
+            asmByte(enc, 0x70 + cc);
+            enc->fixups[enc->fixup_count++] = (struct asm_fixup) {enc->length, ASM_REL8, src->symbol, src->value};
+            asmByte(enc, 0);
+        } else {
+            asmByte(enc, 0x0f);
+            asmByte(enc, 0x80 + cc);
+            asmField32(enc, src->symbol, src->value, ASM_PC32);
+        }
+        return 0;
+    }
+    if (strncmp(name, "set", 3) == 0 && asmCondition(name + 3) >= 0 && count == 1
+            && src->kind != ASM_IMMEDIATE && (src->kind == ASM_MEMORY || src->size == 1)) {
+        char opcode[2] = {0x0f, 0x90 + asmCondition(name + 3)};
+        asmOpModRM(enc, 0, opcode, 2, 0, src, 0);
+        return 0;
+    }
+    if (strncmp(name, "cmov", 4) == 0 && asmCondition(name + 4) >= 0 && count == 2
+            && src->kind != ASM_IMMEDIATE && dst->kind == ASM_REGISTER) {
+        char opcode[2] = {0x0f, 0x40 + asmCondition(name + 4)};
+        asmOpModRM(enc, w, opcode, 2, dst->reg, src, 0);
+        return 0;
+    }
+    static struct {
+        char *name;
+        char *bytes;
+        int length;
+    } fixed[] = {
+        {"ret", "\xc3", 1}, {"leave", "\xc9", 1}, {"rdtsc", "\x0f\x31", 2}, {"cqo", "\x48\x99", 2},
+        {"cltq", "\x48\x98", 2}, {"nop", "\x90", 1}
+    };
+    for (int i = 0; i < sizeof(fixed) / sizeof(fixed[0]); i++) {
+        if (strcmp(name, fixed[i].name) == 0 && count == 0) {
+            memcpy(enc->bytes, fixed[i].bytes, fixed[i].length);
+            enc->length = fixed[i].length;
+            return 0;
         }
+    }
+    return 1;
+}
 
-        consume();
-        /*frequency*/
-        expression(perform);
-        if(perform != 0) {
-            printf("	mov %%rax, %%rdi\n");
+struct asm_item *asmAddItem(enum asm_item_kind kind, int section, int line) {
+    asm_items = realloc(asm_items, (asm_item_count + 1) * sizeof(struct asm_item));
+    struct asm_item *item = &asm_items[asm_item_count++];
+    memset(item, 0, sizeof(struct asm_item));
+    item->kind = kind;
+    item->section = section;
+    item->line = line;
+    return item;
+}
+
+/* parses the contents of a .string into bytes, with its terminating zero */
+void asmString(char *text, int section, int line) {
+    char *quote = strchr(text, '"');
+    if (quote == 0) {
+        asmError(line, "expected a string", text);
+        return;
+    }
+    unsigned char *bytes = malloc(strlen(quote) + 1);
+    int size = 0;
+    char *ch = quote + 1;
+    while (*ch != 0 && *ch != '"') {
+        if (*ch != '\\') {
+            bytes[size++] = *ch++;
+            continue;
+        }
+        ch++;
+        if (*ch >= '0' && *ch <= '7') {
+            int value = 0;
+            for (int digits = 0; digits < 3 && *ch >= '0' && *ch <= '7'; digits++) {
+                value = 8 * value + *ch++ - '0';
+            }
+            bytes[size++] = value;
+            continue;
         }
+        bytes[size++] = *ch == 'n' ? '\n' : *ch == 't' ? '\t' : *ch == 'a' ? '\a' : *ch;
+        if (*ch != 0) {
+            ch++;
+        }
+    }
+    bytes[size++] = 0;
+    struct asm_item *item = asmAddItem(ASM_BYTES, section, line);
+    item->bytes = bytes;
+    item->size = size;
+}
 
-        if(!isComma()) {
-            error(GENERAL, "Missing comma after frequency\n");
+/* adds the values of a .quad or .byte line. Numbers go into one block of bytes, so that a table
+   takes an item per line; a .quad holding a symbol takes an item per value, which is relocated */
+void asmData(char *args, int size, int section, int line) {
+    int count = 1;
+    for (char *ch = args; *ch != 0; ch++) {
+        count += *ch == ',';
+    }
+    unsigned char *bytes = calloc(count * size + 1, 1);
+    int length = 0;
+    int symbols = 0;
+    char *value_save = 0;
+    for (char *value = strtok_r(args, ",", &value_save); value != 0; value = strtok_r(0, ",", &value_save)) {
+        struct asm_item item = {0};
+        if (!asmExpression(value, &item.symbol, &item.value) || (item.symbol != 0 && size != 8)) {
+            asmError(line, "bad data value", value);
+        } else if (item.symbol != 0 || symbols) {
+            if (length > 0) {
+                struct asm_item *block = asmAddItem(ASM_BYTES, section, line);
+                block->bytes = bytes;
+                block->size = length;
+                bytes = calloc(count * size + 1, 1);
+                length = 0;
+            }
+            struct asm_item *quad = asmAddItem(ASM_QUAD, section, line);
+            quad->size = 8;
+            quad->symbol = item.symbol;
+            quad->value = item.value;
+            symbols = 1;
+        } else {
+            for (int i = 0; i < size; i++) {
+                bytes[length++] = ((uint64_t) item.value >> (8 * i)) & 0xff;
+            }
         }
+    }
+    if (length > 0) {
+        struct asm_item *block = asmAddItem(ASM_BYTES, section, line);
+        block->bytes = bytes;
+        block->size = length;
+    } else {
+        free(bytes);
+    }
+}
 
-        consume();
-        /*length*/
-        expression(perform);
-        if(perform != 0) {
-            printf("	mov %%rax, %%rsi\n");
+/* parses the assembly into items of their sections */
+void asmParse(char *text) {
+    int section = asmSection(".text");
+    int section_stack[8];
+    int stack_depth = 0;
+    int line_num = 0;
+    for (char *line = text, *next; line != 0; line = next) {
+        next = strchr(line, '\n');
+        if (next != 0) {
+            *next++ = 0;
         }
-        if(!isComma()) {
-            error(GENERAL, "Missing comma after frequency\n");
+        line_num++;
+        char *start = line;
+        while (isspace(*start)) {
+            start++;
         }
-
-        consume();
-        /*repetitions*/
-        expression(perform);
-        if(perform != 0) {
-            printf("	mov %%rax, %%rdx\n");
+        char *end = start + strlen(start);
+        while (end > start && isspace(end[-1])) {
+            *--end = 0;
         }
-        if(!isRight()) {
-            error(GENERAL, "Missing right parenthesis after play\n");
+        if (*start == 0 || strncmp(start, "//", 2) == 0 || *start == '#') {
+            continue;
         }
-        if(perform != 0) {
-            printf("	call play\n");
+        if (end[-1] == ':') {
+            end[-1] = 0;
+            struct asm_item *item = asmAddItem(ASM_LABEL, section, line_num);
+            item->label = asmSymbol(start);
+            if (item->label->section >= 0) {
+                asmError(line_num, "label defined twice", start);
+            }
+            item->label->section = section;
+            continue;
         }
-        consume();
-        return 1;
-    } else if (isBreak()){
-        if(perform == 0){
-         consume();
+        char *args = start;
+        while (*args != 0 && !isspace(*args)) {
+            args++;
         }
-        else{
-         printf("    jmp while_end_%u\n", globalbreakcount);
-         consume();
+        if (*args != 0) {
+            *args++ = 0;
+            while (isspace(*args)) {
+                args++;
+            }
         }
-        return 1;
-    } else if (isContinue()){
-        if(perform == 0){
-         consume();
+        if (*start == '.') {
+            if (strcmp(start, ".text") == 0 || strcmp(start, ".data") == 0) {
+                section = asmSection(start);
+            } else if (strcmp(start, ".section") == 0 || strcmp(start, ".pushsection") == 0) {
+                if (strcmp(start, ".pushsection") == 0 && stack_depth < 8) {
+                    section_stack[stack_depth++] = section;
+                }
+                char *comma = strchr(args, ',');
+                if (comma != 0) {
+                    *comma = 0;
+                }
+                section = asmSection(args);
+            } else if (strcmp(start, ".popsection") == 0) {
+                if (stack_depth == 0) {
+                    asmError(line_num, "no section to pop", start);
+                } else {
+                    section = section_stack[--stack_depth];
+                }
+            } else if (strcmp(start, ".global") == 0 || strcmp(start, ".globl") == 0) {
+                asmSymbol(args)->global = 1;
+            } else if (strcmp(start, ".quad") == 0 || strcmp(start, ".byte") == 0) {
+                asmData(args, start[1] == 'b' ? 1 : 8, section, line_num);
+            } else if (strcmp(start, ".string") == 0) {
+                asmString(args, section, line_num);
+            } else if (strcmp(start, ".zero") == 0) {
+                struct asm_item *item = asmAddItem(ASM_BYTES, section, line_num);
+                item->size = atoi(args);
+                item->bytes = calloc(item->size + 1, 1);
+            } else if (strcmp(start, ".align") == 0 || strcmp(start, ".p2align") == 0) {
+                struct asm_item *item = asmAddItem(ASM_ALIGN, section, line_num);
+                item->value = start[1] == 'p' ? 1 << atoi(args) : atoi(args);
+                if (item->value > asm_sections[section].align) {
+                    asm_sections[section].align = item->value;
+                }
+            } else {
+                asmError(line_num, "unknown directive", start);
+            }
+            continue;
         }
-        else{
-         printf("    jmp while_begin_%u\n", globalbreakcount);
-         consume();
+        struct asm_item *item = asmAddItem(ASM_INSTRUCTION, section, line_num);
+        struct asm_instruction *inst = &item->instruction;
+        if (strlen(start) >= sizeof(inst->mnemonic)) {
+            asmError(line_num, "unknown instruction", start);
+            continue;
+        }
+        strcpy(inst->mnemonic, start);
+        //operands are separated by commas outside parentheses
+        int depth = 0;
+        char *operand = args;
+        for (char *ch = args; *args != 0; ch++) {
+            if (*ch == '(') {
+                depth++;
+            } else if (*ch == ')') {
+                depth--;
+            } else if ((*ch == ',' && depth == 0) || *ch == 0) {
+                int last = *ch == 0;
+                *ch = 0;
+                if (inst->count == 3 || !asmOperand(operand, &inst->operands[inst->count++])) {
+                    asmError(line_num, "bad operand", operand);
+                    break;
+                }
+                if (last) {
+                    break;
+                }
+                operand = ch + 1;
+            }
         }
-        return 1;
-    } else {
-        return 0;
     }
 }
 
-void seq(int perform) {
-    while (statement(perform)) { fflush(stdout); }
+/* nonzero if the instruction is a direct jump, which can be short when its target is near */
+int asmIsJump(struct asm_instruction *inst) {
+    struct asm_operand *target = &inst->operands[0];
+    int jump = strcmp(inst->mnemonic, "jmp") == 0
+        || (inst->mnemonic[0] == 'j' && asmCondition(inst->mnemonic + 1) >= 0);
+    return jump && inst->count == 1 && target->kind == ASM_MEMORY && !target->indirect
+        && target->base < 0 && target->index < 0 && target->symbol != 0;
 }
 
+/* the bytes an alignment adds at the given offset */
+int asmPadding(int offset, int64_t align) {
+    return align > 1 ? (align - offset % align) % align : 0;
+}
 
-void function(void) {
-    if (!isFun()) {
-        error(GENERAL, "Expected fun\n");
-    }
-    consume();
-    if (!isId()) {
-        error(GENERAL, "Invalid function name\n");
-    }
-    char *id = getId();
-    functionNames = realloc(functionNames,(numFunctions + 1) * sizeof(char*));
-    functionNames[numFunctions] = strdup(id);
-    numFunctions++;
-    consume();
-    function_name = id;
-    printf("%s_fun:\n", id);
-    printf("    push %%rbp\n");
-    printf("    mov %%rsp,%%rbp\n");
-    if (!isLeft()) {
-        error(GENERAL, "Expected function parameter declaration\n");
+/* gives every item its offset; returns nonzero if a short jump had to become long */
+int asmLayout(void) {
+    int changed = 0;
+    for (int i = 0; i < asm_section_count; i++) {
+        asm_sections[i].size = 0;
     }
-    consume();
-    beginVarScope();
-    int var_num = 2;
-    while (!isRight()) {
-        if(!isType()) {
-            error(GENERAL, "expected type declaration\n");
-        }
-        char* typeName = current_token->value.id;
-        int whichType = findVarType(typeName);
-        consume();
-        if (!isId()) {
-            error(GENERAL, "Invalid parameter name\n");
+    for (int i = 0; i < asm_item_count; i++) {
+        struct asm_item *item = &asm_items[i];
+        struct asm_section *section = &asm_sections[item->section];
+        item->offset = section->size;
+        if (item->kind == ASM_LABEL) {
+            item->label->offset = item->offset;
+        } else if (item->kind == ASM_ALIGN) {
+            item->size = asmPadding(item->offset, item->value);
+        } else if (item->kind == ASM_INSTRUCTION && item->relaxable) {
+            item->size = item->long_jump ? (strcmp(item->instruction.mnemonic, "jmp") == 0 ? 5 : 6) : 2;
         }
-        char *param_id = getId();
-        consume();
-        setVarNum(param_id, var_num++, whichType);
-        free(param_id);
-        if (isComma()) {
-            consume();
+        section->size += item->size;
+    }
+    for (int i = 0; i < asm_item_count; i++) {
+        struct asm_item *item = &asm_items[i];
+        if (item->kind == ASM_INSTRUCTION && item->relaxable && !item->long_jump) {
+            struct asm_operand *target = &item->instruction.operands[0];
+            int64_t displacement = asmSymbol(target->symbol)->offset + target->value - (item->offset + 2);
+            if (!asmFitsInt8(displacement)) {
+                item->long_jump = 1;
+                changed = 1;
+            }
         }
     }
-    consume();
-    statement(1);
-    printf("%s_end:\n", function_name);
-    endVarScope();
-    printf("    pop %%rbp\n");
-    printf("    ret\n");
+    return changed;
 }
 
-void structDef(void) {
-    if (!isStruct()) {
-        error(GENERAL, "Not a struct\n");
+void asmAddReloc(int section, int offset, int type, struct asm_symbol *symbol, int64_t addend) {
+    struct asm_section *sec = &asm_sections[section];
+    //as with gas, only global and undefined symbols are relocated against by name
+    if (!symbol->global && symbol->section >= 0) {
+        addend += symbol->offset;
+        symbol = asm_sections[symbol->section].symbol;
     }
-    consume();
-    if (!isId()) {
-        error(GENERAL, "Expected struct name\n");
+    sec->relocs = realloc(sec->relocs, (sec->reloc_count + 1) * sizeof(struct asm_reloc));
+    sec->relocs[sec->reloc_count++] = (struct asm_reloc) {offset, type, symbol, addend};
+}
+
+/* fills the sections with the final bytes, resolving the fields that refer to symbols of their own
+   section and recording relocations for the rest */
+void asmEmit(void) {
+    for (int i = 0; i < asm_section_count; i++) {
+        asm_sections[i].bytes = calloc(asm_sections[i].size + 1, 1);
     }
-    char* structName = getId();
-    struct_info = realloc(struct_info, sizeof(struct struct_data) * (struct_count + 1));
-    printf("%s_struct:\n", structName);
-    struct_info[struct_count].id = getTypeId(structName);
-    struct_info[struct_count].data = malloc(sizeof(struct struct_var));
-    struct_info[struct_count].type_count = 0;
-    printf("    push %%r8\n");
-    int count = 0;
-    consume();
-    if (!isLeftBlock()) {
-        error(GENERAL, "Expected struct definition\n");
+    for (int i = 0; i < asm_item_count; i++) {
+        struct asm_item *item = &asm_items[i];
+        unsigned char *out = asm_sections[item->section].bytes + item->offset;
+        if (item->kind == ASM_BYTES) {
+            memcpy(out, item->bytes, item->size);
+        } else if (item->kind == ASM_QUAD) {
+            int64_t value = item->value;
+            if (item->symbol != 0) {
+                asmAddReloc(item->section, item->offset, R_X86_64_64, asmSymbol(item->symbol), value);
+                value = 0;
+            }
+            for (int b = 0; b < 8; b++) {
+                out[b] = (value >> (8 * b)) & 0xff;
+            }
+        } else if (item->kind == ASM_ALIGN) {
+            int executable = asm_sections[item->section].flags & SHF_EXECINSTR;
+            for (int done = 0; done < item->size; ) {
+                int chunk = item->size - done > 9 ? 9 : item->size - done;
+                if (executable) {
+                    memcpy(out + done, asm_nops[chunk - 1], chunk);
+                }
+                done += chunk;
+            }
+        } else if (item->kind == ASM_INSTRUCTION) {
+            struct asm_encoding enc;
+            asmEncode(&item->instruction, &enc, item->long_jump || !item->relaxable);
+            for (int f = 0; f < enc.fixup_count; f++) {
+                struct asm_fixup *fixup = &enc.fixups[f];
+                struct asm_symbol *symbol = asmSymbol(fixup->symbol);
+                int field = item->offset + fixup->offset;
+                //a pc-relative field counts from the end of the instruction
+                int64_t pc_addend = fixup->addend - (enc.length - fixup->offset);
+                int32_t value = 0;
+                if (fixup->kind == ASM_ABS32S) {
+                    asmAddReloc(item->section, field, R_X86_64_32S, symbol, fixup->addend);
+                } else if (symbol->section == item->section) {
+                    value = symbol->offset + pc_addend - item->offset - fixup->offset;
+                } else {
+                    //calls that may leave the object go through the PLT
+                    int external = symbol->global || symbol->section < 0;
+                    asmAddReloc(item->section, field, fixup->kind == ASM_CALL32 && external ? R_X86_64_PLT32
+                            : R_X86_64_PC32, symbol, pc_addend);
+                }
+                if (fixup->kind == ASM_REL8) {
+                    enc.bytes[fixup->offset] = value & 0xff;
+                } else {
+                    memcpy(enc.bytes + fixup->offset, &value, 4);
+                }
+            }
+            memcpy(out, enc.bytes, enc.length);
+        }
     }
-    consume();
-    printf("    movq $8, %%rdi\n");
-    printf("    call malloc\n");
-    printf("    movq %%rax, %%r8\n");
+}
 
-    int selfDefined = 0;
-    while(isType()){
-        printf("    movq %%r8, %%rdi\n");
-        printf("    movq $%d, %%rsi\n", count * 8 + 8);
-        printf("    call realloc\n");
-        printf("    movq %%rax, %%r8\n");
-        char* type_name = current_token->value.id;
-        if(isStructType()) {
-            if(strcmp(structName, type_name) == 0){
-                selfDefined = 1;
-            }
-            printf("    call %s_struct\n", type_name);
-            printf("    movq %%rax, %d(%%r8)\n", count * 8);
+/* appends to a growing buffer and returns the offset the data starts at */
+int asmAppend(unsigned char **buffer, int *size, const void *data, int length, int align) {
+    int start = *size + asmPadding(*size, align);
+    *buffer = realloc(*buffer, start + length);
+    memset(*buffer + *size, 0, start - *size);
+    memcpy(*buffer + start, data, length);
+    *size = start + length;
+    return start;
+}
+
+/* collects the symbols of every bucket, locals first as ELF requires */
+struct asm_symbol **asmSortedSymbols(int *count, int *first_global) {
+    struct asm_symbol **symbols = 0;
+    *count = 0;
+    for (int global = 0; global < 2; global++) {
+        if (global) {
+            *first_global = *count + 1;
         } else {
-            printf("    movq $333, %%rax\n");
-            printf("    movq %%rax, %d(%%r8)\n", count * 8);
-        }
-        consume();
-        //check if pointer
-        while(isMul()){
-            selfDefined = 0;
-            consume();
-        }
-        if(selfDefined){
-            error(GENERAL, "Recursive struct definitions disallowed\n");
-        }
-        if(!isId()){
-            error(GENERAL, "expected identifier after type in struct definition\n");
+            for (int i = 0; i < asm_section_count; i++) {
+                symbols = realloc(symbols, (*count + 1) * sizeof(struct asm_symbol*));
+                symbols[(*count)++] = asm_sections[i].symbol;
+            }
         }
-        char* var_name = current_token->value.id;
-        struct_info[struct_count].type_count++;
-        int _type_count = struct_info[struct_count].type_count;
-        struct_info[struct_count].data = realloc(struct_info[struct_count].data, sizeof(struct struct_var) * (_type_count));
-        struct_info[struct_count].data[_type_count - 1].type = getTypeId(type_name);
-        struct_info[struct_count].data[_type_count - 1].name = var_name; 
-        consume();
-        if (isSemi()) {
-            consume();
+        for (int i = 0; i < ASM_SYMBOL_BUCKETS; i++) {
+            for (struct asm_symbol *symbol = asm_symbols[i]; symbol != 0; symbol = symbol->next) {
+                //undefined symbols are external
+                if ((symbol->global || symbol->section < 0) == global) {
+                    symbols = realloc(symbols, (*count + 1) * sizeof(struct asm_symbol*));
+                    symbols[(*count)++] = symbol;
+                }
+            }
         }
-        count++;
     }
-    printf("    movq %%r8, %%rax\n");
-    printf("    pop %%r8\n");
-    printf("    ret\n");
-    /*for(int i = 0; i < struct_count + 1; i++){
-        fprintf(stderr, "struct %d exists\n", struct_info[i].id);
-        for(int j = 0; j < struct_info[struct_count].type_count; j++){
-            fprintf(stderr, "   %s is type %d\n", struct_info[i].data[j].name, struct_info[i].data[j].type);
+    return symbols;
+}
+
+/* writes the assembled sections as an ELF relocatable object */
+void asmWriteObject(FILE *out) {
+    unsigned char *file = 0;
+    int file_size = 0;
+    Elf64_Ehdr header;
+    memset(&header, 0, sizeof(header));
+    asmAppend(&file, &file_size, &header, sizeof(header), 1);
+    unsigned char *names = 0;
+    int names_size = 0;
+    asmAppend(&names, &names_size, "", 1, 1);
+    unsigned char *strings = 0;
+    int strings_size = 0;
+    asmAppend(&strings, &strings_size, "", 1, 1);
+
+    int symbol_count, first_global;
+    struct asm_symbol **symbols = asmSortedSymbols(&symbol_count, &first_global);
+    Elf64_Sym *symtab = calloc(symbol_count + 1, sizeof(Elf64_Sym));
+    for (int i = 0; i < symbol_count; i++) {
+        struct asm_symbol *symbol = symbols[i];
+        symbol->index = i + 1;
+        Elf64_Sym *sym = &symtab[i + 1];
+        if (symbol->is_section) {
+            sym->st_info = ELF64_ST_INFO(STB_LOCAL, STT_SECTION);
+            sym->st_shndx = symbol->section + 1;
+            continue;
         }
-    }*/
-    if (!isRightBlock()) {
-        error(BRACKET_MISMATCH, "Unexpected token found before struct closed\n");
+        sym->st_name = asmAppend(&strings, &strings_size, symbol->name, strlen(symbol->name) + 1, 1);
+        sym->st_info = ELF64_ST_INFO(symbol->global || symbol->section < 0 ? STB_GLOBAL : STB_LOCAL, STT_NOTYPE);
+        sym->st_shndx = symbol->section < 0 ? SHN_UNDEF : symbol->section + 1;
+        sym->st_value = symbol->section < 0 ? 0 : symbol->offset;
     }
-    struct_count++;
-    consume();
 
+    //the content sections, their relocations, then the symbol and string tables
+    int rela_count = 0;
+    for (int i = 0; i < asm_section_count; i++) {
+        rela_count += asm_sections[i].reloc_count > 0;
+    }
+    int symtab_index = 1 + asm_section_count + rela_count;
+    int section_count = symtab_index + 4;
+    Elf64_Shdr *sections = calloc(section_count, sizeof(Elf64_Shdr));
+    int rela_index = 1 + asm_section_count;
+    for (int i = 0; i < asm_section_count; i++) {
+        struct asm_section *sec = &asm_sections[i];
+        Elf64_Shdr *shdr = &sections[i + 1];
+        shdr->sh_name = asmAppend(&names, &names_size, sec->name, strlen(sec->name) + 1, 1);
+        shdr->sh_type = SHT_PROGBITS;
+        shdr->sh_flags = sec->flags;
+        shdr->sh_addralign = sec->align;
+        shdr->sh_size = sec->size;
+        shdr->sh_offset = asmAppend(&file, &file_size, sec->bytes, sec->size, sec->align);
+        if (sec->reloc_count == 0) {
+            continue;
+        }
+        Elf64_Rela *relas = calloc(sec->reloc_count, sizeof(Elf64_Rela));
+        for (int r = 0; r < sec->reloc_count; r++) {
+            relas[r].r_offset = sec->relocs[r].offset;
+            relas[r].r_info = ELF64_R_INFO(sec->relocs[r].symbol->index, sec->relocs[r].type);
+            relas[r].r_addend = sec->relocs[r].addend;
+        }
+        char *rela_name = cFormat(".rela%s", sec->name);
+        Elf64_Shdr *rela = &sections[rela_index++];
+        rela->sh_name = asmAppend(&names, &names_size, rela_name, strlen(rela_name) + 1, 1);
+        rela->sh_type = SHT_RELA;
+        rela->sh_flags = SHF_INFO_LINK;
+        rela->sh_link = symtab_index;
+        rela->sh_info = i + 1;
+        rela->sh_addralign = 8;
+        rela->sh_entsize = sizeof(Elf64_Rela);
+        rela->sh_size = sec->reloc_count * sizeof(Elf64_Rela);
+        rela->sh_offset = asmAppend(&file, &file_size, relas, rela->sh_size, 8);
+        free(rela_name);
+        free(relas);
+    }
+    Elf64_Shdr *symtab_header = &sections[symtab_index];
+    symtab_header->sh_name = asmAppend(&names, &names_size, ".symtab", 8, 1);
+    symtab_header->sh_type = SHT_SYMTAB;
+    symtab_header->sh_link = symtab_index + 1;
+    symtab_header->sh_info = first_global;
+    symtab_header->sh_addralign = 8;
+    symtab_header->sh_entsize = sizeof(Elf64_Sym);
+    symtab_header->sh_size = (symbol_count + 1) * sizeof(Elf64_Sym);
+    symtab_header->sh_offset = asmAppend(&file, &file_size, symtab, symtab_header->sh_size, 8);
+    Elf64_Shdr *strtab_header = &sections[symtab_index + 1];
+    strtab_header->sh_name = asmAppend(&names, &names_size, ".strtab", 8, 1);
+    strtab_header->sh_type = SHT_STRTAB;
+    strtab_header->sh_addralign = 1;
+    strtab_header->sh_size = strings_size;
+    strtab_header->sh_offset = asmAppend(&file, &file_size, strings, strings_size, 1);
+    //an empty .note.GNU-stack asks for a stack that is not executable
+    Elf64_Shdr *note_header = &sections[symtab_index + 2];
+    note_header->sh_name = asmAppend(&names, &names_size, ".note.GNU-stack", 16, 1);
+    note_header->sh_type = SHT_PROGBITS;
+    note_header->sh_addralign = 1;
+    note_header->sh_offset = file_size;
+    Elf64_Shdr *shstrtab_header = &sections[symtab_index + 3];
+    shstrtab_header->sh_name = asmAppend(&names, &names_size, ".shstrtab", 10, 1);
+    shstrtab_header->sh_type = SHT_STRTAB;
+    shstrtab_header->sh_addralign = 1;
+    shstrtab_header->sh_size = names_size;
+    shstrtab_header->sh_offset = asmAppend(&file, &file_size, names, names_size, 1);
+
+    int section_offset = asmAppend(&file, &file_size, sections, section_count * sizeof(Elf64_Shdr), 8);
+    Elf64_Ehdr *ehdr = (Elf64_Ehdr *) file;
+    memcpy(ehdr->e_ident, ELFMAG, SELFMAG);
+    ehdr->e_ident[EI_CLASS] = ELFCLASS64;
+    ehdr->e_ident[EI_DATA] = ELFDATA2LSB;
+    ehdr->e_ident[EI_VERSION] = EV_CURRENT;
+    ehdr->e_ident[EI_OSABI] = ELFOSABI_SYSV;
+    ehdr->e_type = ET_REL;
+    ehdr->e_machine = EM_X86_64;
+    ehdr->e_version = EV_CURRENT;
+    ehdr->e_shoff = section_offset;
+    ehdr->e_ehsize = sizeof(Elf64_Ehdr);
+    ehdr->e_shentsize = sizeof(Elf64_Shdr);
+    ehdr->e_shnum = section_count;
+    ehdr->e_shstrndx = symtab_index + 3;
+    fwrite(file, 1, file_size, out);
+    free(file);
+    free(names);
+    free(strings);
+    free(symtab);
+    free(symbols);
+    free(sections);
 }
 
-void globalVarDef(void) {
-    if (!isType()) {
-        error(GENERAL, "Expected global variable type declaration\n");
+/* encodes the assembly text into sections; returns nonzero if something could not be encoded */
+int assemble(char *text) {
+    asmParse(text);
+    //instruction sizes do not depend on addresses, except for jumps that may be short
+    for (int i = 0; i < asm_item_count; i++) {
+        struct asm_item *item = &asm_items[i];
+        if (item->kind != ASM_INSTRUCTION) {
+            continue;
+        }
+        struct asm_encoding enc;
+        if (asmEncode(&item->instruction, &enc, 1)) {
+            asmError(item->line, "unknown instruction", item->instruction.mnemonic);
+            continue;
+        }
+        item->size = enc.length;
+        if (asmIsJump(&item->instruction)) {
+            struct asm_symbol *target = asmSymbol(item->instruction.operands[0].symbol);
+            item->relaxable = target->section == item->section;
+        }
     }
-    char* typeName = current_token->value.id;
-    int whichType = findVarType(typeName);
-    int isStruct = isStructType();
-    consume();
-    if (!isId()) {
-        error(GENERAL, "Expected valid identifier\n");
+    while (asmLayout()) {
     }
-    char *id = getId();
-    consume();
-    setVarNum(id, 1, whichType);
-    printf("global_%d:\n", num_global_vars++);
-    if (isEq()) {
-        consume();
-        expression(1);
-        set(id);
-    } else if (isStruct) {
-        printf("    call %s_struct\n", id);
-        set(id);
+    if (asm_errors == 0) {
+        asmEmit();
     }
-    printf("    jmp global_%d\n", num_global_vars);
-    if (isSemi()) {
-        consume();
+    return asm_errors;
+}
+
+/*
+ * The JIT behind --run loads the encoded sections into memory mapped below 2GB,
+ * where the 32 bit absolute addresses of the generated code still reach, and
+ * links them against the running process. Calls to functions of the process
+ * go through jump stubs next to the code, and the one pc-relative load of a
+ * process variable (stdout) reads a copy of it.
+ */
+
+#define JIT_STUB_SIZE 16
+
+static int run_program = 0;
+
+/* adds a symbol to a list of imports unless it is there already; returns its position */
+int jitImport(struct asm_symbol ***imports, int *count, struct asm_symbol *symbol) {
+    for (int i = 0; i < *count; i++) {
+        if ((*imports)[i] == symbol) {
+            return i;
+        }
     }
+    *imports = realloc(*imports, (*count + 1) * sizeof(struct asm_symbol *));
+    (*imports)[*count] = symbol;
+    return (*count)++;
 }
 
-struct token *copyToken(struct token *curr_token) {
-    struct token *copy = malloc(sizeof(struct token));
-    if(curr_token->type == ID || curr_token->type == TYPE_KWD) {
-        copy->value.id = malloc(strlen(curr_token->value.id));
-        strcpy(copy->value.id, curr_token->value.id);
-    } else if(curr_token->type == INTEGER) {
-        copy->value.integer = curr_token->value.integer;
-    } else if(curr_token->type == CHAR) {
-        copy->value.character = curr_token->value.character;
+/* finds a symbol of the running process; atexit is linked statically into p5, so dlsym cannot see it */
+void *jitLookup(void *process, char *name) {
+    if (strcmp(name, "atexit") == 0) {
+        return (void *) atexit;
     }
-    copy->type = curr_token->type;
-    copy->line_num = curr_token->line_num;
-    return copy;
+    void *address = dlsym(process, name);
+    if (address == 0) {
+        fprintf(stderr, "undefined symbol %s\n", name);
+    }
+    return address;
 }
 
-void definePass(void) {
-    current_token = first_token;
-    struct user_operator *current_op = NULL;
-    while(current_token->type != END) { //look through whole list of tokens
-        //handle define statements
-        if(current_token->type == DEFINE_KWD) {
-            //move to next token
-            current_token = current_token->next;
-            
-            //next token should be a user operator
-            if(current_token->type != USER_OP) {
-                error(GENERAL, "invalid define statement");
-            }
-            //check if the user operator is a valid symbol
-            if(!isupper(current_token->value.user_op)) {
-                error(GENERAL, "invalid user operator symbol");
-            }
-            
-            //create new user operator
-            struct user_operator *operator = calloc(1, sizeof(struct user_operator));
-            operator->symbol = current_token->value.user_op;
-            operator->var1 = NULL;
-            operator->var2 = NULL;
-            //add to list of user operators
-            if(user_ops == NULL) { //no first link in linked list
-                user_ops = operator;
-                current_op = operator;
-            } else { //add links appropriately
-                current_op->next = operator;
-                current_op = operator;
+size_t jitPages(size_t size, size_t page) {
+    return (size + page - 1) / page * page;
+}
+
+/* links the assembled sections into memory and calls main; returns its exit status */
+int jitRun(void) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    struct asm_symbol **stubs = 0;
+    struct asm_symbol **copies = 0;
+    int stub_count = 0;
+    int copy_count = 0;
+    for (int i = 0; i < asm_section_count; i++) {
+        for (int j = 0; j < asm_sections[i].reloc_count; j++) {
+            struct asm_reloc *reloc = &asm_sections[i].relocs[j];
+            if (reloc->symbol->section >= 0) {
+                continue;
             }
-            operator->next = NULL;
-            
-            //get type of first variable
-            current_token = current_token->next;
-            if(current_token->type != TYPE_KWD) {
-                error(GENERAL, "no type specified for first variable in define statement");
-            } else {
-                operator->type1 = getTypeId(current_token->value.id);
+            if (reloc->type == R_X86_64_PLT32) {
+                jitImport(&stubs, &stub_count, reloc->symbol);
+            } else if (reloc->type == R_X86_64_PC32) {
+                jitImport(&copies, &copy_count, reloc->symbol);
             }
-
-            //get type of second variable
-            current_token = current_token->next; 
-            if(current_token->type != TYPE_KWD) {
-                error(GENERAL, "no type specified for first variable in define statement");
+        }
+    }
+    //every section starts on its own page so that it gets its own protection
+    size_t offsets[ASM_MAX_SECTIONS];
+    size_t size = 0;
+    for (int i = 0; i < asm_section_count; i++) {
+        offsets[i] = size;
+        size += jitPages(asm_sections[i].size, page);
+    }
+    size_t stub_offset = size;
+    size += jitPages(stub_count * JIT_STUB_SIZE, page);
+    size_t copy_offset = size;
+    size += jitPages(copy_count * 8, page);
+    unsigned char *base = mmap(0, size ? size : page, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+    if (base == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    void *process = dlopen(0, RTLD_NOW);
+    int failed = 0;
+    for (int i = 0; i < asm_section_count; i++) {
+        memcpy(base + offsets[i], asm_sections[i].bytes, asm_sections[i].size);
+    }
+    //jmp *0(%rip) followed by the address
+    for (int i = 0; i < stub_count; i++) {
+        unsigned char *stub = base + stub_offset + i * JIT_STUB_SIZE;
+        void *address = jitLookup(process, stubs[i]->name);
+        failed |= address == 0;
+        memcpy(stub, "\xff\x25\0\0\0\0", 6);
+        memcpy(stub + 6, &address, 8);
+    }
+    for (int i = 0; i < copy_count; i++) {
+        void *address = jitLookup(process, copies[i]->name);
+        if (address == 0) {
+            failed = 1;
+            continue;
+        }
+        memcpy(base + copy_offset + i * 8, address, 8);
+    }
+    for (int i = 0; i < asm_section_count && !failed; i++) {
+        for (int j = 0; j < asm_sections[i].reloc_count; j++) {
+            struct asm_reloc *reloc = &asm_sections[i].relocs[j];
+            struct asm_symbol *symbol = reloc->symbol;
+            unsigned char *place = base + offsets[i] + reloc->offset;
+            int64_t target;
+            if (symbol->section >= 0) {
+                target = (int64_t) (base + offsets[symbol->section] + symbol->offset);
+            } else if (reloc->type == R_X86_64_PLT32) {
+                target = (int64_t) (base + stub_offset + jitImport(&stubs, &stub_count, symbol) * JIT_STUB_SIZE);
+            } else if (reloc->type == R_X86_64_PC32) {
+                target = (int64_t) (base + copy_offset + jitImport(&copies, &copy_count, symbol) * 8);
             } else {
-                operator->type2 = getTypeId(current_token->value.id);
-            }
-
-            //get expression
-            current_token = current_token->next;
-            //store previous node while forming linked list
-            struct token *curr_copy = NULL;
-            while(current_token->type != SEMI) { //expression ends with semicolon
-                //copy token
-                struct token *copy = copyToken(current_token);
-                //copy next and previous nodes
-                if(curr_copy == NULL) { //first iteration of while loop
-                    operator->expression = copy;
-                    curr_copy = copy;
-                    copy->next = NULL;
-                    copy->prev = NULL;
-                } else {
-                    copy->prev = curr_copy;
-                    curr_copy->next = copy;
-                    curr_copy = copy;
-                    copy->next = NULL;
-                }
-                //check if token is a variable and store variable names
-                if(current_token->type == ID) {
-                    if(operator->var1 == NULL) {
-                        operator->var1 = (char*)(malloc(strlen(current_token->value.id)));
-                        strcpy(operator->var1, current_token->value.id);
-                    } else if(operator->var2 == NULL) {
-                        operator->var2 = (char*)(malloc(strlen(current_token->value.id)));
-                        strcpy(operator->var2, current_token->value.id);
-                    } else if(!(strcmp(operator->var1, current_token->value.id) == 0 || strcmp(operator->var2, current_token->value.id) == 0)) {
-                        //expression can only handle two variables right now
-                        error(GENERAL, "too many variables in this expression");
-                    }
+                target = (int64_t) jitLookup(process, symbol->name);
+                if (target == 0) {
+                    failed = 1;
+                    break;
                 }
-                //move to next token
-                current_token = current_token->next;
             }
-        } else if(current_token->type == USER_OP) { //TODO: implement
-            //check if the user operator is a valid user operator
-            if(!isupper(current_token->value.user_op)) {
-                error(GENERAL, "invalid character for user operator");
+            int64_t value = target + reloc->addend;
+            if (reloc->type == R_X86_64_64) {
+                memcpy(place, &value, 8);
+                continue;
             }
-            
-            //find the user operator information from the linked list
-            struct user_operator *operator = user_ops;
-            while(operator != NULL) {
-                if(operator->symbol == current_token->value.user_op) {
-                    break;
-                }
-                operator = operator->next;
+            if (reloc->type != R_X86_64_32S) {
+                value -= (int64_t) place;
             }
-            if(operator == NULL) {
-                error(GENERAL, "tried to use a user operator without defining it");
+            if (value != (int32_t) value) {
+                fprintf(stderr, "%s is out of reach of the generated code\n", symbol->name);
+                failed = 1;
+                break;
             }
-
-            //ignore user operators that follow define statements, that should be handled above
-            if(current_token->prev->type != DEFINE_KWD) {
-                //get left half of expression (to left of operator)
-                struct token *leftStart = current_token->prev;
-                struct token *leftEnd = leftStart;
-                //TODO: dereferenced pointers
-                if(leftStart->type == RIGHT) { //case 1: expression or function
-                    while(leftStart->type != LEFT) { //move to left parenthesis
-                        leftStart = leftStart->prev;
-                    }
-                    if(leftStart->prev->type == ID) { //function
-                        //start at fun keyword
-                        leftStart = leftStart->prev;
-                    }
-                } else if(leftStart->type == INTEGER) { //case 2: single integer without parentheses
-                } else if(leftStart->type == ID) { //case 3: variables
-                    if(leftStart->prev->type == DOT) { //case 4: struct elements
-                        //start at struct name
-                        leftStart = leftStart->prev->prev;
-                    } else { //just a plain old variable
-                    }
-                }
-                else if(leftStart->type == RIGHT_BRACKET) { //case 5: array elements
-                    while(leftStart->type != LEFT_BRACKET) { //go back to left bracket
-                        leftStart = leftStart->prev;
-                    }
-                    //start at array name
-                    leftStart = leftStart->prev;
-                }
-                
-                //get right half of expression (to right of operator)
-                struct token *rightStart = current_token->next;
-                struct token *rightEnd = rightStart;
-                //TODO: pointers?
-                if(rightEnd->type == LEFT || rightEnd->type == FUN_KWD) { //case 1: expression or function
-                    while(rightEnd->type != RIGHT) { //move to right parenthesis
-                        rightEnd = rightEnd->next;
-                    }
-                } else if(rightEnd->type == INTEGER) { //case 2: single integer without parentheses
-                } else if(rightEnd->type == ID) { //case 3: variables
-                    if(rightEnd->next->type == DOT) { //case 4: struct elements
-                        //start at struct name
-                        rightEnd = rightEnd->next->next;
-                    } else if(rightEnd->next->type == LEFT_BRACKET) { //case 5: array elements
-                        while(rightEnd->type != RIGHT_BRACKET) { //move to right bracket
-                            rightEnd = rightEnd->next;
-                        }
-                    } else { //case 3: just a plain old variable
-                    }
-                }
-
-                //update current token
-                current_token = rightEnd->next;
-
-                //insert actual expression into place where user operator is located
-                int isFirstIteration = 1;
-                struct token *exprEnd; //stores end of expression in operator
-                struct token *exprStart = copyToken(operator->expression); //start of expression in operator
-                struct token *copy_this = operator->expression->next; //original expression node to copy
-                struct token *curr_copy = NULL; //copy of previous expression node
-                struct token *copy; //current copy of node
-                while(copy_this != NULL) {
-                    //keep track of whether or not curr_copy has been altered
-                    int curr_changed = 0;
-                    //copy token if not the first iteration, otherwise use first copy made above
-                    if(curr_copy != NULL) {
-                        copy = copyToken(copy_this);
-                        //copy next and previous nodes
-                        copy->prev = curr_copy;
-                        curr_copy->next = copy;
-                        copy->next = NULL;
-                    } else {
-                        copy = exprStart;
-                        //create links between start of expression and whole code
-                        exprStart->prev = leftStart->prev;
-                        leftStart->prev->next = exprStart;
-                    }
-                    //check if token is a variable and replace variable names with expressions
-                    if(copy->type == ID) {
-                        int ranIfs = 0;
-                        struct token *exprBegin; //beginning of expression
-                        struct token *curr_token; //previous token copied
-                        struct token *copy_this_token; //token to copy from variable expression
-                        struct token *copy_end; //last token to copy
-                        //assign variables as necessary for left or right                    
-                        if(strcmp(operator->var1, copy->value.id) == 0) { //var 1
-                            //copy whole linked list of var1 expression
-                            exprBegin = copyToken(leftStart);
-                            copy_this_token = leftStart;
-                            copy_end = leftEnd->next;
-                            ranIfs = 1;
-                        } else if(strcmp(operator->var2, copy->value.id) == 0) { //var 2
-                            //copy whole linked list of var2 expression
-                            exprBegin = copyToken(rightStart);
-                            copy_this_token = rightStart;
-                            copy_end = rightEnd->next;
-                            ranIfs = 1;
-                        }
-                    
-                        if(ranIfs) {
-                            curr_token = NULL;
-                            //copy whole linked list of expressions for the specified variable
-                            while(copy_this_token != copy_end) {
-                                struct token *copy2;
-                                if(curr_token == NULL) { //first iteration
-                                    copy2 = exprBegin;
-                                    //create links
-                                    exprBegin->prev = copy->prev;
-                                    copy->prev->next = exprBegin;
-                                    //save new start of expression
-                                    if(copy == exprStart) {
-                                        exprStart = exprBegin;
-                                    }
-                                } else {
-                                    copy2 = copyToken(copy_this_token);
-                                    copy2->prev = curr_token;
-                                    curr_token->next = copy2;
-                                }
-                                copy2->next = NULL;
-                                curr_token = copy2;
-                                copy_this_token = copy_this_token->next;
-                            }
-                            //link boundary nodes in expression and greater chunk
-                            //copy = node currently storing the variable
-                            curr_token->next = copy->next;
-                            if(copy->next != NULL) {
-                                copy->next->prev = curr_token;
-                            }
-                            exprEnd = curr_token;
-                            curr_copy = exprEnd;
-                            curr_changed = 1;
-                        }
-                    }
-                    //move to next token
-                    if(!curr_changed) {
-                        curr_copy = copy;
-                    }
-                    //if(curr_copy != exprStart) { //not first iteration of while
-                    if(!isFirstIteration) {
-                        copy_this = copy_this->next;
-                    } else {
-                        isFirstIteration = 0;
-                    }
-                } //end while
-                //break links between overall code and this whole expression, insert expression into empty space
-                leftStart->prev->next = exprStart;
-                exprStart->prev = leftStart->prev;
-                exprEnd->next = current_token;
-                current_token->prev = exprEnd;
-            }//end if !define 
-        } //end while
-        //check next token unless we've hit the end
-        if(current_token->type != END) {
-            current_token = current_token->next;
+            int32_t field = value;
+            memcpy(place, &field, 4);
         }
-    } //end while
-    //reset to first token before exiting method
-    current_token = first_token;
+    }
+    for (int i = 0; i < asm_section_count; i++) {
+        int protection = PROT_READ;
+        if (asm_sections[i].flags & SHF_EXECINSTR) {
+            protection |= PROT_EXEC;
+        } else if (asm_sections[i].flags & SHF_WRITE) {
+            protection |= PROT_WRITE;
+        }
+        if (asm_sections[i].size > 0) {
+            mprotect(base + offsets[i], jitPages(asm_sections[i].size, page), protection);
+        }
+    }
+    if (stub_count > 0) {
+        mprotect(base + stub_offset, jitPages(stub_count * JIT_STUB_SIZE, page), PROT_READ | PROT_EXEC);
+    }
+    if (copy_count > 0) {
+        mprotect(base + copy_offset, jitPages(copy_count * 8, page), PROT_READ);
+    }
+    free(stubs);
+    free(copies);
+    struct asm_symbol *entry = asmSymbol("main");
+    if (entry->section < 0) {
+        fprintf(stderr, "undefined symbol main\n");
+        failed = 1;
+    }
+    if (failed) {
+        return 1;
+    }
+    int (*main_label)(void) = (int (*)(void)) (base + offsets[entry->section] + entry->offset);
+    return main_label();
 }
 
 void program(void) {
-    //second pass to replace user operators with their expressions
+    //second pass to collect the user operators
     definePass();
+    collectSignatures();
     //other top level statements
     while (1) {
         if (isDefine()) {
@@ -2713,76 +9407,101 @@ void program(void) {
             function();
         } else if (isStruct()) {
             structDef();
-        } else if (isType()) {
+        } else if (isType() || isConst()) {
             globalVarDef();
         } else {
             break;
         }
     }
-    printf("    global_%d:\n", num_global_vars);
+    //clones requested by calls, including calls made from inside other clones
+    struct token *end_token = current_token;
+    for (current_clone = clone_head; current_clone != 0; current_clone = current_clone->next) {
+        current_token = current_clone->signature->start;
+        function();
+    }
+    current_token = end_token;
+    //the initializers that could not be laid out statically, in program order
+    printf("globals_init:\n");
+    if (global_init != 0) {
+        fclose(global_init);
+        printf("%s", global_init_code);
+        free(global_init_code);
+    }
     printf("    ret\n");
     if (!isEnd())
         error(GENERAL, "Expected end of file\n");
 }
 
+/* reads the tokens of the program from stdin and sets up the global scope */
+void readProgram(void) {
+    //Standard types are defined before token parsing since this knowledge is needed to know if a token is a type token
+    definedTypes = calloc(10, sizeof(long));
+    addStandardTypes();
+    struct_info = malloc(sizeof(struct struct_data));
+    id_buffer = malloc(10);
+    id_buffer_size = 10;
+    first_token = getToken();
+    current_token = first_token;
+    while (current_token->type != END) {
+        insertToken(current_token, getToken());
+        if(current_token->type == STRUCT_KWD){
+            addType(current_token->next->value.id);
+        }
+        current_token = current_token->next;
+    }
+    for (current_token = first_token; current_token != 0; current_token = current_token->next) {
+        current_token->index = token_count++;
+        token_hash = tokenHash(token_hash, current_token);
+    }
+    current_token = first_token;
+    if (profile_use != 0) {
+        readProfile(profile_use);
+    }
+    namespace_head = malloc(sizeof(struct trie_node));
+    namespace_head->root_ptr = calloc(1, sizeof(struct trie_node));
+    namespace_head->next_var_num = -1;
+    namespace_head->next = 0;
+}
+
 void compile(void) {
+    readProgram();
+    if (emit_c) {
+        if (setjmp(escape) == 0) {
+            cProgram();
+        }
+        return;
+    }
     printf("    .text\n");
     printf("    .global main\n");
     printf("main:\n");
+    //global initializers and main_fun use the callee-saved accumulators
+    printf("    push %%rbx\n");
+    printf("    push %%r13\n");
+    printf("    push %%r14\n");
+    printf("    push %%r15\n");
     printf("    sub $8,%%rsp\n");
     printf("    rdtsc\n");
     printf("    shr $32,%%rdx\n");
     printf("    or %%rdx,%%rax\n");
     printf("    mov %%rax,rand_seed\n");
-    printf("    call global_0\n");
+    if (profile_file != 0) {
+        printf("    mov $profile_write,%%rdi\n");
+        printf("    call atexit\n");
+    }
+    if (print_arena_stats) {
+        printf("    mov $arena_stats_fun,%%rdi\n");
+        printf("    call atexit\n");
+    }
+    printf("    call globals_init\n");
     printf("    call main_fun\n");
     printf("    mov $0,%%rax\n");
     printf("    add $8,%%rsp\n");
+    printf("    pop %%r15\n");
+    printf("    pop %%r14\n");
+    printf("    pop %%r13\n");
+    printf("    pop %%rbx\n");
     printf("    ret\n");
     printf("//STANDARD FUNCTIONS BLOCK\n");
-    printf("drawrect_fun:\n");
-    printf("    pushq %%r8\n");
-    printf("    movq 16(%%rsp), %%rdi\n");
-    printf("    movq 24(%%rsp), %%rsi\n");
-    printf("    movq 32(%%rsp), %%rdx\n");
-    printf("    movq 40(%%rsp), %%rcx\n");
-    printf("    call bg_drawrect\n");
-    printf("    popq %%r8\n");
-    printf("    ret\n");
-    printf("setcolor_fun:\n");
-    printf("    push %%r8\n");
-    printf("    movq 16(%%rsp), %%rdi\n");
-    printf("    movq 24(%%rsp), %%rsi\n");
-    printf("    movq 32(%%rsp), %%rdx\n");
-    printf("    call bg_setcolor\n");
-    printf("    pop %%r8\n");
-    printf("    ret\n");
-    printf("startpolygon_fun:\n");
-    printf("    push %%r8\n");
-    printf("    call bg_startpolygon\n");
-    printf("    pop %%r8\n");
-    printf("    ret\n");
-    printf("addpoint_fun:\n");
-    printf("    push %%r8\n");
-    printf("    movq 16(%%rsp), %%rdi\n");
-    printf("    movq 24(%%rsp), %%rsi\n");
-    printf("    call bg_addpoint\n");
-    printf("    pop %%r8\n");
-    printf("    ret\n");
-    printf("endpolygon_fun:\n");
-    printf("    push %%r8\n");
-    printf("    call bg_endpolygon\n");
-    printf("    pop %%r8\n");
-    printf("    ret\n");
-    printf("drawngon_fun:\n");
-    printf("    push %%r8\n");
-    printf("    movq 16(%%rsp), %%rdi\n");
-    printf("    movq 24(%%rsp), %%rsi\n");
-    printf("    movq 32(%%rsp), %%rdx\n");
-    printf("    movq 40(%%rsp), %%rcx\n");
-    printf("    call bg_drawngon\n");
-    printf("    pop %%r8\n");
-    printf("    ret\n");
     printf("random_fun:\n");
     printf("    mov rand_seed,%%rax\n");
     printf("    mov %%rax,%%rdi\n");
@@ -2797,44 +9516,36 @@ void compile(void) {
     printf("    mov %%rax,rand_seed\n");
     printf("    ret\n");
     printf("getchar_fun:\n");
-    printf("    push %%r8\n");
+    printf("    sub $8,%%rsp\n");
     printf("    call getchar\n");
     printf("    movslq %%eax, %%rax\n");
-    printf("    pop %%r8\n");
+    printf("    add $8,%%rsp\n");
     printf("    ret\n");
     printf("printchar_fun:\n");
-    printf("    push %%r8\n");
+    printf("    sub $8,%%rsp\n");
+    printf("    mov %%rdi, %%rsi\n");
     printf("    mov $output_format_char, %%rdi\n");
-    printf("    mov 16(%%rsp), %%rsi\n");
     printf("    call printf\n");
-    printf("    pop %%r8\n");
+    printf("    add $8,%%rsp\n");
     printf("    ret\n");
     printf("//END STANDARD FUNCTIONS BLOCK\n");
 
-    //Standard types are defined before token parsing since this knowledge is needed to know if a token is a type token
-    definedTypes = calloc(10, sizeof(long));
-    addStandardTypes();
-    struct_info = malloc(sizeof(struct struct_data));
-    id_buffer = malloc(10);
-    id_buffer_size = 10;
-    first_token = getToken();
-    current_token = first_token;
-    while (current_token->type != END) {
-        insertToken(current_token, getToken());
-        if(current_token->type == STRUCT_KWD){
-            addType(current_token->next->value.id);
-        }
-        current_token = current_token->next;
-    }
-    current_token = first_token;
-    namespace_head = malloc(sizeof(struct trie_node));
-    namespace_head->root_ptr = calloc(1, sizeof(struct trie_node));
-    namespace_head->next_var_num = -1;
-    namespace_head->next = 0;
     int x = setjmp(escape);
     if (x == 0) {
         program();
     }
+    if (profile_file != 0) {
+        printProfileWriter();
+    }
+    if (print_arena_stats) {
+        //atexit gets this instead of arena_stats, whose address may not fit an immediate when --run
+        //maps the code below 2GB and p5 itself is position independent; the call goes through a stub
+        printf("arena_stats_fun:\n");
+        printf("    sub $8,%%rsp\n");
+        printf("    call arena_stats\n");
+        printf("    add $8,%%rsp\n");
+        printf("    ret\n");
+    }
     printf("    .data\n");
     printf("output_format:\n");
     printf("    .string \"%%" PRIu64 "\\n\"\n");
@@ -2848,15 +9559,118 @@ void compile(void) {
     printf("    .string \"Potato, the Epic Window\"\n");
     printf("rbp_store:\n");
     printf("    .quad 0\n");
+    printf("key_store:\n");
+    printf("    .quad 0\n");
     printf("rand_seed:\n");
     printf("    .quad 10\n");
+    if (profile_file != 0) {
+        printProfileData();
+    }
     initVars(namespace_head->root_ptr);
+    printTables();
+    printStringLiterals();
+    if (pass_stats) {
+        printPassStats();
+    }
     free(id_buffer);
     freeTrie(namespace_head->root_ptr);
     free(namespace_head);
 }
 
+/* runs the assembly backend into memory and encodes the result; returns nonzero on failure */
+int compileToSections(void) {
+    FILE *out = stdout;
+    char *text = 0;
+    size_t text_size = 0;
+    stdout = open_memstream(&text, &text_size);
+    compile();
+    fclose(stdout);
+    stdout = out;
+    int failed = assemble(text);
+    free(text);
+    return failed;
+}
+
 int main(int argc, char *argv[]) {
+    char *source = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--profile-generate") == 0) {
+            profile_file = "hotpi.profile";
+        } else if (strncmp(argv[i], "--profile-generate=", 19) == 0) {
+            profile_file = argv[i] + 19;
+        } else if (strcmp(argv[i], "--profile-use") == 0) {
+            profile_use = "hotpi.profile";
+        } else if (strncmp(argv[i], "--profile-use=", 14) == 0) {
+            profile_use = argv[i] + 14;
+        } else if (strcmp(argv[i], "-O0") == 0 || strcmp(argv[i], "-O1") == 0 || strcmp(argv[i], "-O2") == 0) {
+            opt_level = argv[i][2] - '0';
+        } else if (strncmp(argv[i], "-fno-", 5) == 0 && findPass(argv[i] + 5) != 0) {
+            findPass(argv[i] + 5)->disabled = 1;
+        } else if (strncmp(argv[i], "--print-after=", 14) == 0 && findPass(argv[i] + 14) != 0) {
+            print_after = argv[i] + 14;
+        } else if (strcmp(argv[i], "--pass-stats") == 0) {
+            pass_stats = 1;
+        } else if (strcmp(argv[i], "--emit=asm") == 0 || strcmp(argv[i], "--emit=c") == 0
+                || strcmp(argv[i], "--emit=obj") == 0) {
+            emit_c = strcmp(argv[i] + 7, "c") == 0;
+            emit_obj = strcmp(argv[i] + 7, "obj") == 0;
+        } else if (strcmp(argv[i], "--arena-stats") == 0) {
+            print_arena_stats = 1;
+        } else if (strcmp(argv[i], "--run") == 0) {
+            run_program = 1;
+        } else if (argv[i][0] != '-' && source == 0) {
+            source = argv[i];
+        } else {
+            fprintf(stderr, "usage: %s [-O0|-O1|-O2] [-fno-<pass>] [--print-after=<pass>] [--pass-stats]\n"
+                    "          [--profile-generate[=file]] [--profile-use[=file]] [--arena-stats] [--emit=asm|c|obj | --run]\n"
+                    "          [program.pi | < program.pi]\n", argv[0]);
+            fprintf(stderr, "passes:");
+            for (int i = 0; i < PASS_COUNT; i++) {
+                fprintf(stderr, " %s (-O%d)", passes[i].name, passes[i].level);
+            }
+            fprintf(stderr, "\n");
+            return 1;
+        }
+    }
+    if (run_program) {
+        //the JIT runs what the assembly backend prints
+        emit_c = 0;
+        emit_obj = 0;
+    }
+    if (emit_c && (profile_file != 0 || profile_use != 0)) {
+        fprintf(stderr, "profiles are ignored with --emit=c\n");
+        profile_file = 0;
+        profile_use = 0;
+    }
+    //the tokenizer reads stdin, which a program named on the command line stands in for
+    int input = -1;
+    if (source != 0) {
+        int fd = open(source, O_RDONLY);
+        if (fd < 0) {
+            perror(source);
+            return 1;
+        }
+        input = dup(0);
+        dup2(fd, 0);
+        close(fd);
+    }
+    if (emit_obj || run_program) {
+        int failed = compileToSections();
+        if (input >= 0) {
+            //hand the real stdin back to the program
+            dup2(input, 0);
+            close(input);
+            clearerr(stdin);
+        }
+        if (failed || (run_program && num_errors > 0)) {
+            return 1;
+        }
+        if (run_program) {
+            return jitRun();
+        }
+        asmWriteObject(stdout);
+        return 0;
+    }
     compile();
     return 0;
 }
@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+/*
+ * Heap storage of Hot-Pi programs: the arrays and structs that escape the
+ * frame. Inside an arena block they are bump allocated from chunks, and the
+ * block gives back everything allocated since it started in one step when it
+ * ends. Outside of arena blocks they are malloc'd and never freed.
+ *
+ * Every thread has its own arenas, so no locking is needed.
+ */
+
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+struct arena_chunk {
+    struct arena_chunk *next;
+    char *end;
+    char data[];
+};
+
+/* what arena_leave restores; kept at the start of the block's own allocations, in the chunk
+   they start in */
+struct arena_mark {
+    struct arena_chunk *chunk;
+    uint64_t level;
+    uint64_t in_use;
+};
+
+//chunks are used in list order; the ones after the current chunk are free
+static __thread struct arena_chunk *arena_first = 0;
+static __thread struct arena_chunk *arena_chunk = 0;
+static __thread char *arena_position = 0;
+//number of arena blocks the thread is in
+static __thread uint64_t arena_level = 0;
+
+static __thread uint64_t arena_in_use = 0;
+static __thread uint64_t arena_peak = 0;
+static __thread uint64_t arena_reserved = 0;
+static __thread uint64_t arena_chunks = 0;
+static __thread uint64_t arena_blocks = 0;
+static __thread uint64_t arena_allocations = 0;
+static __thread uint64_t arena_bytes = 0;
+static __thread uint64_t heap_allocations = 0;
+static __thread uint64_t heap_bytes = 0;
+
+/* moves to a chunk after the current one with room for size bytes, making one if there is none */
+static void arena_grow(uint64_t size) {
+    struct arena_chunk *chunk = arena_chunk != 0 ? arena_chunk->next : arena_first;
+    if (chunk == 0 || (uint64_t) (chunk->end - chunk->data) < size) {
+        uint64_t capacity = size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE;
+        struct arena_chunk *fresh = malloc(sizeof(struct arena_chunk) + capacity);
+        if (fresh == 0) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+        fresh->end = fresh->data + capacity;
+        fresh->next = chunk;
+        if (arena_chunk != 0) {
+            arena_chunk->next = fresh;
+        } else {
+            arena_first = fresh;
+        }
+        chunk = fresh;
+        arena_reserved += capacity;
+        arena_chunks++;
+    }
+    arena_chunk = chunk;
+    arena_position = chunk->data;
+}
+
+static void *arena_bump(uint64_t size) {
+    size = (size + 7) & ~(uint64_t) 7;
+    if (arena_chunk == 0 || (uint64_t) (arena_chunk->end - arena_position) < size) {
+        arena_grow(size);
+    }
+    void *block = arena_position;
+    arena_position += size;
+    arena_in_use += size;
+    if (arena_in_use > arena_peak) {
+        arena_peak = arena_in_use;
+    }
+    return block;
+}
+
+/* allocates storage for an array or struct */
+void *arena_alloc(uint64_t size) {
+    if (arena_level == 0) {
+        heap_allocations++;
+        heap_bytes += size;
+        void *block = malloc(size);
+        if (block == 0) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+        return block;
+    }
+    arena_allocations++;
+    arena_bytes += size;
+    return arena_bump(size);
+}
+
+/* starts an arena block; returns the mark that ends it */
+void *arena_enter(void) {
+    uint64_t in_use = arena_in_use;
+    struct arena_mark *mark = arena_bump(sizeof(struct arena_mark));
+    mark->chunk = arena_chunk;
+    mark->level = arena_level++;
+    mark->in_use = in_use;
+    arena_blocks++;
+    return mark;
+}
+
+/* ends the arena block of the mark and of every block inside it that is still open */
+void arena_leave(void *block) {
+    struct arena_mark *mark = block;
+    arena_chunk = mark->chunk;
+    arena_position = (char *) mark;
+    arena_level = mark->level;
+    arena_in_use = mark->in_use;
+}
+
+/* prints what the thread allocated, for --arena-stats */
+void arena_stats(void) {
+    fprintf(stderr, "heap: %lu allocations, %lu bytes\n", (unsigned long) heap_allocations,
+            (unsigned long) heap_bytes);
+    fprintf(stderr, "arena: %lu blocks, %lu allocations, %lu bytes, peak %lu bytes\n",
+            (unsigned long) arena_blocks, (unsigned long) arena_allocations, (unsigned long) arena_bytes,
+            (unsigned long) arena_peak);
+    fprintf(stderr, "arena chunks: %lu, %lu bytes\n", (unsigned long) arena_chunks,
+            (unsigned long) arena_reserved);
+}
@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <emmintrin.h>
+
+/*
+ * Strings of Hot-Pi programs. A string is the address of its bytes, with the length in the word
+ * before them and a 0 byte after them, so literals in .rodata and buffers from str_new look the
+ * same. The length is never scanned for.
+ *
+ * Searching and comparing look at 16 bytes at a time with SSE2, which every x86-64 has; copies,
+ * reads and writes go through memcpy and stdio a block at a time.
+ */
+
+void *arena_alloc(uint64_t size);
+
+#define STRING_LENGTH(s) (((uint64_t *) (uintptr_t) (s))[-1])
+
+/* a string of length zero bytes, allocated like an array, so an arena block gives it back */
+uint64_t str_new(uint64_t length) {
+    uint64_t *block = arena_alloc(sizeof(uint64_t) + length + 1);
+    block[0] = length;
+    memset(block + 1, 0, length + 1);
+    return (uint64_t) (uintptr_t) (block + 1);
+}
+
+uint64_t str_length(uint64_t s) {
+    return STRING_LENGTH(s);
+}
+
+/* the index of the first byte c in s, or the length of s if there is none */
+uint64_t str_find(uint64_t s, uint64_t c) {
+    const unsigned char *bytes = (const unsigned char *) (uintptr_t) s;
+    uint64_t length = STRING_LENGTH(s);
+    __m128i wanted = _mm_set1_epi8((char) c);
+    uint64_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *) (bytes + i));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, wanted));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    for (; i < length; i++) {
+        if (bytes[i] == (unsigned char) c) {
+            return i;
+        }
+    }
+    return length;
+}
+
+/* 0 if the strings are equal, else 1 if a sorts after b and -1 if it sorts before, by bytes */
+uint64_t str_compare(uint64_t a, uint64_t b) {
+    const unsigned char *left = (const unsigned char *) (uintptr_t) a;
+    const unsigned char *right = (const unsigned char *) (uintptr_t) b;
+    uint64_t left_length = STRING_LENGTH(a);
+    uint64_t right_length = STRING_LENGTH(b);
+    uint64_t length = left_length < right_length ? left_length : right_length;
+    uint64_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i same = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (left + i)),
+                _mm_loadu_si128((const __m128i *) (right + i)));
+        int mask = _mm_movemask_epi8(same) ^ 0xffff;
+        if (mask != 0) {
+            i += __builtin_ctz(mask);
+            return left[i] < right[i] ? (uint64_t) -1 : 1;
+        }
+    }
+    for (; i < length; i++) {
+        if (left[i] != right[i]) {
+            return left[i] < right[i] ? (uint64_t) -1 : 1;
+        }
+    }
+    return left_length == right_length ? 0 : left_length < right_length ? (uint64_t) -1 : 1;
+}
+
+/* copies src into dst starting at index at, as much as fits; returns the index after the copy */
+uint64_t str_copy(uint64_t dst, uint64_t at, uint64_t src) {
+    uint64_t room = STRING_LENGTH(dst);
+    if (at >= room) {
+        return room;
+    }
+    uint64_t length = STRING_LENGTH(src);
+    if (length > room - at) {
+        length = room - at;
+    }
+    memmove((char *) (uintptr_t) dst + at, (const char *) (uintptr_t) src, length);
+    return at + length;
+}
+
+/* reads up to the length of s bytes of standard input into it; returns how many, 0 at the end */
+uint64_t str_read(uint64_t s) {
+    return fread((char *) (uintptr_t) s, 1, STRING_LENGTH(s), stdin);
+}
+
+/* writes the first count bytes of s to standard output, at most all of them */
+uint64_t str_write(uint64_t s, uint64_t count) {
+    uint64_t length = STRING_LENGTH(s);
+    return fwrite((const char *) (uintptr_t) s, 1, count < length ? count : length, stdout);
+}
+
+/* what print does with a string: all of it and a newline */
+void str_print(uint64_t s) {
+    fwrite((const char *) (uintptr_t) s, 1, STRING_LENGTH(s), stdout);
+    putchar('\n');
+}